@@ -0,0 +1,313 @@
+/*
+* Copyright 2020 Comcast Cable Communications Management, LLC
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* SPDX-License-Identifier: Apache-2.0
+*/
+
+#include "RdkCVAColorConvert.h"
+#include "RdkCVAImageTools.h"
+
+/**
+ * @brief This function is used to describe a frame from its separate planes.
+ * @param format is the frame layout.
+ * @param width is the frame width.
+ * @param height is the frame height.
+ * @param y_data is the Y plane and y_step its row step.
+ * @param c_data is the first chroma plane in memory order (UV, VU, V or U) and c_step its row step.
+ * @param c2_data is the second chroma plane of the planar formats (U or V) and c2_step its row step.
+ * @param desc is the filled descriptor.
+ * @return RDKC_SUCCESS on success.
+ */
+int ColorConvert::Describe(yuv_format_t format, int width, int height,
+			   unsigned char *y_data, int y_step, unsigned char *c_data, int c_step,
+			   unsigned char *c2_data, int c2_step, YUVFrameDesc *desc)
+{
+	if( (NULL == desc) || (NULL == y_data) || (NULL == c_data) || (width <= 0) || (height <= 0) ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Invalid arguments\n",__FUNCTION__,__LINE__);
+		return RDKC_FAILURE;
+	}
+	if( !IsSemiPlanar(format) && (NULL == c2_data) ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Planar format %d needs two chroma planes\n",__FUNCTION__,__LINE__, format);
+		return RDKC_FAILURE;
+	}
+
+	desc->format = format;
+	desc->width = width;
+	desc->height = height;
+	desc->y.data = y_data;
+	desc->y.step = y_step;
+
+	switch( format ) {
+	case YUV_FORMAT_NV12:
+		desc->u.data = c_data;
+		desc->v.data = c_data + 1;
+		desc->u.step = desc->v.step = c_step;
+		break;
+	case YUV_FORMAT_NV21:
+		desc->v.data = c_data;
+		desc->u.data = c_data + 1;
+		desc->u.step = desc->v.step = c_step;
+		break;
+	case YUV_FORMAT_YV12:
+		desc->v.data = c_data;
+		desc->v.step = c_step;
+		desc->u.data = c2_data;
+		desc->u.step = c2_step;
+		break;
+	case YUV_FORMAT_I420:
+		desc->u.data = c_data;
+		desc->u.step = c_step;
+		desc->v.data = c2_data;
+		desc->v.step = c2_step;
+		break;
+	default:
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Unknown format %d\n",__FUNCTION__,__LINE__, format);
+		return RDKC_FAILURE;
+	}
+
+	return RDKC_SUCCESS;
+}
+
+/**
+ * @brief This function is used to describe a frame held in one buffer, the chroma
+ *        planes follow the Y plane and planar chroma rows use half the luma step.
+ * @param format is the frame layout.
+ * @param width is the frame width.
+ * @param height is the frame height.
+ * @param data is the buffer.
+ * @param step is the Y row step.
+ * @param desc is the filled descriptor.
+ * @return RDKC_SUCCESS on success.
+ */
+int ColorConvert::DescribeContiguous(yuv_format_t format, int width, int height, unsigned char *data, int step, YUVFrameDesc *desc)
+{
+	if( NULL == data ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Invalid arguments\n",__FUNCTION__,__LINE__);
+		return RDKC_FAILURE;
+	}
+
+	unsigned char *chroma = data + ((size_t)step * height);
+	if( IsSemiPlanar(format) ) {
+		return Describe(format, width, height, data, step, chroma, step, NULL, 0, desc);
+	}
+
+	return Describe(format, width, height, data, step, chroma, step / 2,
+			chroma + ((size_t)(step / 2) * (height / 2)), step / 2, desc);
+}
+
+/**
+ * @brief This function is used to get the size of a contiguous frame without row padding.
+ * @param width is the frame width.
+ * @param height is the frame height.
+ * @return size in bytes.
+ */
+size_t ColorConvert::ContiguousSize(int width, int height)
+{
+	return (size_t)width * height * 3 / 2;
+}
+
+/**
+ * @brief This function is used to get the Y plane as a gray image, no copy.
+ * @param src is the frame.
+ * @return gray image referring to the Y plane.
+ */
+cv::Mat ColorConvert::GrayView(const YUVFrameDesc &src)
+{
+	return cv::Mat(src.height, src.width, CV_8UC1, src.y.data, src.y.step);
+}
+
+/**
+ * @brief This function is used to get the interleaved chroma plane of a semi-planar frame, no copy.
+ * @param src is the frame.
+ * @return two channel image referring to the chroma plane.
+ */
+cv::Mat ColorConvert::ChromaView(const YUVFrameDesc &src)
+{
+	unsigned char *base = (src.u.data < src.v.data) ? src.u.data : src.v.data;
+
+	return cv::Mat(src.height / 2, src.width / 2, CV_8UC2, base, src.u.step);
+}
+
+/**
+ * @brief This function is used to resize or copy every plane of src into the planes of dst.
+ *        Both frames must use the same layout.
+ * @param src is the source frame.
+ * @param dst is the destination frame, its planes must already exist.
+ * @return RDKC_SUCCESS on success.
+ */
+int ColorConvert::Resize(const YUVFrameDesc &src, const YUVFrameDesc &dst)
+{
+	if( IsSemiPlanar(src.format) != IsSemiPlanar(dst.format) ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Layout mismatch %d -> %d\n",__FUNCTION__,__LINE__, src.format, dst.format);
+		return RDKC_FAILURE;
+	}
+
+	bool same_size = (src.width == dst.width) && (src.height == dst.height);
+	cv::Mat srcY = GrayView(src);
+	cv::Mat dstY = GrayView(dst);
+
+	if( same_size ) {
+		srcY.copyTo(dstY);
+	}
+	else {
+		cv::resize(srcY, dstY, dstY.size(), 0, 0, cv::INTER_AREA);
+	}
+
+	if( IsSemiPlanar(src.format) ) {
+		cv::Mat srcC = ChromaView(src);
+		cv::Mat dstC = ChromaView(dst);
+		if( same_size ) {
+			srcC.copyTo(dstC);
+		}
+		else {
+			cv::resize(srcC, dstC, dstC.size(), 0, 0, cv::INTER_AREA);
+		}
+		/* NV12 <-> NV21 swaps the interleaved samples */
+		if( src.format != dst.format ) {
+			std::vector<cv::Mat> uv;
+			cv::split(dstC, uv);
+			std::swap(uv[0], uv[1]);
+			cv::merge(uv, dstC);
+		}
+		return RDKC_SUCCESS;
+	}
+
+	const YUVPlane *srcPlanes[2] = { &src.u, &src.v };
+	const YUVPlane *dstPlanes[2] = { &dst.u, &dst.v };
+	for( int i = 0; i < 2; i++ ) {
+		cv::Mat srcC(src.height / 2, src.width / 2, CV_8UC1, srcPlanes[i]->data, srcPlanes[i]->step);
+		cv::Mat dstC(dst.height / 2, dst.width / 2, CV_8UC1, dstPlanes[i]->data, dstPlanes[i]->step);
+		if( same_size ) {
+			srcC.copyTo(dstC);
+		}
+		else {
+			cv::resize(srcC, dstC, dstC.size(), 0, 0, cv::INTER_AREA);
+		}
+	}
+
+	return RDKC_SUCCESS;
+}
+
+/**
+ * @brief This function is used to check whether a planar frame is laid out like a
+ *        contiguous I420/YV12 buffer: no row padding and chroma planes right after Y.
+ * @param src is the frame.
+ * @return true if the planes can be viewed as one buffer.
+ */
+static bool is_contiguous_planar(const YUVFrameDesc &src)
+{
+	size_t y_size = (size_t)src.width * src.height;
+	size_t c_size = y_size / 4;
+	const YUVPlane &first = (YUV_FORMAT_YV12 == src.format) ? src.v : src.u;
+	const YUVPlane &second = (YUV_FORMAT_YV12 == src.format) ? src.u : src.v;
+
+	return (src.y.step == src.width) && (first.step == src.width / 2) && (second.step == src.width / 2) &&
+	       (first.data == src.y.data + y_size) && (second.data == first.data + c_size);
+}
+
+/**
+ * @brief This function is used to check whether a semi-planar frame is laid out like one
+ *        NV12/NV21 buffer: the chroma plane right after Y, with the same row step.
+ * @param src is the frame.
+ * @return true if the planes can be viewed as one buffer.
+ */
+static bool is_contiguous_semiplanar(const YUVFrameDesc &src)
+{
+	unsigned char *chroma = (src.u.data < src.v.data) ? src.u.data : src.v.data;
+
+	return (src.u.step == src.y.step) && (chroma == src.y.data + ((size_t)src.y.step * src.height));
+}
+
+/**
+ * @brief This function is used to convert a frame to BGR, RGB or gray with cv::cvtColor.
+ *        A frame whose planes are laid out like one buffer is converted from a single view
+ *        of it, other frames are packed into one buffer first.
+ * @param src is the frame, width and height must be even.
+ * @param out is the output format.
+ * @param dst is the output image, reallocated only when its size or type changes.
+ * @return RDKC_SUCCESS on success.
+ */
+int ColorConvert::Convert(const YUVFrameDesc &src, color_out_t out, cv::Mat &dst)
+{
+	if( (NULL == src.y.data) || (NULL == src.u.data) || (NULL == src.v.data) ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Invalid frame\n",__FUNCTION__,__LINE__);
+		return RDKC_FAILURE;
+	}
+
+	if( COLOR_OUT_GRAY == out ) {
+		GrayView(src).copyTo(dst);
+		return RDKC_SUCCESS;
+	}
+
+	if( (src.width & 1) || (src.height & 1) ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Odd frame size %dx%d\n",__FUNCTION__,__LINE__, src.width, src.height);
+		return RDKC_FAILURE;
+	}
+
+	bool rgb = (COLOR_OUT_RGB == out);
+	int code = 0;
+
+	switch( src.format ) {
+	case YUV_FORMAT_NV12:
+		code = rgb ? cv::COLOR_YUV2RGB_NV12 : cv::COLOR_YUV2BGR_NV12;
+		break;
+	case YUV_FORMAT_NV21:
+		code = rgb ? cv::COLOR_YUV2RGB_NV21 : cv::COLOR_YUV2BGR_NV21;
+		break;
+	case YUV_FORMAT_YV12:
+		code = rgb ? cv::COLOR_YUV2RGB_YV12 : cv::COLOR_YUV2BGR_YV12;
+		break;
+	case YUV_FORMAT_I420:
+		code = rgb ? cv::COLOR_YUV2RGB_I420 : cv::COLOR_YUV2BGR_I420;
+		break;
+	default:
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Unknown format %d\n",__FUNCTION__,__LINE__, src.format);
+		return RDKC_FAILURE;
+	}
+
+	if( IsSemiPlanar(src.format) ) {
+		if( is_contiguous_semiplanar(src) ) {
+			cv::cvtColor(cv::Mat(src.height * 3 / 2, src.width, CV_8UC1, src.y.data, src.y.step), dst, code);
+			return RDKC_SUCCESS;
+		}
+
+		/* separate Y and UV buffers, pack them first */
+		cv::Mat packed(src.height * 3 / 2, src.width, CV_8UC1);
+		GrayView(src).copyTo(packed.rowRange(0, src.height));
+		ChromaView(src).copyTo(packed.rowRange(src.height, src.height * 3 / 2).reshape(2));
+		cv::cvtColor(packed, dst, code);
+		return RDKC_SUCCESS;
+	}
+
+	if( is_contiguous_planar(src) ) {
+		cv::cvtColor(cv::Mat(src.height * 3 / 2, src.width, CV_8UC1, src.y.data), dst, code);
+		return RDKC_SUCCESS;
+	}
+
+	/* padded rows or scattered planes, pack them in memory order first */
+	cv::Mat packed(src.height * 3 / 2, src.width, CV_8UC1);
+	size_t y_size = (size_t)src.width * src.height;
+	const YUVPlane &first = (YUV_FORMAT_YV12 == src.format) ? src.v : src.u;
+	const YUVPlane &second = (YUV_FORMAT_YV12 == src.format) ? src.u : src.v;
+
+	GrayView(src).copyTo(packed.rowRange(0, src.height));
+	cv::Mat(src.height / 2, src.width / 2, CV_8UC1, first.data, first.step)
+		.copyTo(cv::Mat(src.height / 2, src.width / 2, CV_8UC1, packed.data + y_size));
+	cv::Mat(src.height / 2, src.width / 2, CV_8UC1, second.data, second.step)
+		.copyTo(cv::Mat(src.height / 2, src.width / 2, CV_8UC1, packed.data + y_size + (y_size / 4)));
+	cv::cvtColor(packed, dst, code);
+
+	return RDKC_SUCCESS;
+}
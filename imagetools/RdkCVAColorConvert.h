@@ -0,0 +1,80 @@
+/*
+* Copyright 2020 Comcast Cable Communications Management, LLC
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* SPDX-License-Identifier: Apache-2.0
+*/
+
+#ifndef __RDKCVA_COLORCONVERT_H_
+#define __RDKCVA_COLORCONVERT_H_
+
+/*************************       INCLUDES         *************************/
+#include <opencv2/opencv.hpp>
+
+/* YUV 4:2:0 layouts */
+typedef enum {
+	YUV_FORMAT_NV12 = 0,	/* Y plane, interleaved UV plane */
+	YUV_FORMAT_NV21,	/* Y plane, interleaved VU plane */
+	YUV_FORMAT_YV12,	/* Y plane, V plane, U plane */
+	YUV_FORMAT_I420		/* Y plane, U plane, V plane */
+} yuv_format_t;
+
+/* Output of a conversion */
+typedef enum {
+	COLOR_OUT_BGR = 0,
+	COLOR_OUT_RGB,
+	COLOR_OUT_GRAY
+} color_out_t;
+
+struct YUVPlane
+{
+	unsigned char *data;
+	int step;		/* bytes between rows */
+};
+
+/* A YUV 4:2:0 frame described in place. For the semi-planar formats u and v point into
+   the same interleaved plane, one byte apart, and share its step */
+struct YUVFrameDesc
+{
+	yuv_format_t format;
+	int width;
+	int height;
+	YUVPlane y;
+	YUVPlane u;
+	YUVPlane v;
+};
+
+class ColorConvert
+{
+public:
+	/* Describe a frame from its separate planes */
+	static int Describe(yuv_format_t format, int width, int height,
+			    unsigned char *y_data, int y_step, unsigned char *c_data, int c_step,
+			    unsigned char *c2_data, int c2_step, YUVFrameDesc *desc);
+	/* Describe a frame held in one buffer, planes back to back */
+	static int DescribeContiguous(yuv_format_t format, int width, int height, unsigned char *data, int step, YUVFrameDesc *desc);
+	/* Size in bytes of a contiguous frame */
+	static size_t ContiguousSize(int width, int height);
+	/* Resize or copy every plane of src into the planes of dst */
+	static int Resize(const YUVFrameDesc &src, const YUVFrameDesc &dst);
+	/* Convert to BGR, RGB or gray */
+	static int Convert(const YUVFrameDesc &src, color_out_t out, cv::Mat &dst);
+	/* Gray view of the Y plane, no copy */
+	static cv::Mat GrayView(const YUVFrameDesc &src);
+	/* Interleaved chroma plane of a semi-planar frame */
+	static cv::Mat ChromaView(const YUVFrameDesc &src);
+	static bool IsSemiPlanar(yuv_format_t format) { return (YUV_FORMAT_NV12 == format) || (YUV_FORMAT_NV21 == format); }
+};
+
+#endif /*#ifndef __RDKCVA_COLORCONVERT_H_ */
@@ -21,9 +21,7 @@
 using namespace std;
 //using namespace cv;
 
-unsigned char* ImageTools::yuvSnapshotData = NULL;
-
-#ifndef _HAS_XSTREAM_
+#if !defined(_HAS_XSTREAM_) && !defined(_FILE_FRAME_SOURCE_)
 RdkCPluginFactory* ImageTools::temp_factory;
 RdkCVideoCapturer* ImageTools::recorder;
 #endif
@@ -54,12 +52,174 @@ static std::vector<cv::Point> tokenize_to_roi(int width, int height, std::string
     return tokens;
 }
 
+#ifndef _FILE_FRAME_SOURCE_
+static long elapsed_ms(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((now.tv_sec - start->tv_sec) * 1000L) + ((now.tv_nsec - start->tv_nsec) / 1000000L);
+}
+
+static void sleep_ms(long ms)
+{
+	struct timespec req;
+
+	req.tv_sec = ms / 1000;
+	req.tv_nsec = (ms % 1000) * 1000000L;
+	while( (0 != nanosleep(&req, &req)) && (EINTR == errno) );
+}
+#endif
+
+static int write_file(const std::string &filename, const unsigned char *data, size_t size)
+{
+	FILE *fp = fopen(filename.c_str(), "wb");
+	if( NULL == fp ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Unable to open %s: %s\n",__FUNCTION__,__LINE__, filename.c_str(), strerror(errno));
+		return RDKC_FAILURE;
+	}
+	size_t written = fwrite(data, 1, size, fp);
+	if( (0 != fclose(fp)) || (written != size) ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Unable to write %s\n",__FUNCTION__,__LINE__, filename.c_str());
+		return RDKC_FAILURE;
+	}
+	return RDKC_SUCCESS;
+}
+
+static int copy_to_buffer(SnapshotBuffer *jpeg, const unsigned char *data, size_t size)
+{
+	if( NULL == jpeg->data ) {
+		jpeg->data = (unsigned char*)data;
+		jpeg->capacity = size;
+		jpeg->size = size;
+		return RDKC_SUCCESS;
+	}
+
+	jpeg->size = size;
+	if( size > jpeg->capacity ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Output buffer too small, need %zu have %zu\n",__FUNCTION__,__LINE__, size, jpeg->capacity);
+		return RDKC_FAILURE;
+	}
+	memcpy(jpeg->data, data, size);
+	return RDKC_SUCCESS;
+}
+
+#ifdef _HAS_TURBOJPEG_
+/* Create the encoder and grow its output buffer for a width x height 4:2:0 JPEG */
+static int prepare_tj_encoder(JpegEncoderContext &ctx, int width, int height)
+{
+	if( NULL == ctx.handle ) {
+		ctx.handle = tjInitCompress();
+		if( NULL == ctx.handle ) {
+			RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): tjInitCompress failed: %s\n",__FUNCTION__,__LINE__, tjGetErrorStr());
+			return RDKC_FAILURE;
+		}
+	}
+
+	unsigned long needed = tjBufSize(width, height, TJSAMP_420);
+	if( needed > ctx.dataSize ) {
+		if( NULL != ctx.data ) {
+			tjFree(ctx.data);
+		}
+		ctx.data = tjAlloc(needed);
+		if( NULL == ctx.data ) {
+			RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): tjAlloc failed\n",__FUNCTION__,__LINE__);
+			ctx.dataSize = 0;
+			return RDKC_FAILURE;
+		}
+		ctx.dataSize = needed;
+	}
+	return RDKC_SUCCESS;
+}
+#endif
+
+/* Blend the chroma of the pixels set in mask towards (tint_u, tint_v) */
+static void tint_chroma(const YUVFrameDesc &desc, const cv::Mat &mask, unsigned char tint_u, unsigned char tint_v)
+{
+	int ps = ColorConvert::IsSemiPlanar(desc.format) ? 2 : 1;
+
+	for( int row = 0; row < mask.rows; row++ ) {
+		unsigned char *u = desc.u.data + ((size_t)row * desc.u.step);
+		unsigned char *v = desc.v.data + ((size_t)row * desc.v.step);
+		const unsigned char *m = mask.ptr(row);
+		for( int col = 0; col < mask.cols; col++ ) {
+			unsigned char sel = m[col] ? 0xFF : 0x00;
+			unsigned char tu = (unsigned char)((u[ps*col] + tint_u) >> 1);
+			unsigned char tv = (unsigned char)((v[ps*col] + tint_v) >> 1);
+			u[ps*col] = (tu & sel) | (u[ps*col] & ~sel);
+			v[ps*col] = (tv & sel) | (v[ps*col] & ~sel);
+		}
+	}
+}
+
+/* Draw a polyline or a rectangle into the chroma of a frame, at chroma resolution */
+static void draw_chroma(const YUVFrameDesc &desc, const std::vector< std::vector<cv::Point> > *polygons, const cv::Rect *box,
+			unsigned char color_u, unsigned char color_v)
+{
+	if( ColorConvert::IsSemiPlanar(desc.format) ) {
+		cv::Mat plane = ColorConvert::ChromaView(desc);
+		cv::Scalar color = (desc.u.data < desc.v.data) ? cv::Scalar(color_u, color_v) : cv::Scalar(color_v, color_u);
+		if( NULL != polygons ) {
+			cv::polylines(plane, *polygons, true, color);
+		}
+		else {
+			cv::rectangle(plane, *box, color);
+		}
+		return;
+	}
+
+	const YUVPlane *planes[2] = { &desc.u, &desc.v };
+	unsigned char colors[2] = { color_u, color_v };
+	for( int i = 0; i < 2; i++ ) {
+		cv::Mat plane(desc.height / 2, desc.width / 2, CV_8UC1, planes[i]->data, planes[i]->step);
+		if( NULL != polygons ) {
+			cv::polylines(plane, *polygons, true, cv::Scalar(colors[i]));
+		}
+		else {
+			cv::rectangle(plane, *box, cv::Scalar(colors[i]));
+		}
+	}
+}
+
+/* Orders target indices from the largest output to the smallest */
+struct target_area_greater
+{
+	const std::vector<SnapshotTarget> *targets;
+	target_area_greater(const std::vector<SnapshotTarget> *t) : targets(t) {}
+	bool operator()(size_t a, size_t b) const
+	{
+		return ((long)(*targets)[a].width * (*targets)[a].height) > ((long)(*targets)[b].width * (*targets)[b].height);
+	}
+};
+
 /* Constructor */
 ImageTools::ImageTools():frame(NULL)
 			, buf_id(0)
+			, frameWaitTimeoutMs(FRAME_WAIT_TIMEOUT_MS)
+			, doiCacheMtime(0)
+			, workerCount(0)
+			, workerIds(0)
+			, poolExit(false)
+			, jobTargets(NULL)
+			, nextJob(0)
+			, pendingJobs(0)
+			, failedJobs(0)
+			, prerollWidth(0)
+			, prerollHeight(0)
+			, prerollNext(0)
 {
 	RDK_LOG( RDK_LOG_DEBUG,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Constructor.\n",__FUNCTION__,__LINE__);
-#ifdef _HAS_XSTREAM_
+	pthread_mutex_init(&poolMutex, NULL);
+	pthread_cond_init(&poolWork, NULL);
+	pthread_cond_init(&poolDone, NULL);
+#if defined(_FILE_FRAME_SOURCE_)
+	fileWidth = 0;
+	fileHeight = 0;
+	filePitch = 0;
+	fileFrameCount = 0;
+	fileFrameIndex = 0;
+	fileFrameSeq = 0;
+#elif defined(_HAS_XSTREAM_)
 	consumer = NULL;
 	frameInfo = NULL;
 #ifndef _DIRECT_FRAME_READ_
@@ -78,9 +238,154 @@ ImageTools::ImageTools():frame(NULL)
 ImageTools::~ImageTools()
 {
 	Close();
+	StopWorkers();
+	ReleaseSnapshotContext();
+	pthread_cond_destroy(&poolDone);
+	pthread_cond_destroy(&poolWork);
+	pthread_mutex_destroy(&poolMutex);
 	RDK_LOG( RDK_LOG_DEBUG,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Destructor.\n",__FUNCTION__,__LINE__);
 }
 
+/**
+ * @brief This function is used to release the snapshot buffers and the JPEG encoder
+ * @param void
+ * @return void
+ */
+void ImageTools::ReleaseSnapshotContext()
+{
+	yuvMat.release();
+	bgrMat.release();
+	scaledMat.release();
+	pyramid.clear();
+	pyramidStore.clear();
+	outputStore.clear();
+	roiCacheKey.clear();
+	roiLuma.clear();
+	roiChroma.clear();
+	doiCachePath.clear();
+	doiMask.release();
+	doiChromaMask.release();
+	for( int i = 0; i <= SNAPSHOT_MAX_WORKERS; i++ ) {
+		ReleaseJPEGEncoder(encoders[i]);
+	}
+}
+
+/**
+ * @brief This function is used to release a JPEG encoder and its buffers
+ * @param ctx is the encoder.
+ * @return void
+ */
+void ImageTools::ReleaseJPEGEncoder(JpegEncoderContext &ctx)
+{
+	std::vector<unsigned char>().swap(ctx.jpegBuffer);
+	ctx.compressionParams.clear();
+	ctx.chroma.release();
+#ifdef _HAS_TURBOJPEG_
+	if( NULL != ctx.data ) {
+		tjFree(ctx.data);
+		ctx.data = NULL;
+		ctx.dataSize = 0;
+	}
+	if( NULL != ctx.handle ) {
+		tjDestroy(ctx.handle);
+		ctx.handle = NULL;
+	}
+#endif
+}
+
+/**
+ * @brief This function is used to encode a BGR image to JPEG. The encoder and its
+ *        output buffer are kept across calls and only grow with the image size.
+ * @param ctx is the encoder, only one thread may use it at a time.
+ * @param image is the BGR image.
+ * @param compression_scale is JPEG scale value.
+ * @param data is set to the encoded JPEG, valid until the next call.
+ * @param size is set to the size of the encoded JPEG.
+ * @return RDKC_SUCCESS on success.
+ */
+int ImageTools::EncodeJPEG(JpegEncoderContext &ctx, const cv::Mat &image, int compression_scale, const unsigned char **data, size_t *size)
+{
+	if( (NULL == data) || (NULL == size) || image.empty() ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Invalid arguments\n",__FUNCTION__,__LINE__);
+		return RDKC_FAILURE;
+	}
+
+#ifdef _HAS_TURBOJPEG_
+	if( RDKC_SUCCESS != prepare_tj_encoder(ctx, image.cols, image.rows) ) {
+		return RDKC_FAILURE;
+	}
+
+	unsigned long jpegSize = ctx.dataSize;
+	if( 0 != tjCompress2(ctx.handle, image.data, image.cols, image.step, image.rows, TJPF_BGR,
+			     &ctx.data, &jpegSize, TJSAMP_420, compression_scale, TJFLAG_NOREALLOC) ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): tjCompress2 failed: %s\n",__FUNCTION__,__LINE__, tjGetErrorStr());
+		return RDKC_FAILURE;
+	}
+	*data = ctx.data;
+	*size = jpegSize;
+#else
+	if( ctx.compressionParams.empty() || (ctx.compressionParams[1] != compression_scale) ) {
+		ctx.compressionParams.clear();
+		ctx.compressionParams.push_back(CV_IMWRITE_JPEG_QUALITY);
+		ctx.compressionParams.push_back(compression_scale);
+	}
+
+	if( !cv::imencode(".jpg", image, ctx.jpegBuffer, ctx.compressionParams) ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): imencode failed\n",__FUNCTION__,__LINE__);
+		return RDKC_FAILURE;
+	}
+	*data = ctx.jpegBuffer.data();
+	*size = ctx.jpegBuffer.size();
+#endif
+	return RDKC_SUCCESS;
+}
+
+/**
+ * @brief This function is used to encode a BGR image to JPEG and write it to file system.
+ * @param ctx is the encoder.
+ * @param snapshot_filename is filename
+ * @param image is the BGR image.
+ * @param compression_scale is JPEG scale value
+ * @return RDKC_SUCCESS on success.
+ */
+int ImageTools::WriteJPEG(JpegEncoderContext &ctx, std::string snapshot_filename, const cv::Mat &image, int compression_scale)
+{
+	const unsigned char *data = NULL;
+	size_t size = 0;
+
+	if( RDKC_SUCCESS != EncodeJPEG(ctx, image, compression_scale, &data, &size) ) {
+		return RDKC_FAILURE;
+	}
+
+	return write_file(snapshot_filename, data, size);
+}
+
+/**
+ * @brief This function is used to encode a BGR image to JPEG in memory.
+ * @param ctx is the encoder.
+ * @param jpeg is the output buffer. If jpeg->data is NULL it is set to the encoder
+ *        buffer, valid until the next use of ctx, else the JPEG is copied into it.
+ * @param image is the BGR image.
+ * @param compression_scale is JPEG scale value
+ * @return RDKC_SUCCESS on success.
+ */
+int ImageTools::OutputJPEG(JpegEncoderContext &ctx, SnapshotBuffer *jpeg, const cv::Mat &image, int compression_scale)
+{
+	const unsigned char *data = NULL;
+	size_t size = 0;
+
+	if( NULL == jpeg ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Invalid output buffer\n",__FUNCTION__,__LINE__);
+		return RDKC_FAILURE;
+	}
+
+	if( RDKC_SUCCESS != EncodeJPEG(ctx, image, compression_scale, &data, &size) ) {
+		return RDKC_FAILURE;
+	}
+
+	return copy_to_buffer(jpeg, data, size);
+}
+
 /**
  * @brief This function is used to initialize the buffer
  * @param void
@@ -88,6 +393,10 @@ ImageTools::~ImageTools()
  */
 int ImageTools::Init(int bufferId)
 {
+#if defined(_FILE_FRAME_SOURCE_)
+	RDK_LOG(RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Built with the file frame source, use Init(frame_file, width, height)\n", __FILE__, __LINE__);
+	return RDKC_FAILURE;
+#else
 #ifdef _HAS_XSTREAM_
 	consumer =  new XStreamerConsumer;
 	if( NULL == consumer ) {
@@ -140,6 +449,89 @@ int ImageTools::Init(int bufferId)
 	}
 #endif
 
+	return RDKC_SUCCESS;
+#endif //_FILE_FRAME_SOURCE_
+}
+
+#ifdef _FILE_FRAME_SOURCE_
+/**
+ * @brief This function is used to initialize the frame source from a file of raw NV12 frames.
+ *        The file is loaded once and its frames are returned in a loop by GetYUVFrame.
+ * @param frame_file is the file, frames of pitch * height * 3 / 2 bytes back to back.
+ * @param width is the frame width.
+ * @param height is the frame height.
+ * @param pitch is the line pitch, 0 when equal to width.
+ * @return RDKC_SUCCESS on success.
+ */
+int ImageTools::Init(std::string frame_file, int width, int height, int pitch)
+{
+	if( 0 == pitch ) {
+		pitch = width;
+	}
+	if( (width <= 0) || (height <= 0) || (width & 1) || (height & 1) || (pitch < width) ) {
+		RDK_LOG(RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Invalid frame size %dx%d pitch %d\n", __FILE__, __LINE__, width, height, pitch);
+		return RDKC_FAILURE;
+	}
+
+	FILE *fp = fopen(frame_file.c_str(), "rb");
+	if( NULL == fp ) {
+		RDK_LOG(RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Unable to open %s: %s\n", __FILE__, __LINE__, frame_file.c_str(), strerror(errno));
+		return RDKC_FAILURE;
+	}
+
+	size_t frame_size = (size_t)pitch * height * 3 / 2;
+	fseek(fp, 0, SEEK_END);
+	long file_size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	if( (file_size <= 0) || ((size_t)file_size < frame_size) ) {
+		RDK_LOG(RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): %s holds no complete %dx%d frame\n", __FILE__, __LINE__, frame_file.c_str(), width, height);
+		fclose(fp);
+		return RDKC_FAILURE;
+	}
+
+	fileFrameCount = (size_t)file_size / frame_size;
+	fileFrames.resize(fileFrameCount * frame_size);
+	size_t got = fread(fileFrames.data(), 1, fileFrames.size(), fp);
+	fclose(fp);
+	if( got != fileFrames.size() ) {
+		RDK_LOG(RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Short read on %s\n", __FILE__, __LINE__, frame_file.c_str());
+		fileFrames.clear();
+		fileFrameCount = 0;
+		return RDKC_FAILURE;
+	}
+
+	fileWidth = width;
+	fileHeight = height;
+	filePitch = pitch;
+	fileFrameIndex = 0;
+	RDK_LOG(RDK_LOG_INFO,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Loaded %zu frames of %dx%d from %s\n", __FILE__, __LINE__, fileFrameCount, width, height, frame_file.c_str());
+
+	return RDKC_SUCCESS;
+}
+
+/**
+ * @brief This function is used to restart the file frame source from its first frame
+ * @param void
+ * @return void
+ */
+void ImageTools::Rewind()
+{
+	fileFrameIndex = 0;
+}
+#endif
+
+/**
+ * @brief This function is used to set how long GetYUVFrame waits for a frame
+ * @param timeout_ms is the wait in milliseconds, 0 to not wait
+ * @return RDKC_SUCCESS on success.
+ */
+int ImageTools::SetFrameWaitTimeout(int timeout_ms)
+{
+	if( timeout_ms < 0 ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Invalid frame wait timeout %d\n",__FUNCTION__,__LINE__, timeout_ms);
+		return RDKC_FAILURE;
+	}
+	frameWaitTimeoutMs = timeout_ms;
 	return RDKC_SUCCESS;
 }
 
@@ -150,6 +542,26 @@ int ImageTools::Init(int bufferId)
  */
 int ImageTools::GetYUVFrame()
 {
+#ifdef _FILE_FRAME_SOURCE_
+        if( (NULL == frame) || (0 == fileFrameCount) ) {
+                RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): File frame source not initialized.\n",__FILE__,__LINE__);
+                return RDKC_FAILURE;
+        }
+
+        unsigned char *file_frame = fileFrames.data() + (fileFrameIndex * (size_t)filePitch * fileHeight * 3 / 2);
+        fileFrameIndex = (fileFrameIndex + 1) % fileFrameCount;
+
+        frame->height = fileHeight;
+        frame->width = fileWidth;
+        frame->pitch = filePitch;
+        frame->format = YUV_FORMAT_NV12;
+        frame->y_data = file_frame;
+        frame->uv_data = file_frame + ((size_t)filePitch * fileHeight);
+        frame->size = fileWidth*fileHeight;
+        frame->pts = fileFrameSeq++;
+
+        return RDKC_SUCCESS;
+#else
         int ret = RDKC_FAILURE;
 #ifndef _HAS_XSTREAM_
         RDKC_PLUGIN_YUVInfo yuv_info;
@@ -167,15 +579,22 @@ int ImageTools::GetYUVFrame()
 		*/
 		bool bypass_gdmacopy = true;
 
-#ifdef _HAS_XSTREAM_
-		int count = 0;
+		bool not_ready = false;
+		long backoff_ms = FRAME_WAIT_BACKOFF_MIN_MS;
+		struct timespec wait_start;
 
+#ifdef _HAS_XSTREAM_
 		if (NULL == consumer) {
 			RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Invalid consumer instance\n", __FILE__, __LINE__);
 			return RDKC_FAILURE;
 		}
+#endif
 
+		/* The frame source has no readiness fd, poll with a short exponential backoff
+		 * so the wait ends close to the next frame and never exceeds frameWaitTimeoutMs */
+		clock_gettime(CLOCK_MONOTONIC, &wait_start);
 		do {
+#ifdef _HAS_XSTREAM_
 #ifdef _DIRECT_FRAME_READ_
 			ret = consumer->ReadRAWFrame((u16)buf_id, (u16)FORMAT_YUV, frameInfo, bypass_gdmacopy);
 #else
@@ -185,14 +604,28 @@ int ImageTools::GetYUVFrame()
 				ret = RDKC_SUCCESS;
 				break;
 			}
-			count++;
-			sleep(10);
-
-		} while(ret == XSTREAMER_FRAME_NOT_READY && count < 10);
+			not_ready = (ret == XSTREAMER_FRAME_NOT_READY);
 #else
-		memset(&yuv_info, 0, sizeof(RDKC_PLUGIN_YUVInfo));
-		ret = recorder->ReadYUVData(buf_id, &yuv_info, bypass_gdmacopy);
+			memset(&yuv_info, 0, sizeof(RDKC_PLUGIN_YUVInfo));
+			ret = recorder->ReadYUVData(buf_id, &yuv_info, bypass_gdmacopy);
+			if (RDKC_SUCCESS == ret) {
+				break;
+			}
+			not_ready = (1 == ret);
 #endif
+			if( !not_ready ) {
+				break;
+			}
+
+			long remaining_ms = frameWaitTimeoutMs - elapsed_ms(&wait_start);
+			if( remaining_ms <= 0 ) {
+				break;
+			}
+			sleep_ms( (backoff_ms < remaining_ms) ? backoff_ms : remaining_ms );
+			if( backoff_ms < FRAME_WAIT_BACKOFF_MAX_MS ) {
+				backoff_ms = ((backoff_ms * 2) < FRAME_WAIT_BACKOFF_MAX_MS) ? (backoff_ms * 2) : FRAME_WAIT_BACKOFF_MAX_MS;
+			}
+		} while( true );
 
         if (RDKC_SUCCESS == ret)
         {
@@ -202,14 +635,11 @@ int ImageTools::GetYUVFrame()
                 RDK_LOG( RDK_LOG_DEBUG,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Got one frame! width=%d, height=%d, pitch=%d, seq_num=%d, format=%d, flag=%d, dsp_pts=%llu, mono_pts=%llu!\n", __FILE__, __LINE__, yuv_info.width, yuv_info.height, yuv_info.pitch, yuv_info.seq_num, yuv_info.format, yuv_info.flag, yuv_info.dsp_pts, yuv_info.mono_pts);
 #endif
         }
-#ifndef _HAS_XSTREAM_
-        else if (1 == ret)
+        else if (not_ready)
         {
-                // No frame data ready, try again
-                RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): No frame data ready.\n",__FILE__,__LINE__);
+                RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): No frame data ready after %ld ms.\n",__FILE__,__LINE__, elapsed_ms(&wait_start));
                 return RDKC_FAILURE;
         }
-#endif
         else
         {
                 RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Read YUV stream error.\n",__FILE__,__LINE__);
@@ -222,140 +652,278 @@ int ImageTools::GetYUVFrame()
         frame->y_data = (unsigned char*) frameInfo->y_addr;
         frame->uv_data =  (unsigned char*)frameInfo->uv_addr;
         frame->size = frameInfo->width*frameInfo->height;
+        frame->pitch = (frameInfo->pitch > 0) ? frameInfo->pitch : frameInfo->width;
+        frame->format = YUV_FORMAT_NV12;
+        frame->pts = frameInfo->mono_pts;
 #else
         frame->height = yuv_info.height;
         frame->width = yuv_info.width;
         frame->y_data = (unsigned char*) yuv_info.y_addr;
         frame->uv_data =  (unsigned char*)yuv_info.uv_addr;
         frame->size = yuv_info.width*yuv_info.height;
+        frame->pitch = (yuv_info.pitch > 0) ? yuv_info.pitch : yuv_info.width;
+        frame->format = YUV_FORMAT_NV12;
+        frame->pts = yuv_info.mono_pts;
 #endif
 
         return ret;
+#endif //_FILE_FRAME_SOURCE_
 }
 /**
- * @brief This function is used to convert and resize a YUV frame into a JPEG and saves to file system.
- * @param snapshot_filename is filename
- * @param compression_scale is JPEG scale value
- * @param new_width is new width of JPEG image.
- * @param new_height is new height of JPEG image.
+ * @brief This function is used to describe the planes of the current frame in place.
+ *        Planar chroma planes follow each other at half the luma pitch.
+ * @param desc is the filled descriptor.
  * @return RDKC_SUCCESS on success.
  */
-int ImageTools::RdkCVASnapshot_NV12(std::string snapshot_filename, int compression_scale, int new_width, int new_height, std::string roi)
+int ImageTools::DescribeFrame(YUVFrameDesc *desc)
 {
-	cv::Mat yuvMat;
-	int l_width = new_width;
-	int l_height = new_height;
-	vector<int> compression_params;
-	cv::Mat RGBMat;
+	if( ColorConvert::IsSemiPlanar(frame->format) ) {
+		return ColorConvert::Describe(frame->format, frame->width, frame->height, frame->y_data, frame->pitch,
+					      frame->uv_data, frame->pitch, NULL, 0, desc);
+	}
 
-	compression_params.push_back(CV_IMWRITE_JPEG_QUALITY);
-	compression_params.push_back(compression_scale);
+	return ColorConvert::Describe(frame->format, frame->width, frame->height, frame->y_data, frame->pitch,
+				      frame->uv_data, frame->pitch / 2,
+				      frame->uv_data + ((size_t)(frame->pitch / 2) * (frame->height / 2)), frame->pitch / 2, desc);
+}
+
+/**
+ * @brief This function is used to bring a frame to the snapshot size, described by
+ *        snapDesc. The planes are downscaled straight from the source buffer. At full
+ *        size the source planes are used in place unless the caller needs to draw on them.
+ *        4:2:0 needs even dimensions, so odd sizes are rounded down and fixed up after the
+ *        color conversion.
+ * @param src is the source frame, the current frame or a pre-roll slot.
+ * @param new_width is width of the output image.
+ * @param new_height is height of the output image.
+ * @param writable is true when snapDesc must not refer to the source frame.
+ * @return RDKC_SUCCESS on success.
+ */
+int ImageTools::ResizeYUV(const YUVFrameDesc &src, int new_width, int new_height, bool writable)
+{
+	int yuv_width = (new_width < src.width) ? (new_width & ~1) : src.width;
+	int yuv_height = (new_height < src.height) ? (new_height & ~1) : src.height;
+
+	if( (yuv_width <= 0) || (yuv_height <= 0) ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Invalid snapshot size %dx%d\n",__FUNCTION__,__LINE__, new_width, new_height);
+		return RDKC_FAILURE;
+	}
 
-	/* Allocate memory as per the frame width and height */
-	yuvSnapshotData = (unsigned char *) malloc((frame->size + (frame->size/2)) * sizeof(unsigned char));
+	if( !writable && (yuv_width == src.width) && (yuv_height == src.height) ) {
+		snapDesc = src;
+		return RDKC_SUCCESS;
+	}
 
-	if(NULL == yuvSnapshotData ) {
-		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Invalid pointer to yuvData\n",__FUNCTION__,__LINE__);
+	/* Downscaled planes are written directly into one contiguous image */
+	yuvMat.create(yuv_height + yuv_height/2, yuv_width, CV_8UC1);
+	if( RDKC_SUCCESS != ColorConvert::DescribeContiguous(src.format, yuv_width, yuv_height, yuvMat.data, yuvMat.step, &snapDesc) ) {
 		return RDKC_FAILURE;
 	}
 
-	/* Converting an image buffer into Mat */
-	memset( yuvSnapshotData, 0, (frame->size + (frame->size/2)) * sizeof(unsigned char));
-	memcpy( yuvSnapshotData, frame->y_data,frame->size);
-	memcpy( yuvSnapshotData+frame->size,frame->uv_data,frame->size/2 );
-	yuvMat = cv::Mat( frame->height + frame->height/2, frame->width, CV_8UC1, yuvSnapshotData );
+	return ColorConvert::Resize(src, snapDesc);
+}
 
-	/* matrix to store color image */
-	RGBMat = cv::Mat( frame->height, frame->width, CV_8UC4);
-	/* convert the frame to BGR format */
-	cv::cvtColor(yuvMat, RGBMat, CV_YUV2BGR_NV12);
+/**
+ * @brief This function is used to convert snapDesc to BGR at the snapshot size.
+ * @param new_width is width of the output image.
+ * @param new_height is height of the output image.
+ * @param outMat is set to the output BGR image, it refers to the snapshot context.
+ * @return RDKC_SUCCESS on success.
+ */
+int ImageTools::ConvertYUVToBGR(int new_width, int new_height, cv::Mat &outMat)
+{
+	if( RDKC_SUCCESS != ColorConvert::Convert(snapDesc, COLOR_OUT_BGR, bgrMat) ) {
+		return RDKC_FAILURE;
+	}
 
-	if( frame->height != l_height || frame->width != l_width ) {
-	    /* resize the frame to new width and height */
-	    cv::resize(RGBMat, RGBMat,cv::Size(l_width, l_height),0, 0);
+	if( (bgrMat.cols != new_width) || (bgrMat.rows != new_height) ) {
+		cv::resize(bgrMat, scaledMat, cv::Size(new_width, new_height), 0, 0);
+		outMat = scaledMat;
+	}
+	else {
+		outMat = bgrMat;
 	}
 
-	if(!roi.empty()) {
-		RDK_LOG( RDK_LOG_DEBUG,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Thumbnail with ROI: %s\n",__FUNCTION__,__LINE__, roi.c_str());
-		std::vector<cv::Point> roicoods = std::vector<cv::Point>();
-		roicoods = tokenize_to_roi(new_width, new_height, roi.c_str());
+	return RDKC_SUCCESS;
+}
+
+/**
+ * @brief This function is used to draw the overlay into the planes of snapDesc. The parsed
+ *        ROI and the scaled DOI mask are cached and rebuilt only when they change.
+ * @param overlay is the overlay to draw.
+ * @param frame_size is the size of the captured frame, the default space of the boxes.
+ * @return void
+ */
+void ImageTools::DrawOverlay(const SnapshotOverlay &overlay, cv::Size frame_size)
+{
+	int width = snapDesc.width;
+	int height = snapDesc.height;
+	cv::Mat planeY = ColorConvert::GrayView(snapDesc);
+	cv::Size chromaSize(width/2, height/2);
+
+	if( !overlay.doiMask.empty() ) {
+		struct stat st;
+		if( 0 != stat(overlay.doiMask.c_str(), &st) ) {
+			RDK_LOG( RDK_LOG_WARN,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): DOI mask %s not found\n",__FUNCTION__,__LINE__, overlay.doiMask.c_str());
+		}
+		else {
+			if( (overlay.doiMask != doiCachePath) || (st.st_mtime != doiCacheMtime) ) {
+				doiMask = cv::imread(overlay.doiMask, cv::IMREAD_GRAYSCALE);
+				doiCachePath = overlay.doiMask;
+				doiCacheMtime = st.st_mtime;
+				doiChromaMask.release();
+			}
+			if( !doiMask.empty() ) {
+				if( doiChromaMask.size() != chromaSize ) {
+					cv::resize(doiMask, doiChromaMask, chromaSize, 0, 0, cv::INTER_NEAREST);
+				}
+				tint_chroma(snapDesc, doiChromaMask, OVERLAY_DOI_U, OVERLAY_DOI_V);
+			}
+		}
+	}
 
+	if( !overlay.roi.empty() ) {
+		if( (overlay.roi != roiCacheKey) || (roiCacheSize != planeY.size()) ) {
+			roiLuma.assign(1, tokenize_to_roi(width, height, overlay.roi));
+			roiChroma.assign(1, tokenize_to_roi(width/2, height/2, overlay.roi));
+			roiCacheKey = overlay.roi;
+			roiCacheSize = planeY.size();
+		}
 		//Draw ROI if it is not empty
-		if(!roicoods.empty()) {
-			std::vector< std::vector<cv::Point> > polygons;
-			polygons.push_back(roicoods);
-			cv::drawContours(RGBMat, polygons, 0, cv::Scalar(0, 255, 255));
+		if( !roiLuma[0].empty() ) {
+			cv::polylines(planeY, roiLuma, true, cv::Scalar(OVERLAY_ROI_Y));
+			draw_chroma(snapDesc, &roiChroma, NULL, OVERLAY_ROI_U, OVERLAY_ROI_V);
 		} else {
 			RDK_LOG( RDK_LOG_DEBUG,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): ROI is empty : Skip drawing ROI\n",__FUNCTION__,__LINE__);
 		}
-	} else {
-		RDK_LOG( RDK_LOG_DEBUG,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Thumbnail without ROI\n",__FUNCTION__,__LINE__);
 	}
 
-	cv::imwrite(snapshot_filename, RGBMat, compression_params);
-
-	/* Release memory */
-	if( NULL != yuvSnapshotData ) {
-		free(yuvSnapshotData);
-		yuvSnapshotData = NULL;
+	if( !overlay.boxes.empty() ) {
+		cv::Size space = (overlay.boxSpace.area() > 0) ? overlay.boxSpace : frame_size;
+		for( size_t i = 0; i < overlay.boxes.size(); i++ ) {
+			const cv::Rect &box = overlay.boxes[i];
+			int x0 = (box.x * width) / space.width;
+			int y0 = (box.y * height) / space.height;
+			int x1 = ((box.x + box.width) * width) / space.width;
+			int y1 = ((box.y + box.height) * height) / space.height;
+			/* the corners are inclusive, a Rect ends one past its last pixel */
+			cv::Rect chromaBox(cv::Point(x0/2, y0/2), cv::Point(x1/2, y1/2) + cv::Point(1, 1));
+			cv::rectangle(planeY, cv::Point(x0, y0), cv::Point(x1, y1), cv::Scalar(OVERLAY_BOX_Y));
+			draw_chroma(snapDesc, NULL, &chromaBox, OVERLAY_BOX_U, OVERLAY_BOX_V);
+		}
 	}
-	RGBMat.release();
-	yuvMat.release();
-	return RDKC_SUCCESS;
 }
 
 /**
- * @brief This function is used to convert and resize a YUV frame into a JPEG and saves to file system.
- * @param snapshot_filename is filename
+ * @brief This function is used to encode snapDesc to JPEG. With libjpeg-turbo and an even
+ *        snapshot size the planes are compressed directly, else through BGR.
+ * @param ctx is the encoder.
+ * @param new_width is width of the JPEG image.
+ * @param new_height is height of the JPEG image.
  * @param compression_scale is JPEG scale value
- * @param new_width is new width of JPEG image.
- * @param new_height is new height of JPEG image.
+ * @param data is set to the encoded JPEG, valid until the next use of ctx.
+ * @param size is set to the size of the encoded JPEG.
  * @return RDKC_SUCCESS on success.
  */
-int ImageTools::RdkCVASnapshot_YV12(std::string snapshot_filename, int compression_scale, int new_width, int new_height)
+int ImageTools::EncodeYUV(JpegEncoderContext &ctx, int new_width, int new_height, int compression_scale, const unsigned char **data, size_t *size)
 {
-	cv::Mat yuvMat;
-	int l_width = new_width;
-	int l_height = new_height;
-	vector<int> compression_params;
-	cv::Mat RGBMat;
+#ifdef _HAS_TURBOJPEG_
+	if( (snapDesc.width == new_width) && (snapDesc.height == new_height) ) {
+		if( RDKC_SUCCESS != prepare_tj_encoder(ctx, new_width, new_height) ) {
+			return RDKC_FAILURE;
+		}
 
-	compression_params.push_back(CV_IMWRITE_JPEG_QUALITY);
-	compression_params.push_back(compression_scale);
+		const unsigned char *src[3] = { snapDesc.y.data, snapDesc.u.data, snapDesc.v.data };
+		int strides[3] = { snapDesc.y.step, snapDesc.u.step, snapDesc.v.step };
 
-	/* Allocate memory as per the frame width and height */
-	yuvSnapshotData = (unsigned char *) malloc((frame->size + (frame->size/2)) * sizeof(unsigned char));
+		/* libjpeg-turbo takes planar chroma, split the interleaved plane */
+		if( ColorConvert::IsSemiPlanar(snapDesc.format) ) {
+			int chroma_height = new_height/2;
+			ctx.chroma.create(chroma_height * 2, new_width/2, CV_8UC1);
+			cv::Mat planes[2] = { ctx.chroma.rowRange(0, chroma_height), ctx.chroma.rowRange(chroma_height, chroma_height * 2) };
+			cv::split(ColorConvert::ChromaView(snapDesc), planes);
 
-	if(NULL == yuvSnapshotData ) {
-		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Invalid pointer to yuvData\n",__FUNCTION__,__LINE__);
+			int u_index = (snapDesc.u.data < snapDesc.v.data) ? 0 : 1;
+			src[1] = planes[u_index].ptr(0);
+			src[2] = planes[1 - u_index].ptr(0);
+			strides[1] = strides[2] = (int)ctx.chroma.step;
+		}
+
+		unsigned long jpegSize = ctx.dataSize;
+		if( 0 != tjCompressFromYUVPlanes(ctx.handle, src, new_width, strides, new_height, TJSAMP_420,
+						 &ctx.data, &jpegSize, compression_scale, TJFLAG_NOREALLOC) ) {
+			RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): tjCompressFromYUVPlanes failed: %s\n",__FUNCTION__,__LINE__, tjGetErrorStr());
+			return RDKC_FAILURE;
+		}
+		*data = ctx.data;
+		*size = jpegSize;
+		return RDKC_SUCCESS;
+	}
+#endif
+	cv::Mat RGBMat;
+
+	if( RDKC_SUCCESS != ConvertYUVToBGR(new_width, new_height, RGBMat) ) {
 		return RDKC_FAILURE;
 	}
 
-	/* Converting an image buffer into Mat */
-	memset( yuvSnapshotData, 0, (frame->size + (frame->size/2)) * sizeof(unsigned char));
-	memcpy( yuvSnapshotData, frame->y_data,frame->size);
-	memcpy( yuvSnapshotData+frame->size,frame->uv_data,frame->size/2 );
-	yuvMat = cv::Mat( frame->height + frame->height/2, frame->width, CV_8UC1, yuvSnapshotData );
+	return EncodeJPEG(ctx, RGBMat, compression_scale, data, size);
+}
 
-	/* matrix to store color image */
-	RGBMat = cv::Mat( frame->height, frame->width, CV_8UC4);
-	/* convert the frame to BGR format */
-	cv::cvtColor(yuvMat, RGBMat, CV_YUV2BGR_YV12);
+/**
+ * @brief This function is used to resize a frame, draw the overlay and encode it to JPEG.
+ * @param src is the frame to encode.
+ * @param frame_size is the size of the captured frame src was taken from.
+ * @param new_width is new width of the JPEG image.
+ * @param new_height is new height of the JPEG image.
+ * @param overlay is the overlay to draw.
+ * @param compression_scale is JPEG scale value
+ * @param data is set to the encoded JPEG, valid until the next snapshot.
+ * @param size is set to the size of the encoded JPEG.
+ * @return RDKC_SUCCESS on success.
+ */
+int ImageTools::RdkCVAEncode(const YUVFrameDesc &src, cv::Size frame_size, int new_width, int new_height, const SnapshotOverlay &overlay, int compression_scale, const unsigned char **data, size_t *size)
+{
+	bool has_overlay = !overlay.roi.empty() || !overlay.doiMask.empty() || !overlay.boxes.empty();
 
-	if( frame->height != l_height || frame->width != l_width ) {
-	    /* resize the frame to new width and height */
-	    cv::resize(RGBMat, RGBMat,cv::Size(l_width, l_height),0, 0);
+	/* resize to new width and height before the color conversion */
+	if( RDKC_SUCCESS != ResizeYUV(src, new_width, new_height, has_overlay) ) {
+		return RDKC_FAILURE;
 	}
 
-	cv::imwrite(snapshot_filename, RGBMat, compression_params);
+	if( has_overlay ) {
+		RDK_LOG( RDK_LOG_DEBUG,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Thumbnail with ROI: %s, DOI: %s, %zu boxes\n",__FUNCTION__,__LINE__, overlay.roi.c_str(), overlay.doiMask.c_str(), overlay.boxes.size());
+		DrawOverlay(overlay, frame_size);
+	} else {
+		RDK_LOG( RDK_LOG_DEBUG,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Thumbnail without overlay\n",__FUNCTION__,__LINE__);
+	}
 
-        /* Release memory */
-        if( NULL != yuvSnapshotData ) {
-                free(yuvSnapshotData);
-                yuvSnapshotData = NULL;
-        }
+	return EncodeYUV(encoders[0], new_width, new_height, compression_scale, data, size);
+}
 
-	return RDKC_SUCCESS;
+/**
+ * @brief This function is used to convert and resize a YUV frame into a JPEG and saves to file system.
+ * @param snapshot_filename is filename
+ * @param compression_scale is JPEG scale value
+ * @param new_width is new width of JPEG image.
+ * @param new_height is new height of JPEG image.
+ * @param overlay is the overlay to draw.
+ * @return RDKC_SUCCESS on success.
+ */
+int ImageTools::RdkCVASnapshot(std::string snapshot_filename, int compression_scale, int new_width, int new_height, const SnapshotOverlay &overlay)
+{
+	YUVFrameDesc frameDesc;
+	const unsigned char *data = NULL;
+	size_t size = 0;
+
+	if( RDKC_SUCCESS != DescribeFrame(&frameDesc) ) {
+		return RDKC_FAILURE;
+	}
+
+	if( RDKC_SUCCESS != RdkCVAEncode(frameDesc, cv::Size(frame->width, frame->height), new_width, new_height, overlay, compression_scale, &data, &size) ) {
+		return RDKC_FAILURE;
+	}
+
+	return write_file(snapshot_filename, data, size);
 }
 
 /**
@@ -367,6 +935,23 @@ int ImageTools::RdkCVASnapshot_YV12(std::string snapshot_filename, int compressi
  * @return RDKC_SUCCESS on success.
  */
 int ImageTools::GenerateSnapshot(std::string snapshot_filename, int compression_scale, int new_width, int new_height, std::string roi)
+{
+        SnapshotOverlay overlay;
+        overlay.roi = roi;
+
+        return GenerateSnapshot(snapshot_filename, compression_scale, new_width, new_height, overlay);
+}
+
+/**
+ * @brief This function is used to generate an annotated thumbnail image
+ * @param snapshot_filename is filename
+ * @param compression_scale is JPEG scale value
+ * @param new_width is new width of JPEG image.
+ * @param new_height is new height of JPEG image.
+ * @param overlay is the overlay to draw.
+ * @return RDKC_SUCCESS on success.
+ */
+int ImageTools::GenerateSnapshot(std::string snapshot_filename, int compression_scale, int new_width, int new_height, const SnapshotOverlay &overlay)
 {
         //std::string snapshot_filename;
         //snapshot_filename = SNAPSHOT_FILE;
@@ -376,14 +961,508 @@ int ImageTools::GenerateSnapshot(std::string snapshot_filename, int compression_
                 return RDKC_FAILURE;
         }
 
-        if( RDKC_SUCCESS != RdkCVASnapshot_NV12(snapshot_filename, compression_scale, new_width, new_height, roi) ) {
-                RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): RdkCVASnapshot_NV12 failed\n",__FILE__, __LINE__);
+        if( RDKC_SUCCESS != RdkCVASnapshot(snapshot_filename, compression_scale, new_width, new_height, overlay) ) {
+                RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): RdkCVASnapshot failed\n",__FILE__, __LINE__);
                 return RDKC_FAILURE;
         }
 
         return RDKC_SUCCESS;
 }
 
+/**
+ * @brief This function is used to generate a thumbnail image in memory, without going through the file system.
+ * @param jpeg is the output buffer, see SnapshotBuffer.
+ * @param compression_scale is JPEG scale value
+ * @param new_width is new width of JPEG image.
+ * @param new_height is new height of JPEG image.
+ * @return RDKC_SUCCESS on success.
+ */
+int ImageTools::GenerateSnapshot(SnapshotBuffer *jpeg, int compression_scale, int new_width, int new_height, std::string roi)
+{
+	SnapshotOverlay overlay;
+	overlay.roi = roi;
+
+	return GenerateSnapshot(jpeg, compression_scale, new_width, new_height, overlay);
+}
+
+/**
+ * @brief This function is used to generate an annotated thumbnail image in memory.
+ * @param jpeg is the output buffer, see SnapshotBuffer.
+ * @param compression_scale is JPEG scale value
+ * @param new_width is new width of JPEG image.
+ * @param new_height is new height of JPEG image.
+ * @param overlay is the overlay to draw.
+ * @return RDKC_SUCCESS on success.
+ */
+int ImageTools::GenerateSnapshot(SnapshotBuffer *jpeg, int compression_scale, int new_width, int new_height, const SnapshotOverlay &overlay)
+{
+	YUVFrameDesc frameDesc;
+	const unsigned char *data = NULL;
+	size_t size = 0;
+
+	if( NULL == jpeg ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Invalid output buffer\n",__FILE__, __LINE__);
+		return RDKC_FAILURE;
+	}
+
+	if ( (RDKC_SUCCESS != GetYUVFrame()) || (RDKC_SUCCESS != DescribeFrame(&frameDesc)) ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): GetYUVFrame failed\n",__FILE__, __LINE__);
+		return RDKC_FAILURE;
+	}
+
+	if( RDKC_SUCCESS != RdkCVAEncode(frameDesc, cv::Size(frame->width, frame->height), new_width, new_height, overlay, compression_scale, &data, &size) ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): RdkCVAEncode failed\n",__FILE__, __LINE__);
+		return RDKC_FAILURE;
+	}
+
+	return copy_to_buffer(jpeg, data, size);
+}
+
+/**
+ * @brief This function is used to generate several snapshots of different sizes from one frame.
+ *        The frame is grabbed, annotated and color converted once, every output is resized
+ *        from the smallest larger level already built, and the outputs are encoded in parallel.
+ * @param targets is the list of outputs.
+ * @param overlay is the overlay drawn on every output.
+ * @return RDKC_SUCCESS when every output was written.
+ */
+int ImageTools::GenerateSnapshots(const std::vector<SnapshotTarget> &targets, const SnapshotOverlay &overlay)
+{
+	if( targets.empty() ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): No snapshot targets\n",__FILE__, __LINE__);
+		return RDKC_FAILURE;
+	}
+
+	for( size_t i = 0; i < targets.size(); i++ ) {
+		if( (targets[i].filename.empty() && (NULL == targets[i].output)) || (targets[i].width <= 0) || (targets[i].height <= 0) ) {
+			RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Invalid snapshot target %zu: %s %dx%d\n",__FILE__, __LINE__, i, targets[i].filename.c_str(), targets[i].width, targets[i].height);
+			return RDKC_FAILURE;
+		}
+	}
+
+	if ( RDKC_SUCCESS != GetYUVFrame() ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): GetYUVFrame failed\n",__FILE__, __LINE__);
+		return RDKC_FAILURE;
+	}
+
+	if( RDKC_SUCCESS != BuildSnapshotPyramid(targets, overlay) ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): BuildSnapshotPyramid failed\n",__FILE__, __LINE__);
+		return RDKC_FAILURE;
+	}
+
+	int wanted = (int)targets.size() - 1;
+	if( wanted > SNAPSHOT_MAX_WORKERS ) {
+		wanted = SNAPSHOT_MAX_WORKERS;
+	}
+	StartWorkers(wanted);
+
+	pthread_mutex_lock(&poolMutex);
+	jobTargets = &targets;
+	nextJob = 0;
+	pendingJobs = targets.size();
+	failedJobs = 0;
+	pthread_cond_broadcast(&poolWork);
+	pthread_mutex_unlock(&poolMutex);
+
+	/* the caller encodes too, with its own encoder */
+	ProcessSnapshotJobs(encoders[0]);
+
+	pthread_mutex_lock(&poolMutex);
+	while( pendingJobs > 0 ) {
+		pthread_cond_wait(&poolDone, &poolMutex);
+	}
+	jobTargets = NULL;
+	int failed = failedJobs;
+	pthread_mutex_unlock(&poolMutex);
+
+	if( 0 != failed ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): %d of %zu snapshots failed\n",__FILE__, __LINE__, failed, targets.size());
+		return RDKC_FAILURE;
+	}
+
+	return RDKC_SUCCESS;
+}
+
+/**
+ * @brief This function is used to build one BGR image per target from the current frame.
+ *        Only the largest level is annotated and converted from NV12, smaller levels are
+ *        resized from the smallest level that is still large enough and equal sizes share
+ *        one image, so every output shows the same overlay.
+ * @param targets is the list of outputs.
+ * @param overlay is the overlay to draw.
+ * @return RDKC_SUCCESS on success.
+ */
+int ImageTools::BuildSnapshotPyramid(const std::vector<SnapshotTarget> &targets, const SnapshotOverlay &overlay)
+{
+	YUVFrameDesc frameDesc;
+	bool has_overlay = !overlay.roi.empty() || !overlay.doiMask.empty() || !overlay.boxes.empty();
+	std::vector<size_t> order(targets.size());
+	int max_width = 0;
+	int max_height = 0;
+
+	for( size_t i = 0; i < targets.size(); i++ ) {
+		order[i] = i;
+		max_width = std::max(max_width, targets[i].width);
+		max_height = std::max(max_height, targets[i].height);
+	}
+	std::stable_sort(order.begin(), order.end(), target_area_greater(&targets));
+
+	if( (RDKC_SUCCESS != DescribeFrame(&frameDesc)) ||
+	    (RDKC_SUCCESS != ResizeYUV(frameDesc, max_width, max_height, has_overlay)) ) {
+		return RDKC_FAILURE;
+	}
+	if( has_overlay ) {
+		RDK_LOG( RDK_LOG_DEBUG,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Snapshots with ROI: %s, DOI: %s, %zu boxes\n",__FUNCTION__,__LINE__, overlay.roi.c_str(), overlay.doiMask.c_str(), overlay.boxes.size());
+		DrawOverlay(overlay, cv::Size(frame->width, frame->height));
+	}
+
+	cv::Mat base;
+	if( RDKC_SUCCESS != ConvertYUVToBGR(max_width, max_height, base) ) {
+		return RDKC_FAILURE;
+	}
+
+	pyramid.resize(targets.size());
+	pyramidStore.resize(targets.size());
+	if( outputStore.size() < targets.size() ) {
+		outputStore.resize(targets.size());
+	}
+
+	for( size_t k = 0; k < order.size(); k++ ) {
+		size_t idx = order[k];
+		int width = targets[idx].width;
+		int height = targets[idx].height;
+		cv::Mat src = base;
+
+		/* levels built so far are larger, pick the smallest one that covers this target */
+		for( size_t j = 0; j < k; j++ ) {
+			const cv::Mat &level = pyramid[order[j]];
+			if( (level.cols >= width) && (level.rows >= height) &&
+			    ((long)level.cols * level.rows < (long)src.cols * src.rows) ) {
+				src = level;
+			}
+		}
+
+		if( (src.cols == width) && (src.rows == height) ) {
+			pyramid[idx] = src;
+		}
+		else {
+			cv::resize(src, pyramidStore[idx], cv::Size(width, height), 0, 0, cv::INTER_AREA);
+			pyramid[idx] = pyramidStore[idx];
+		}
+	}
+
+	return RDKC_SUCCESS;
+}
+
+/**
+ * @brief This function is used to encode one target of a multi-size snapshot.
+ * @param index is the target index.
+ * @param ctx is the encoder of the calling thread.
+ * @return RDKC_SUCCESS on success.
+ */
+int ImageTools::RunSnapshotJob(size_t index, JpegEncoderContext &ctx)
+{
+	const SnapshotTarget &target = (*jobTargets)[index];
+	const cv::Mat *image = &pyramid[index];
+
+	if( !target.filename.empty() ) {
+		return WriteJPEG(ctx, target.filename, *image, target.quality);
+	}
+
+	if( NULL != target.output->data ) {
+		return OutputJPEG(ctx, target.output, *image, target.quality);
+	}
+
+	/* the encoder buffer is reused by the next job of this thread, keep a copy per target */
+	SnapshotBuffer encoded = { NULL, 0, 0 };
+	if( RDKC_SUCCESS != OutputJPEG(ctx, &encoded, *image, target.quality) ) {
+		return RDKC_FAILURE;
+	}
+	outputStore[index].assign(encoded.data, encoded.data + encoded.size);
+	target.output->data = outputStore[index].data();
+	target.output->capacity = outputStore[index].size();
+	target.output->size = outputStore[index].size();
+	return RDKC_SUCCESS;
+}
+
+/**
+ * @brief This function is used to run queued snapshot jobs until none is left.
+ * @param ctx is the encoder of the calling thread.
+ * @return void
+ */
+void ImageTools::ProcessSnapshotJobs(JpegEncoderContext &ctx)
+{
+	pthread_mutex_lock(&poolMutex);
+	while( (NULL != jobTargets) && (nextJob < jobTargets->size()) ) {
+		size_t index = nextJob++;
+		pthread_mutex_unlock(&poolMutex);
+
+		int ret = RunSnapshotJob(index, ctx);
+
+		pthread_mutex_lock(&poolMutex);
+		if( RDKC_SUCCESS != ret ) {
+			failedJobs++;
+		}
+		if( 0 == --pendingJobs ) {
+			pthread_cond_signal(&poolDone);
+		}
+	}
+	pthread_mutex_unlock(&poolMutex);
+}
+
+/**
+ * @brief This function is used to start the encoder threads, if not running yet.
+ * @param count is the number of threads wanted.
+ * @return void
+ */
+void ImageTools::StartWorkers(int count)
+{
+	while( workerCount < count ) {
+		if( 0 != pthread_create(&workers[workerCount], NULL, WorkerThread, this) ) {
+			RDK_LOG( RDK_LOG_WARN,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Unable to start encoder thread: %s\n",__FUNCTION__,__LINE__, strerror(errno));
+			break;
+		}
+		workerCount++;
+	}
+}
+
+/**
+ * @brief This function is used to stop the encoder threads.
+ * @param void
+ * @return void
+ */
+void ImageTools::StopWorkers()
+{
+	pthread_mutex_lock(&poolMutex);
+	poolExit = true;
+	pthread_cond_broadcast(&poolWork);
+	pthread_mutex_unlock(&poolMutex);
+
+	for( int i = 0; i < workerCount; i++ ) {
+		pthread_join(workers[i], NULL);
+	}
+	workerCount = 0;
+	workerIds = 0;
+	poolExit = false;
+}
+
+/**
+ * @brief Encoder thread, waits for snapshot jobs and runs them with its own encoder.
+ * @param arg is the ImageTools instance.
+ * @return NULL
+ */
+void* ImageTools::WorkerThread(void *arg)
+{
+	ImageTools *self = (ImageTools*)arg;
+
+	pthread_mutex_lock(&self->poolMutex);
+	JpegEncoderContext &ctx = self->encoders[++self->workerIds];
+	while( !self->poolExit ) {
+		if( (NULL != self->jobTargets) && (self->nextJob < self->jobTargets->size()) ) {
+			pthread_mutex_unlock(&self->poolMutex);
+			self->ProcessSnapshotJobs(ctx);
+			pthread_mutex_lock(&self->poolMutex);
+			continue;
+		}
+		pthread_cond_wait(&self->poolWork, &self->poolMutex);
+	}
+	pthread_mutex_unlock(&self->poolMutex);
+
+	return NULL;
+}
+
+/**
+ * @brief This function is used to enable the pre-roll ring. The last slots frames are kept
+ *        downscaled to width x height in one arena allocated here, so a snapshot can later be
+ *        taken of the frame where motion was detected instead of the frame at request time.
+ * @param slots is the number of frames kept.
+ * @param width is the width of the kept frames.
+ * @param height is the height of the kept frames.
+ * @return RDKC_SUCCESS on success.
+ */
+int ImageTools::EnablePreroll(int slots, int width, int height)
+{
+	if( (slots <= 0) || (slots > PREROLL_MAX_SLOTS) || (width < 2) || (height < 2) ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Invalid pre-roll %d slots of %dx%d\n",__FUNCTION__,__LINE__, slots, width, height);
+		return RDKC_FAILURE;
+	}
+
+	/* 4:2:0 planes need even dimensions */
+	width &= ~1;
+	height &= ~1;
+
+	size_t slot_size = ColorConvert::ContiguousSize(width, height);
+	std::vector<unsigned char>(slot_size * slots).swap(prerollArena);
+	prerollSlots.assign(slots, PrerollSlot());
+	prerollWidth = width;
+	prerollHeight = height;
+	prerollNext = 0;
+
+	RDK_LOG( RDK_LOG_INFO,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Pre-roll of %d frames of %dx%d, %zu bytes\n",__FUNCTION__,__LINE__, slots, width, height, prerollArena.size());
+	return RDKC_SUCCESS;
+}
+
+/**
+ * @brief This function is used to disable the pre-roll ring and release its arena
+ * @param void
+ * @return void
+ */
+void ImageTools::DisablePreroll()
+{
+	std::vector<unsigned char>().swap(prerollArena);
+	std::vector<PrerollSlot>().swap(prerollSlots);
+	prerollWidth = 0;
+	prerollHeight = 0;
+	prerollNext = 0;
+}
+
+/**
+ * @brief This function is used to describe the planes of a pre-roll slot
+ * @param index is the slot.
+ * @param desc is the filled descriptor.
+ * @return RDKC_SUCCESS on success.
+ */
+int ImageTools::PrerollDesc(size_t index, YUVFrameDesc *desc)
+{
+	unsigned char *base = prerollArena.data() + (index * ColorConvert::ContiguousSize(prerollWidth, prerollHeight));
+
+	return ColorConvert::DescribeContiguous(prerollSlots[index].format, prerollWidth, prerollHeight, base, prerollWidth, desc);
+}
+
+/**
+ * @brief This function is used to grab a frame and downscale it into the oldest pre-roll slot.
+ *        The caller runs it at the rate it wants frames kept, e.g. once per analytics frame.
+ * @param pts is set to the pts of the grabbed frame, may be NULL.
+ * @return RDKC_SUCCESS on success.
+ */
+int ImageTools::CapturePreroll(unsigned long long *pts)
+{
+	YUVFrameDesc frameDesc;
+	YUVFrameDesc slotDesc;
+
+	if( prerollSlots.empty() ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Pre-roll is not enabled\n",__FUNCTION__,__LINE__);
+		return RDKC_FAILURE;
+	}
+
+	if ( (RDKC_SUCCESS != GetYUVFrame()) || (RDKC_SUCCESS != DescribeFrame(&frameDesc)) ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): GetYUVFrame failed\n",__FILE__, __LINE__);
+		return RDKC_FAILURE;
+	}
+
+	PrerollSlot &slot = prerollSlots[prerollNext];
+	slot.valid = false;
+	slot.format = frame->format;
+	if( (RDKC_SUCCESS != PrerollDesc(prerollNext, &slotDesc)) ||
+	    (RDKC_SUCCESS != ColorConvert::Resize(frameDesc, slotDesc)) ) {
+		return RDKC_FAILURE;
+	}
+	slot.pts = frame->pts;
+	slot.frameWidth = frame->width;
+	slot.frameHeight = frame->height;
+	slot.valid = true;
+	prerollNext = (prerollNext + 1) % prerollSlots.size();
+
+	if( NULL != pts ) {
+		*pts = frame->pts;
+	}
+	return RDKC_SUCCESS;
+}
+
+/**
+ * @brief This function is used to encode the pre-roll frame whose pts is closest to pts.
+ * @param pts is the wanted frame, e.g. the timestamp of the motion event.
+ * @param new_width is new width of the JPEG image.
+ * @param new_height is new height of the JPEG image.
+ * @param overlay is the overlay to draw.
+ * @param compression_scale is JPEG scale value
+ * @param data is set to the encoded JPEG, valid until the next snapshot.
+ * @param size is set to the size of the encoded JPEG.
+ * @return RDKC_SUCCESS on success.
+ */
+int ImageTools::RdkCVAEncodeAt(unsigned long long pts, int new_width, int new_height, const SnapshotOverlay &overlay, int compression_scale, const unsigned char **data, size_t *size)
+{
+	int best = -1;
+	unsigned long long best_delta = 0;
+
+	for( size_t i = 0; i < prerollSlots.size(); i++ ) {
+		if( !prerollSlots[i].valid ) {
+			continue;
+		}
+		unsigned long long delta = (prerollSlots[i].pts > pts) ? (prerollSlots[i].pts - pts) : (pts - prerollSlots[i].pts);
+		if( (best < 0) || (delta < best_delta) ) {
+			best = (int)i;
+			best_delta = delta;
+		}
+	}
+
+	if( best < 0 ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): No pre-roll frame captured\n",__FUNCTION__,__LINE__);
+		return RDKC_FAILURE;
+	}
+	RDK_LOG( RDK_LOG_DEBUG,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Pre-roll frame %llu for pts %llu\n",__FUNCTION__,__LINE__, prerollSlots[best].pts, pts);
+
+	YUVFrameDesc slotDesc;
+	if( RDKC_SUCCESS != PrerollDesc(best, &slotDesc) ) {
+		return RDKC_FAILURE;
+	}
+
+	/* the slot is drawn on only through a copy, so it stays intact for later requests */
+	return RdkCVAEncode(slotDesc, cv::Size(prerollSlots[best].frameWidth, prerollSlots[best].frameHeight),
+			    new_width, new_height, overlay, compression_scale, data, size);
+}
+
+/**
+ * @brief This function is used to generate a thumbnail image of the pre-roll frame closest to pts
+ * @param snapshot_filename is filename
+ * @param pts is the wanted frame, e.g. the timestamp of the motion event.
+ * @param compression_scale is JPEG scale value
+ * @param new_width is new width of JPEG image.
+ * @param new_height is new height of JPEG image.
+ * @param overlay is the overlay to draw.
+ * @return RDKC_SUCCESS on success.
+ */
+int ImageTools::GenerateSnapshotAt(std::string snapshot_filename, unsigned long long pts, int compression_scale, int new_width, int new_height, const SnapshotOverlay &overlay)
+{
+	const unsigned char *data = NULL;
+	size_t size = 0;
+
+	if( RDKC_SUCCESS != RdkCVAEncodeAt(pts, new_width, new_height, overlay, compression_scale, &data, &size) ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): RdkCVAEncodeAt failed\n",__FILE__, __LINE__);
+		return RDKC_FAILURE;
+	}
+
+	return write_file(snapshot_filename, data, size);
+}
+
+/**
+ * @brief This function is used to generate a thumbnail image of the pre-roll frame closest to pts in memory
+ * @param jpeg is the output buffer, see SnapshotBuffer.
+ * @param pts is the wanted frame, e.g. the timestamp of the motion event.
+ * @param compression_scale is JPEG scale value
+ * @param new_width is new width of JPEG image.
+ * @param new_height is new height of JPEG image.
+ * @param overlay is the overlay to draw.
+ * @return RDKC_SUCCESS on success.
+ */
+int ImageTools::GenerateSnapshotAt(SnapshotBuffer *jpeg, unsigned long long pts, int compression_scale, int new_width, int new_height, const SnapshotOverlay &overlay)
+{
+	const unsigned char *data = NULL;
+	size_t size = 0;
+
+	if( NULL == jpeg ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Invalid output buffer\n",__FILE__, __LINE__);
+		return RDKC_FAILURE;
+	}
+
+	if( RDKC_SUCCESS != RdkCVAEncodeAt(pts, new_width, new_height, overlay, compression_scale, &data, &size) ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): RdkCVAEncodeAt failed\n",__FILE__, __LINE__);
+		return RDKC_FAILURE;
+	}
+
+	return copy_to_buffer(jpeg, data, size);
+}
+
 /**
  * @brief This function is used to close
  * @param void
@@ -392,7 +1471,11 @@ int ImageTools::GenerateSnapshot(std::string snapshot_filename, int compression_
 int ImageTools::Close()
 {
 	int ret = RDKC_SUCCESS;
-#ifdef _HAS_XSTREAM_
+#if defined(_FILE_FRAME_SOURCE_)
+	std::vector<unsigned char>().swap(fileFrames);
+	fileFrameCount = 0;
+	fileFrameIndex = 0;
+#elif defined(_HAS_XSTREAM_)
 
 #ifdef _DIRECT_FRAME_READ_
 	if( RDKC_FAILURE != consumer->RAWClose() )
@@ -433,9 +1516,5 @@ int ImageTools::Close()
 		free(frame);
 		frame = NULL;
 	}
-	if(NULL != yuvSnapshotData) {
-		free(yuvSnapshotData);
-		yuvSnapshotData = NULL;
-	}
 	return ret;
 }
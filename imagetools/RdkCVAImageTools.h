@@ -24,10 +24,22 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <algorithm>
 #include <opencv2/opencv.hpp>
 #include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
 #include "rdk_debug.h"
-#ifdef _HAS_XSTREAM_
+#include "RdkCVAColorConvert.h"
+#ifdef _HAS_TURBOJPEG_
+#include <turbojpeg.h>
+#endif
+#if defined(_FILE_FRAME_SOURCE_)
+/* frames are read from a raw NV12 file, no camera stack needed */
+#elif defined(_HAS_XSTREAM_)
 #include "xStreamerConsumer.h"
 #else
 #include "RdkCPluginFactory.h"
@@ -36,6 +48,9 @@
 #define RDKC_SUCCESS		0
 #define RDKC_FAILURE		-1
 //#define SNAPSHOT_FILE           "/opt/tn_snapshot.jpg"
+#define FRAME_WAIT_TIMEOUT_MS		2000	/* default wait for a frame in GetYUVFrame */
+#define FRAME_WAIT_BACKOFF_MIN_MS	2
+#define FRAME_WAIT_BACKOFF_MAX_MS	32	/* about one frame at 30 fps */
 
 struct Frame
 {
@@ -44,6 +59,74 @@ struct Frame
         int size;
         int height;
         int width;
+        int pitch;
+        yuv_format_t format;
+        unsigned long long pts;         /* mono_pts, the clock of the analytics framePTS */
+};
+
+/* JPEG snapshot in memory. If data is NULL the JPEG is left in a buffer owned by
+   ImageTools, valid until the next snapshot, else it is copied into data */
+struct SnapshotBuffer
+{
+        unsigned char *data;
+        size_t capacity;
+        size_t size;            /* JPEG size, or the size needed when capacity is too small */
+};
+
+/* Overlay colors in YUV, BT.601 */
+#define OVERLAY_ROI_Y		210	/* yellow */
+#define OVERLAY_ROI_U		16
+#define OVERLAY_ROI_V		146
+#define OVERLAY_BOX_Y		81	/* red */
+#define OVERLAY_BOX_U		90
+#define OVERLAY_BOX_V		240
+#define OVERLAY_DOI_U		54	/* green chroma tint */
+#define OVERLAY_DOI_V		34
+
+/* Snapshot annotations, drawn into the NV12 planes before the color conversion */
+struct SnapshotOverlay
+{
+        std::string roi;                /* ROI polygon, same format as the roi argument */
+        std::string doiMask;            /* DOI bitmap file, the chroma is tinted where it is set */
+        std::vector<cv::Rect> boxes;    /* motion bounding boxes */
+        cv::Size boxSpace;              /* resolution the boxes refer to, frame size when empty */
+};
+
+#define SNAPSHOT_MAX_WORKERS	2	/* encoder threads running next to the caller */
+#define PREROLL_MAX_SLOTS	64	/* frames kept by the pre-roll ring at most */
+
+/* One frame of the pre-roll ring, its planes live in the ring arena */
+struct PrerollSlot
+{
+        unsigned long long pts;
+        yuv_format_t format;
+        int frameWidth;                 /* size of the captured frame, boxes refer to it */
+        int frameHeight;
+        bool valid;
+};
+
+/* One output of a multi-size snapshot */
+struct SnapshotTarget
+{
+        std::string filename;
+        int width;
+        int height;
+        int quality;
+        SnapshotBuffer *output; /* in-memory output, used when filename is empty */
+};
+
+/* JPEG encoder state, one per encoding thread */
+struct JpegEncoderContext
+{
+	std::vector<int> compressionParams;	/* JPEG settings, rebuilt only when the quality changes */
+	std::vector<unsigned char> jpegBuffer;	/* encoded JPEG */
+	cv::Mat chroma;				/* planar U and V for direct YUV encoding */
+#ifdef _HAS_TURBOJPEG_
+	tjhandle handle;			/* encoder kept across snapshots */
+	unsigned char *data;
+	unsigned long dataSize;
+	JpegEncoderContext() : handle(NULL), data(NULL), dataSize(0) {}
+#endif
 };
 
 class ImageTools
@@ -55,16 +138,88 @@ public:
 	~ImageTools();
 	/* Initialize buffer */
 	int Init(int bufferId);
+#ifdef _FILE_FRAME_SOURCE_
+	/* Initialize from a file of raw NV12 frames */
+	int Init(std::string frame_file, int width, int height, int pitch = 0);
+	/* Restart the file frame source from its first frame */
+	void Rewind();
+#endif
+	/* Set how long to wait for a frame */
+	int SetFrameWaitTimeout(int timeout_ms);
 	/* Generate Snapshot */
 	int GenerateSnapshot(std::string snapshot_filename, int compression_scale, int new_width, int new_height, std::string roi = "");
+	int GenerateSnapshot(std::string snapshot_filename, int compression_scale, int new_width, int new_height, const SnapshotOverlay &overlay);
+	/* Generate Snapshot into memory */
+	int GenerateSnapshot(SnapshotBuffer *jpeg, int compression_scale, int new_width, int new_height, std::string roi = "");
+	int GenerateSnapshot(SnapshotBuffer *jpeg, int compression_scale, int new_width, int new_height, const SnapshotOverlay &overlay);
+	/* Generate several snapshots of different sizes from one frame, all with the same overlay */
+	int GenerateSnapshots(const std::vector<SnapshotTarget> &targets, const SnapshotOverlay &overlay = SnapshotOverlay());
+	/* Keep the last slots frames, downscaled to width x height, in a preallocated ring */
+	int EnablePreroll(int slots, int width, int height);
+	void DisablePreroll();
+	/* Grab a frame into the pre-roll ring */
+	int CapturePreroll(unsigned long long *pts = NULL);
+	/* Generate Snapshot of the pre-roll frame closest to pts */
+	int GenerateSnapshotAt(std::string snapshot_filename, unsigned long long pts, int compression_scale, int new_width, int new_height, const SnapshotOverlay &overlay = SnapshotOverlay());
+	int GenerateSnapshotAt(SnapshotBuffer *jpeg, unsigned long long pts, int compression_scale, int new_width, int new_height, const SnapshotOverlay &overlay = SnapshotOverlay());
 	/* Close */
 	int Close();
 private:
-	static unsigned char * yuvSnapshotData;
 	Frame *frame;
 	int buf_id;
+	int frameWaitTimeoutMs;
+
+	/* Snapshot context, buffers are reallocated only when the snapshot size changes */
+	cv::Mat yuvMat;				/* downscaled or copied YUV frame */
+	YUVFrameDesc snapDesc;			/* planes of the snapshot, yuvMat or the source frame */
+	cv::Mat bgrMat;				/* color converted frame */
+	cv::Mat scaledMat;			/* final size when it differs from bgrMat */
+	JpegEncoderContext encoders[SNAPSHOT_MAX_WORKERS + 1];	/* [0] belongs to the calling thread */
+
+	/* Resolution pyramid of a multi-size snapshot, one level per target */
+	std::vector<cv::Mat> pyramid;		/* level of each target, may share data with a larger level */
+	std::vector<cv::Mat> pyramidStore;	/* buffers owned by the levels that needed a resize */
+	std::vector< std::vector<unsigned char> > outputStore;	/* in-memory outputs of the targets */
+
+	/* Overlay geometry cached between snapshots */
+	std::string roiCacheKey;
+	cv::Size roiCacheSize;
+	std::vector< std::vector<cv::Point> > roiLuma;
+	std::vector< std::vector<cv::Point> > roiChroma;
+	std::string doiCachePath;
+	time_t doiCacheMtime;
+	cv::Mat doiMask;
+	cv::Mat doiChromaMask;
+
+	/* Encoder thread pool, started on the first multi-size snapshot */
+	pthread_t workers[SNAPSHOT_MAX_WORKERS];
+	int workerCount;
+	int workerIds;
+	bool poolExit;
+	pthread_mutex_t poolMutex;
+	pthread_cond_t poolWork;
+	pthread_cond_t poolDone;
+	const std::vector<SnapshotTarget> *jobTargets;
+	size_t nextJob;
+	size_t pendingJobs;
+	int failedJobs;
+
+	/* Pre-roll ring, the arena is allocated once by EnablePreroll */
+	std::vector<unsigned char> prerollArena;
+	std::vector<PrerollSlot> prerollSlots;
+	int prerollWidth;
+	int prerollHeight;
+	size_t prerollNext;
 
-#ifdef _HAS_XSTREAM_
+#if defined(_FILE_FRAME_SOURCE_)
+	std::vector<unsigned char> fileFrames;	/* all frames of the file, served in a loop */
+	int fileWidth;
+	int fileHeight;
+	int filePitch;
+	size_t fileFrameCount;
+	size_t fileFrameIndex;
+	unsigned long long fileFrameSeq;	/* pts of the file frames */
+#elif defined(_HAS_XSTREAM_)
 	XStreamerConsumer *consumer;
 #ifndef _DIRECT_FRAME_READ_
 	curlInfo frameHandler;
@@ -78,9 +233,44 @@ private:
 	/* Get the YUV frame */
 	//int GetYUVFrame(iImage* plane0, iImage* plane1);
 	int GetYUVFrame();
+	/* Describe the planes of the current frame */
+	int DescribeFrame(YUVFrameDesc *desc);
+	/* Bring the planes of src to the snapshot size */
+	int ResizeYUV(const YUVFrameDesc &src, int new_width, int new_height, bool writable);
+	/* Convert snapDesc to BGR */
+	int ConvertYUVToBGR(int new_width, int new_height, cv::Mat &outMat);
+	/* Draw the overlay into snapDesc */
+	void DrawOverlay(const SnapshotOverlay &overlay, cv::Size frame_size);
+	/* Encode snapDesc to JPEG */
+	int EncodeYUV(JpegEncoderContext &ctx, int new_width, int new_height, int compression_scale, const unsigned char **data, size_t *size);
+	/* Encode a BGR image to JPEG with a persistent encoder */
+	static int EncodeJPEG(JpegEncoderContext &ctx, const cv::Mat &image, int compression_scale, const unsigned char **data, size_t *size);
+	/* Encode a BGR image and write it to file */
+	static int WriteJPEG(JpegEncoderContext &ctx, std::string snapshot_filename, const cv::Mat &image, int compression_scale);
+	/* Encode a BGR image into a memory buffer */
+	static int OutputJPEG(JpegEncoderContext &ctx, SnapshotBuffer *jpeg, const cv::Mat &image, int compression_scale);
+	/* Release an encoder */
+	static void ReleaseJPEGEncoder(JpegEncoderContext &ctx);
+	/* Release the snapshot context */
+	void ReleaseSnapshotContext();
+	/* Build one annotated BGR level per target from the current frame */
+	int BuildSnapshotPyramid(const std::vector<SnapshotTarget> &targets, const SnapshotOverlay &overlay);
+	/* Encode and write the target at index */
+	int RunSnapshotJob(size_t index, JpegEncoderContext &ctx);
+	/* Run queued snapshot jobs until none is left */
+	void ProcessSnapshotJobs(JpegEncoderContext &ctx);
+	/* Encoder thread pool */
+	void StartWorkers(int count);
+	void StopWorkers();
+	static void* WorkerThread(void *arg);
+	/* Describe the pre-roll slot at index */
+	int PrerollDesc(size_t index, YUVFrameDesc *desc);
+	/* Encode the pre-roll frame closest to pts */
+	int RdkCVAEncodeAt(unsigned long long pts, int new_width, int new_height, const SnapshotOverlay &overlay, int compression_scale, const unsigned char **data, size_t *size);
+	/* Resize src, draw the overlay and encode it */
+	int RdkCVAEncode(const YUVFrameDesc &src, cv::Size frame_size, int new_width, int new_height, const SnapshotOverlay &overlay, int compression_scale, const unsigned char **data, size_t *size);
 	/* Generate jpeg image using opencv */
-	int RdkCVASnapshot_NV12(std::string snapshot_filename, int compression_scale, int new_width, int new_height, std::string roi = "");
-	int RdkCVASnapshot_YV12(std::string snapshot_filename, int compression_scale, int new_width, int new_height);
+	int RdkCVASnapshot(std::string snapshot_filename, int compression_scale, int new_width, int new_height, const SnapshotOverlay &overlay);
 };
 
 #endif /*#ifndef __IMAGETOOLS_H_ */
@@ -0,0 +1,681 @@
+/*
+* Copyright 2020 Comcast Cable Communications Management, LLC
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* SPDX-License-Identifier: Apache-2.0
+*/
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "RdkCVASnapshotService.h"
+
+#define SNAPSHOT_SERVICE_REPLY_TIMEOUT_MS	5000	/* frame wait plus encode, seen from the client */
+
+volatile sig_atomic_t SnapshotService::stopRequested = 0;
+
+static long elapsed_ms(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((now.tv_sec - start->tv_sec) * 1000L) + ((now.tv_nsec - start->tv_nsec) / 1000000L);
+}
+
+static void set_timeout(int fd, int option, int timeout_ms)
+{
+	struct timeval tv;
+
+	tv.tv_sec = timeout_ms / 1000;
+	tv.tv_usec = (timeout_ms % 1000) * 1000;
+	setsockopt(fd, SOL_SOCKET, option, &tv, sizeof(tv));
+}
+
+static int send_all(int fd, const void *data, size_t size)
+{
+	const char *p = (const char *)data;
+
+	while( size > 0 ) {
+		ssize_t sent = send(fd, p, size, MSG_NOSIGNAL);
+		if( sent < 0 ) {
+			if( EINTR == errno ) {
+				continue;
+			}
+			return RDKC_FAILURE;
+		}
+		p += sent;
+		size -= sent;
+	}
+	return RDKC_SUCCESS;
+}
+
+static int fill_address(const std::string &socket_path, struct sockaddr_un *addr)
+{
+	if( socket_path.empty() || (socket_path.size() >= sizeof(addr->sun_path)) ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Invalid socket path %s\n",__FUNCTION__,__LINE__, socket_path.c_str());
+		return RDKC_FAILURE;
+	}
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	strncpy(addr->sun_path, socket_path.c_str(), sizeof(addr->sun_path) - 1);
+	return RDKC_SUCCESS;
+}
+
+/* Removes the socket left behind by a dead instance, fails when an instance still answers on it */
+static int claim_socket_path(const std::string &socket_path, const struct sockaddr_un *addr)
+{
+	struct stat st;
+
+	if( 0 != lstat(socket_path.c_str(), &st) ) {
+		return (ENOENT == errno) ? RDKC_SUCCESS : RDKC_FAILURE;
+	}
+	if( !S_ISSOCK(st.st_mode) ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): %s exists and is not a socket\n",__FUNCTION__,__LINE__, socket_path.c_str());
+		return RDKC_FAILURE;
+	}
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if( fd < 0 ) {
+		return RDKC_FAILURE;
+	}
+	int ret = connect(fd, (const struct sockaddr *)addr, sizeof(*addr));
+	int err = errno;
+	close(fd);
+	if( 0 == ret ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): A snapshot service is already running on %s\n",__FUNCTION__,__LINE__, socket_path.c_str());
+		return RDKC_FAILURE;
+	}
+	if( ECONNREFUSED != err ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Unable to probe %s: %s\n",__FUNCTION__,__LINE__, socket_path.c_str(), strerror(err));
+		return RDKC_FAILURE;
+	}
+
+	/* nobody listens, a previous instance died without removing it */
+	if( (0 != unlink(socket_path.c_str())) && (ENOENT != errno) ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Unable to remove %s: %s\n",__FUNCTION__,__LINE__, socket_path.c_str(), strerror(errno));
+		return RDKC_FAILURE;
+	}
+	return RDKC_SUCCESS;
+}
+
+/* Constructor */
+SnapshotService::SnapshotService(int bufferId):imgt(NULL)
+			, bufId(bufferId)
+			, listenFd(-1)
+			, prerollSlots(0)
+{
+	RDK_LOG( RDK_LOG_DEBUG,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Constructor.\n",__FUNCTION__,__LINE__);
+}
+
+/* Destructor */
+SnapshotService::~SnapshotService()
+{
+	while( !clients.empty() ) {
+		DropClient(clients.size() - 1);
+	}
+	if( listenFd >= 0 ) {
+		close(listenFd);
+		listenFd = -1;
+		unlink(socketPath.c_str());
+	}
+	CloseFrameSource();
+	RDK_LOG( RDK_LOG_DEBUG,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Destructor.\n",__FUNCTION__,__LINE__);
+}
+
+/**
+ * @brief This function is used to create the ImageTools instance and open the frame source
+ * @param void
+ * @return RDKC_SUCCESS on success.
+ */
+int SnapshotService::OpenFrameSource()
+{
+	imgt = new ImageTools();
+	if( NULL == imgt ) {
+		return RDKC_FAILURE;
+	}
+	if( RDKC_SUCCESS != imgt->Init(bufId) ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): ImageTools initialization failed\n",__FUNCTION__,__LINE__);
+		CloseFrameSource();
+		return RDKC_FAILURE;
+	}
+	if( (prerollSlots > 0) &&
+	    (RDKC_SUCCESS != imgt->EnablePreroll(prerollSlots, SNAPSHOT_SERVICE_PREROLL_WIDTH, SNAPSHOT_SERVICE_PREROLL_HEIGHT)) ) {
+		CloseFrameSource();
+		return RDKC_FAILURE;
+	}
+	return RDKC_SUCCESS;
+}
+
+/**
+ * @brief This function is used to close the frame source and delete the ImageTools instance
+ * @param void
+ * @return void
+ */
+void SnapshotService::CloseFrameSource()
+{
+	if( NULL != imgt ) {
+		delete imgt;
+		imgt = NULL;
+	}
+}
+
+/**
+ * @brief This function is used to keep the last slots frames in a pre-roll ring, so a request
+ *        can ask for the frame of an earlier pts, e.g. the one where motion was detected.
+ *        Run grabs a frame into the ring every SNAPSHOT_SERVICE_PREROLL_MS.
+ * @param slots is the number of frames kept, 0 to disable the ring.
+ * @return RDKC_SUCCESS on success.
+ */
+int SnapshotService::EnablePreroll(int slots)
+{
+	if( (slots < 0) || (slots > PREROLL_MAX_SLOTS) ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Invalid pre-roll of %d frames\n",__FUNCTION__,__LINE__, slots);
+		return RDKC_FAILURE;
+	}
+	if( NULL != imgt ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Service already started\n",__FUNCTION__,__LINE__);
+		return RDKC_FAILURE;
+	}
+	prerollSlots = slots;
+	return RDKC_SUCCESS;
+}
+
+/**
+ * @brief This function is used to open the frame source once and listen for requests.
+ *        The frame source stays open until the service is destroyed.
+ * @param socket_path is the Unix domain socket to listen on.
+ * @return RDKC_SUCCESS on success.
+ */
+int SnapshotService::Start(std::string socket_path)
+{
+	struct sockaddr_un addr;
+
+	if( (RDKC_SUCCESS != fill_address(socket_path, &addr)) || (RDKC_SUCCESS != claim_socket_path(socket_path, &addr)) ) {
+		return RDKC_FAILURE;
+	}
+
+	if( RDKC_SUCCESS != OpenFrameSource() ) {
+		return RDKC_FAILURE;
+	}
+
+	listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if( listenFd < 0 ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): socket failed: %s\n",__FUNCTION__,__LINE__, strerror(errno));
+		return RDKC_FAILURE;
+	}
+
+	/* only the owner may connect, the socket is created with these permissions */
+	mode_t old_mask = umask(S_IRWXG | S_IRWXO | S_IXUSR);
+	int bound = bind(listenFd, (struct sockaddr *)&addr, sizeof(addr));
+	umask(old_mask);
+	if( (0 != bound) || (0 != listen(listenFd, SNAPSHOT_SERVICE_MAX_CLIENTS)) ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Unable to listen on %s: %s\n",__FUNCTION__,__LINE__, socket_path.c_str(), strerror(errno));
+		close(listenFd);
+		listenFd = -1;
+		return RDKC_FAILURE;
+	}
+	fcntl(listenFd, F_SETFL, fcntl(listenFd, F_GETFL) | O_NONBLOCK);
+	socketPath = socket_path;
+	clock_gettime(CLOCK_MONOTONIC, &prerollLast);
+
+	RDK_LOG( RDK_LOG_INFO,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Snapshot service listening on %s\n",__FUNCTION__,__LINE__, socket_path.c_str());
+	return RDKC_SUCCESS;
+}
+
+/**
+ * @brief This function is used to ask Run to return. Only sets a flag, safe from a signal handler.
+ * @param void
+ * @return void
+ */
+void SnapshotService::Stop()
+{
+	stopRequested = 1;
+}
+
+/**
+ * @brief This function is used to serve requests until Stop is called. Once a request is
+ *        complete the service waits SNAPSHOT_SERVICE_COALESCE_MS for more, then grabs one
+ *        frame for all of them, one per distinct ROI. In between it feeds the pre-roll ring.
+ * @param void
+ * @return RDKC_SUCCESS on success.
+ */
+int SnapshotService::Run()
+{
+	std::vector<struct pollfd> fds;
+	struct timespec batch_start;
+	bool batch_open = false;
+
+	if( listenFd < 0 ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Service not started\n",__FUNCTION__,__LINE__);
+		return RDKC_FAILURE;
+	}
+
+	while( !stopRequested ) {
+		int timeout_ms = -1;
+		if( batch_open ) {
+			timeout_ms = SNAPSHOT_SERVICE_COALESCE_MS - elapsed_ms(&batch_start);
+			if( timeout_ms <= 0 ) {
+				ServeBatch();
+				batch_open = false;
+				continue;
+			}
+		}
+		if( prerollSlots > 0 ) {
+			int preroll_ms = SNAPSHOT_SERVICE_PREROLL_MS - elapsed_ms(&prerollLast);
+			if( preroll_ms <= 0 ) {
+				CapturePreroll();
+				continue;
+			}
+			if( (timeout_ms < 0) || (preroll_ms < timeout_ms) ) {
+				timeout_ms = preroll_ms;
+			}
+		}
+
+		/* complete requests wait for the batch, only the others are read */
+		fds.clear();
+		if( clients.size() < SNAPSHOT_SERVICE_MAX_CLIENTS ) {
+			struct pollfd pfd = { listenFd, POLLIN, 0 };
+			fds.push_back(pfd);
+		}
+		for( size_t i = 0; i < clients.size(); i++ ) {
+			struct pollfd pfd = { clients[i].fd, (short)(clients[i].complete ? 0 : POLLIN), 0 };
+			fds.push_back(pfd);
+		}
+
+		int ready = poll(fds.data(), fds.size(), timeout_ms);
+		if( ready < 0 ) {
+			if( EINTR == errno ) {
+				continue;
+			}
+			RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): poll failed: %s\n",__FUNCTION__,__LINE__, strerror(errno));
+			return RDKC_FAILURE;
+		}
+		if( 0 == ready ) {
+			continue;
+		}
+
+		size_t first_client = 0;
+		if( clients.size() < SNAPSHOT_SERVICE_MAX_CLIENTS ) {
+			first_client = 1;
+		}
+		/* walk backwards so dropping a client does not shift the ones still to check */
+		for( size_t i = clients.size(); i > 0; i-- ) {
+			short revents = fds[first_client + i - 1].revents;
+			if( 0 == revents ) {
+				continue;
+			}
+			if( !ReadClient(clients[i - 1]) ) {
+				DropClient(i - 1);
+			}
+			else if( clients[i - 1].complete && !batch_open ) {
+				clock_gettime(CLOCK_MONOTONIC, &batch_start);
+				batch_open = true;
+			}
+		}
+		if( (1 == first_client) && (0 != fds[0].revents) ) {
+			AcceptClients();
+		}
+	}
+
+	RDK_LOG( RDK_LOG_INFO,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Snapshot service stopped\n",__FUNCTION__,__LINE__);
+	return RDKC_SUCCESS;
+}
+
+/**
+ * @brief This function is used to accept the pending connections
+ * @param void
+ * @return void
+ */
+void SnapshotService::AcceptClients()
+{
+	while( clients.size() < SNAPSHOT_SERVICE_MAX_CLIENTS ) {
+		int fd = accept(listenFd, NULL, NULL);
+		if( fd < 0 ) {
+			if( (EAGAIN != errno) && (EWOULDBLOCK != errno) && (EINTR != errno) ) {
+				RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): accept failed: %s\n",__FUNCTION__,__LINE__, strerror(errno));
+			}
+			return;
+		}
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+		set_timeout(fd, SO_SNDTIMEO, SNAPSHOT_SERVICE_IO_TIMEOUT_MS);
+
+		SnapshotRequest client;
+		client.fd = fd;
+		client.complete = false;
+		client.quality = 0;
+		client.width = 0;
+		client.height = 0;
+		client.pts = 0;
+		client.target = 0;
+		clients.push_back(client);
+	}
+}
+
+/**
+ * @brief This function is used to read the request of a client
+ * @param client is the client.
+ * @return false when the client has to be dropped.
+ */
+bool SnapshotService::ReadClient(SnapshotRequest &client)
+{
+	char buf[256];
+
+	while( true ) {
+		ssize_t got = recv(client.fd, buf, sizeof(buf), 0);
+		if( got < 0 ) {
+			return (EAGAIN == errno) || (EWOULDBLOCK == errno) || (EINTR == errno);
+		}
+		if( 0 == got ) {
+			return false;
+		}
+		client.line.append(buf, got);
+
+		size_t end = client.line.find('\n');
+		if( std::string::npos != end ) {
+			client.line.resize(end);
+			client.complete = ParseRequest(client);
+			if( !client.complete ) {
+				RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Invalid request: %s\n",__FUNCTION__,__LINE__, client.line.c_str());
+				Reply(client, false, NULL, 0);
+				return false;
+			}
+			return true;
+		}
+		if( client.line.size() > SNAPSHOT_SERVICE_MAX_REQUEST ) {
+			RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Request too long\n",__FUNCTION__,__LINE__);
+			Reply(client, false, NULL, 0);
+			return false;
+		}
+	}
+}
+
+/**
+ * @brief This function is used to parse a request line, see the protocol in RdkCVASnapshotService.h
+ * @param client is the client, its line is complete.
+ * @return true when the request is valid.
+ */
+bool SnapshotService::ParseRequest(SnapshotRequest &client)
+{
+	size_t roi_start = client.line.find('\t');
+	if( std::string::npos == roi_start ) {
+		return false;
+	}
+
+	/* the pts is optional, older clients do not send it */
+	std::string sizes = client.line.substr(0, roi_start);
+	client.pts = 0;
+	if( 3 > sscanf(sizes.c_str(), "%d %d %d %llu", &client.quality, &client.width, &client.height, &client.pts) ) {
+		return false;
+	}
+	client.roi = client.line.substr(roi_start + 1);
+
+	return (client.quality >= 0) && (client.quality <= 100) &&
+	       (client.width > 0) && (client.height > 0);
+}
+
+/**
+ * @brief This function is used to answer every complete request. Requests with the same ROI
+ *        share one frame, drawn once, and equal sizes and qualities share one encode.
+ * @param void
+ * @return void
+ */
+void SnapshotService::ServeBatch()
+{
+	size_t first = 0;
+
+	/* without a pre-roll ring they get the next frame like the others */
+	for( size_t i = clients.size(); (prerollSlots > 0) && (i > 0); i-- ) {
+		if( clients[i - 1].complete && (0 != clients[i - 1].pts) ) {
+			ServePreroll(clients[i - 1]);
+			DropClient(i - 1);
+		}
+	}
+
+	while( true ) {
+		while( (first < clients.size()) && !clients[first].complete ) {
+			first++;
+		}
+		if( first == clients.size() ) {
+			return;
+		}
+		/* the served clients are dropped, the next group starts at the same index */
+		ServeGroup(clients[first].roi);
+	}
+}
+
+/**
+ * @brief This function is used to grab one frame and answer the complete requests for roi
+ * @param roi is the ROI of the group.
+ * @return void
+ */
+void SnapshotService::ServeGroup(std::string roi)
+{
+	targets.clear();
+	for( size_t i = 0; i < clients.size(); i++ ) {
+		SnapshotRequest &client = clients[i];
+		if( !client.complete || (client.roi != roi) ) {
+			continue;
+		}
+
+		size_t j = 0;
+		while( (j < targets.size()) &&
+		       !((targets[j].width == client.width) && (targets[j].height == client.height) &&
+			 (targets[j].quality == client.quality)) ) {
+			j++;
+		}
+		if( j == targets.size() ) {
+			SnapshotTarget target;
+			target.width = client.width;
+			target.height = client.height;
+			target.quality = client.quality;
+			target.output = NULL;
+			targets.push_back(target);
+		}
+		client.target = j;
+	}
+
+	SnapshotBuffer empty = { NULL, 0, 0 };
+	outputs.assign(targets.size(), empty);
+	for( size_t j = 0; j < targets.size(); j++ ) {
+		targets[j].output = &outputs[j];
+	}
+
+	SnapshotOverlay overlay;
+	overlay.roi = roi;
+	int ret = (NULL != imgt) ? imgt->GenerateSnapshots(targets, overlay) : RDKC_FAILURE;
+	if( RDKC_SUCCESS != ret ) {
+		/* the frame source may be gone, reopen it and try once more */
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Snapshot failed, reopening the frame source\n",__FUNCTION__,__LINE__);
+		CloseFrameSource();
+		if( RDKC_SUCCESS == OpenFrameSource() ) {
+			ret = imgt->GenerateSnapshots(targets, overlay);
+		}
+	}
+	RDK_LOG( RDK_LOG_DEBUG,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): %zu encodes for %zu clients\n",__FUNCTION__,__LINE__, targets.size(), clients.size());
+
+	for( size_t i = clients.size(); i > 0; i-- ) {
+		SnapshotRequest &client = clients[i - 1];
+		if( !client.complete || (client.roi != roi) ) {
+			continue;
+		}
+
+		ReplySnapshot(client, ret, outputs[client.target]);
+		DropClient(i - 1);
+	}
+}
+
+/**
+ * @brief This function is used to answer a request for the pre-roll frame closest to its pts
+ * @param client is the client.
+ * @return void
+ */
+void SnapshotService::ServePreroll(SnapshotRequest &client)
+{
+	SnapshotOverlay overlay;
+	SnapshotBuffer jpeg = { NULL, 0, 0 };
+
+	overlay.roi = client.roi;
+	int ret = (NULL != imgt) ? imgt->GenerateSnapshotAt(&jpeg, client.pts, client.quality, client.width, client.height, overlay) : RDKC_FAILURE;
+	ReplySnapshot(client, ret, jpeg);
+}
+
+/**
+ * @brief This function is used to grab the next frame into the pre-roll ring
+ * @param void
+ * @return void
+ */
+void SnapshotService::CapturePreroll()
+{
+	clock_gettime(CLOCK_MONOTONIC, &prerollLast);
+	if( (NULL != imgt) && (RDKC_SUCCESS != imgt->CapturePreroll()) ) {
+		/* a broken frame source is reopened by the next snapshot request */
+		RDK_LOG( RDK_LOG_DEBUG,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Pre-roll capture failed\n",__FUNCTION__,__LINE__);
+	}
+}
+
+/**
+ * @brief This function is used to send a snapshot, or the error, to the client
+ * @param client is the client.
+ * @param ret is the result of the snapshot.
+ * @param jpeg is the snapshot.
+ * @return void
+ */
+void SnapshotService::ReplySnapshot(SnapshotRequest &client, int ret, const SnapshotBuffer &jpeg)
+{
+	Reply(client, RDKC_SUCCESS == ret, jpeg.data, jpeg.size);
+}
+
+/**
+ * @brief This function is used to send the response to a client
+ * @param client is the client.
+ * @param ok is the result.
+ * @param data is the JPEG to send, NULL when none.
+ * @param size is the size of the JPEG.
+ * @return void
+ */
+void SnapshotService::Reply(SnapshotRequest &client, bool ok, const unsigned char *data, size_t size)
+{
+	char header[32];
+
+	if( ok ) {
+		snprintf(header, sizeof(header), "OK %zu\n", (NULL != data) ? size : (size_t)0);
+	}
+	else {
+		snprintf(header, sizeof(header), "ERR\n");
+	}
+
+	/* blocking writes bounded by SO_SNDTIMEO, a stuck client cannot stall the others for long */
+	fcntl(client.fd, F_SETFL, fcntl(client.fd, F_GETFL) & ~O_NONBLOCK);
+	if( (RDKC_SUCCESS != send_all(client.fd, header, strlen(header))) ||
+	    (ok && (NULL != data) && (RDKC_SUCCESS != send_all(client.fd, data, size))) ) {
+		RDK_LOG( RDK_LOG_WARN,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Unable to reply: %s\n",__FUNCTION__,__LINE__, strerror(errno));
+	}
+}
+
+/**
+ * @brief This function is used to close a client and remove it
+ * @param index is the client.
+ * @return void
+ */
+void SnapshotService::DropClient(size_t index)
+{
+	close(clients[index].fd);
+	clients.erase(clients.begin() + index);
+}
+
+/**
+ * @brief This function is used to request a snapshot from a running service.
+ * @param socket_path is the socket of the service.
+ * @param compression_scale is JPEG scale value
+ * @param new_width is new width of JPEG image.
+ * @param new_height is new height of JPEG image.
+ * @param roi is the ROI to draw, may be empty.
+ * @param pts is the pre-roll frame wanted, 0 for the next frame.
+ * @param jpeg receives the JPEG, the caller writes it wherever it wants.
+ * @return RDKC_SUCCESS on success, RDKC_FAILURE also when no service is running.
+ */
+int SnapshotService::Request(std::string socket_path, int compression_scale, int new_width, int new_height,
+			     std::string roi, unsigned long long pts, std::vector<unsigned char> &jpeg)
+{
+	struct sockaddr_un addr;
+
+	if( (RDKC_SUCCESS != fill_address(socket_path, &addr)) || (std::string::npos != roi.find_first_of("\t\n")) ) {
+		return RDKC_FAILURE;
+	}
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if( fd < 0 ) {
+		return RDKC_FAILURE;
+	}
+	if( 0 != connect(fd, (struct sockaddr *)&addr, sizeof(addr)) ) {
+		RDK_LOG( RDK_LOG_DEBUG,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): No snapshot service on %s\n",__FUNCTION__,__LINE__, socket_path.c_str());
+		close(fd);
+		return RDKC_FAILURE;
+	}
+	set_timeout(fd, SO_SNDTIMEO, SNAPSHOT_SERVICE_IO_TIMEOUT_MS);
+	set_timeout(fd, SO_RCVTIMEO, SNAPSHOT_SERVICE_REPLY_TIMEOUT_MS);
+
+	char prefix[96];
+	snprintf(prefix, sizeof(prefix), "%d %d %d %llu\t", compression_scale, new_width, new_height, pts);
+	std::string line = prefix + roi + "\n";
+	if( RDKC_SUCCESS != send_all(fd, line.data(), line.size()) ) {
+		close(fd);
+		return RDKC_FAILURE;
+	}
+
+	/* header, then the JPEG */
+	std::string reply;
+	char buf[4096];
+	size_t header_end = std::string::npos;
+	while( std::string::npos == (header_end = reply.find('\n')) ) {
+		ssize_t got = recv(fd, buf, sizeof(buf), 0);
+		if( (got < 0) && (EINTR == errno) ) {
+			continue;
+		}
+		if( (got <= 0) || (reply.size() > SNAPSHOT_SERVICE_MAX_REQUEST) ) {
+			RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): No reply from the snapshot service\n",__FUNCTION__,__LINE__);
+			close(fd);
+			return RDKC_FAILURE;
+		}
+		reply.append(buf, got);
+	}
+
+	unsigned long size = 0;
+	if( (1 != sscanf(reply.c_str(), "OK %lu", &size)) || (0 == size) ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Snapshot service failed\n",__FUNCTION__,__LINE__);
+		close(fd);
+		return RDKC_FAILURE;
+	}
+
+	jpeg.assign(reply.begin() + header_end + 1, reply.end());
+	while( jpeg.size() < size ) {
+		ssize_t got = recv(fd, buf, sizeof(buf), 0);
+		if( (got < 0) && (EINTR == errno) ) {
+			continue;
+		}
+		if( got <= 0 ) {
+			RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Short JPEG from the snapshot service\n",__FUNCTION__,__LINE__);
+			close(fd);
+			return RDKC_FAILURE;
+		}
+		jpeg.insert(jpeg.end(), buf, buf + got);
+	}
+	jpeg.resize(size);
+
+	close(fd);
+	return RDKC_SUCCESS;
+}
@@ -0,0 +1,111 @@
+/*
+* Copyright 2020 Comcast Cable Communications Management, LLC
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* SPDX-License-Identifier: Apache-2.0
+*/
+
+#ifndef __RDKCVA_SNAPSHOTSERVICE_H_
+#define __RDKCVA_SNAPSHOTSERVICE_H_
+
+/*************************       INCLUDES         *************************/
+#include <signal.h>
+#include "RdkCVAImageTools.h"
+
+#define SNAPSHOT_SERVICE_SOCKET		"/var/run/rdkc_snapshooter.sock"	/* created 0600, not in a world writable directory */
+#define SNAPSHOT_SERVICE_MAX_CLIENTS	16
+#define SNAPSHOT_SERVICE_MAX_REQUEST	1024	/* bytes of one request line */
+#define SNAPSHOT_SERVICE_COALESCE_MS	10	/* wait for more requests before grabbing the frame */
+#define SNAPSHOT_SERVICE_IO_TIMEOUT_MS	2000
+#define SNAPSHOT_SERVICE_PREROLL_WIDTH	640	/* size of the frames kept by the pre-roll ring */
+#define SNAPSHOT_SERVICE_PREROLL_HEIGHT	360
+#define SNAPSHOT_SERVICE_PREROLL_MS	100	/* pre-roll capture interval */
+
+/*
+ * Protocol, one request per connection:
+ *   request  "<quality> <width> <height> <pts>\t<roi>\n", pts 0 or missing for the next
+ *            frame, else the pre-roll frame closest to pts
+ *   response "OK <size>\n" followed by size bytes of JPEG, or "ERR\n"
+ * The service never opens files on behalf of a client, the client writes the JPEG itself.
+ */
+
+/* One connected client */
+struct SnapshotRequest
+{
+	int fd;
+	std::string line;		/* request received so far */
+	bool complete;
+	int quality;
+	int width;
+	int height;
+	std::string roi;
+	unsigned long long pts;		/* pre-roll frame wanted, 0 for the next frame */
+	size_t target;			/* index of the shared snapshot target */
+};
+
+class SnapshotService
+{
+public:
+	/* Constructor */
+	SnapshotService(int bufferId);
+	/* Destructor */
+	~SnapshotService();
+	/* Keep the last slots frames, captured every SNAPSHOT_SERVICE_PREROLL_MS, call before Start */
+	int EnablePreroll(int slots);
+	/* Open the frame source and listen on socket_path */
+	int Start(std::string socket_path);
+	/* Serve requests until Stop is called */
+	int Run();
+	/* Ask Run to return, safe from a signal handler */
+	static void Stop();
+	/* Send a request to a running service, jpeg receives the image */
+	static int Request(std::string socket_path, int compression_scale, int new_width, int new_height,
+			   std::string roi, unsigned long long pts, std::vector<unsigned char> &jpeg);
+private:
+	ImageTools *imgt;
+	int bufId;
+	int listenFd;
+	std::string socketPath;
+	std::vector<SnapshotRequest> clients;
+	std::vector<SnapshotTarget> targets;
+	std::vector<SnapshotBuffer> outputs;
+	int prerollSlots;
+	struct timespec prerollLast;	/* time of the last pre-roll capture */
+	static volatile sig_atomic_t stopRequested;
+
+	/* Create and initialize the ImageTools instance */
+	int OpenFrameSource();
+	void CloseFrameSource();
+	/* Accept pending connections */
+	void AcceptClients();
+	/* Read from a client, returns false when it has to be dropped */
+	bool ReadClient(SnapshotRequest &client);
+	/* Parse a complete request line */
+	static bool ParseRequest(SnapshotRequest &client);
+	/* Answer every complete request, one frame per ROI */
+	void ServeBatch();
+	/* Grab one frame and answer the complete requests for roi, equal requests share one encode */
+	void ServeGroup(std::string roi);
+	/* Answer a request for a pre-roll frame */
+	void ServePreroll(SnapshotRequest &client);
+	/* Grab the next frame into the pre-roll ring */
+	void CapturePreroll();
+	/* Send a snapshot, or the error, to the client */
+	void ReplySnapshot(SnapshotRequest &client, int ret, const SnapshotBuffer &jpeg);
+	/* Send the response and close the client */
+	void Reply(SnapshotRequest &client, bool ok, const unsigned char *data, size_t size);
+	void DropClient(size_t index);
+};
+
+#endif /*#ifndef __RDKCVA_SNAPSHOTSERVICE_H_ */
@@ -0,0 +1,293 @@
+/*
+* Copyright 2020 Comcast Cable Communications Management, LLC
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* SPDX-License-Identifier: Apache-2.0
+*/
+
+/*
+ * Snapshot benchmark and golden image check for ImageTools.
+ * Runs against a file of raw NV12 frames, no camera needed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include "RdkCVAImageTools.h"
+
+#define DEFAULT_ITERATIONS      50
+#define DEFAULT_MIN_PSNR        40.0
+
+struct BenchOutput
+{
+	int width;
+	int height;
+	int quality;
+};
+
+static void help()
+{
+	printf("Usage: ./imagetools_bench -i <nv12_frames_file> -s <width>x<height> [options]\n");
+	printf("  -p <pitch>            line pitch of the frames, default width\n");
+	printf("  -o <w>x<h>[@<q>]      output size and JPEG quality, repeatable, default 320x180@60 640x360@60 1280x720@80\n");
+	printf("  -n <iterations>       snapshots per output, default %d\n", DEFAULT_ITERATIONS);
+	printf("  -m                    also time one multi-size snapshot of all outputs\n");
+	printf("  -w <dir>              write the first snapshot of every output to dir\n");
+	printf("  -g <dir>              compare the first snapshot of every output with the golden JPEG in dir\n");
+	printf("  -t <psnr>             minimum PSNR in dB against the golden JPEG, default %.1f\n", DEFAULT_MIN_PSNR);
+	printf("Frames are raw NV12, e.g. ffmpeg -i in.mp4 -pix_fmt nv12 -f rawvideo frames.nv12\n");
+}
+
+static double now_ms()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1000.0) + (ts.tv_nsec / 1000000.0);
+}
+
+static long peak_rss_kb()
+{
+	struct rusage usage;
+
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+}
+
+static std::string output_name(const BenchOutput &out)
+{
+	char name[64];
+
+	snprintf(name, sizeof(name), "snapshot_%dx%d_q%d.jpg", out.width, out.height, out.quality);
+	return name;
+}
+
+static bool write_output(const std::string &path, const SnapshotBuffer &jpeg)
+{
+	FILE *fp = fopen(path.c_str(), "wb");
+	if( NULL == fp ) {
+		return false;
+	}
+	size_t written = fwrite(jpeg.data, 1, jpeg.size, fp);
+	return (0 == fclose(fp)) && (written == jpeg.size);
+}
+
+/* PSNR of the snapshot against the golden JPEG, negative on error */
+static double golden_psnr(const std::string &path, const SnapshotBuffer &jpeg)
+{
+	cv::Mat golden = cv::imread(path, cv::IMREAD_COLOR);
+	if( golden.empty() ) {
+		printf("  golden %s: not found\n", path.c_str());
+		return -1;
+	}
+
+	cv::Mat encoded(1, (int)jpeg.size, CV_8UC1, jpeg.data);
+	cv::Mat decoded = cv::imdecode(encoded, cv::IMREAD_COLOR);
+	if( decoded.empty() || (decoded.size() != golden.size()) ) {
+		printf("  golden %s: size mismatch\n", path.c_str());
+		return -1;
+	}
+
+	return cv::PSNR(decoded, golden);
+}
+
+int main(int argc, char *argv[])
+{
+	std::string frame_file;
+	std::string write_dir;
+	std::string golden_dir;
+	std::vector<BenchOutput> outputs;
+	int width = 0;
+	int height = 0;
+	int pitch = 0;
+	int iterations = DEFAULT_ITERATIONS;
+	double min_psnr = DEFAULT_MIN_PSNR;
+	bool multi = false;
+	int opt;
+
+	while( -1 != (opt = getopt(argc, argv, "i:s:p:o:n:mw:g:t:h")) ) {
+		switch( opt ) {
+		case 'i':
+			frame_file = optarg;
+			break;
+		case 's':
+			if( 2 != sscanf(optarg, "%dx%d", &width, &height) ) {
+				help();
+				return RDKC_FAILURE;
+			}
+			break;
+		case 'p':
+			pitch = atoi(optarg);
+			break;
+		case 'o': {
+			BenchOutput out = { 0, 0, 60 };
+			if( 2 > sscanf(optarg, "%dx%d@%d", &out.width, &out.height, &out.quality) ) {
+				help();
+				return RDKC_FAILURE;
+			}
+			outputs.push_back(out);
+			break;
+		}
+		case 'n':
+			iterations = std::max(1, atoi(optarg));
+			break;
+		case 'm':
+			multi = true;
+			break;
+		case 'w':
+			write_dir = optarg;
+			break;
+		case 'g':
+			golden_dir = optarg;
+			break;
+		case 't':
+			min_psnr = atof(optarg);
+			break;
+		default:
+			help();
+			return RDKC_FAILURE;
+		}
+	}
+
+	if( frame_file.empty() || (width <= 0) || (height <= 0) ) {
+		help();
+		return RDKC_FAILURE;
+	}
+
+	if( outputs.empty() ) {
+		BenchOutput defaults[] = { { 320, 180, 60 }, { 640, 360, 60 }, { 1280, 720, 80 } };
+		outputs.assign(defaults, defaults + sizeof(defaults) / sizeof(defaults[0]));
+	}
+
+	ImageTools imgt;
+	if( RDKC_SUCCESS != imgt.Init(frame_file, width, height, pitch) ) {
+		printf("Unable to load frames from %s\n", frame_file.c_str());
+		return RDKC_FAILURE;
+	}
+
+	long base_rss = peak_rss_kb();
+	int failures = 0;
+
+	printf("%-12s %4s %8s %8s %8s %8s %8s %8s %9s %8s\n", "output", "q", "min ms", "avg ms", "p50 ms", "p95 ms", "max ms", "fps", "avg KB", "psnr");
+
+	for( size_t i = 0; i < outputs.size(); i++ ) {
+		const BenchOutput &out = outputs[i];
+		std::vector<double> latency;
+		double total_ms = 0;
+		double total_bytes = 0;
+		double psnr = 0;
+
+		/* the first snapshot of the first frame is the one checked against the golden image */
+		imgt.Rewind();
+		for( int n = 0; n < iterations; n++ ) {
+			SnapshotBuffer jpeg = { NULL, 0, 0 };
+			double start = now_ms();
+			int ret = imgt.GenerateSnapshot(&jpeg, out.quality, out.width, out.height);
+			double elapsed = now_ms() - start;
+
+			if( RDKC_SUCCESS != ret ) {
+				printf("%dx%d@%d: snapshot failed\n", out.width, out.height, out.quality);
+				failures++;
+				break;
+			}
+			latency.push_back(elapsed);
+			total_ms += elapsed;
+			total_bytes += jpeg.size;
+
+			if( 0 != n ) {
+				continue;
+			}
+			if( !write_dir.empty() && !write_output(write_dir + "/" + output_name(out), jpeg) ) {
+				printf("%dx%d@%d: unable to write %s\n", out.width, out.height, out.quality, output_name(out).c_str());
+				failures++;
+			}
+			if( !golden_dir.empty() ) {
+				psnr = golden_psnr(golden_dir + "/" + output_name(out), jpeg);
+				if( psnr < min_psnr ) {
+					failures++;
+				}
+			}
+		}
+
+		if( latency.empty() ) {
+			continue;
+		}
+
+		std::sort(latency.begin(), latency.end());
+		char size[32];
+		snprintf(size, sizeof(size), "%dx%d", out.width, out.height);
+		printf("%-12s %4d %8.2f %8.2f %8.2f %8.2f %8.2f %8.1f %9.1f ", size, out.quality,
+		       latency.front(), total_ms / latency.size(), latency[latency.size() / 2],
+		       latency[(latency.size() * 95) / 100], latency.back(),
+		       (1000.0 * latency.size()) / total_ms, total_bytes / latency.size() / 1024.0);
+		if( golden_dir.empty() ) {
+			printf("%8s\n", "-");
+		}
+		else {
+			printf("%8.2f%s\n", psnr, (psnr < min_psnr) ? " FAIL" : "");
+		}
+	}
+
+	if( multi ) {
+		std::vector<SnapshotTarget> targets(outputs.size());
+		std::vector<SnapshotBuffer> buffers(outputs.size());
+		std::vector<double> latency;
+		double total_ms = 0;
+
+		for( size_t i = 0; i < outputs.size(); i++ ) {
+			targets[i].width = outputs[i].width;
+			targets[i].height = outputs[i].height;
+			targets[i].quality = outputs[i].quality;
+			targets[i].output = &buffers[i];
+		}
+
+		for( int n = 0; n < iterations; n++ ) {
+			for( size_t i = 0; i < buffers.size(); i++ ) {
+				buffers[i].data = NULL;
+				buffers[i].capacity = 0;
+				buffers[i].size = 0;
+			}
+			double start = now_ms();
+			int ret = imgt.GenerateSnapshots(targets);
+			double elapsed = now_ms() - start;
+
+			if( RDKC_SUCCESS != ret ) {
+				printf("multi-size snapshot failed\n");
+				failures++;
+				break;
+			}
+			latency.push_back(elapsed);
+			total_ms += elapsed;
+		}
+
+		if( !latency.empty() ) {
+			std::sort(latency.begin(), latency.end());
+			printf("%-12s %4s %8.2f %8.2f %8.2f %8.2f %8.2f %8.1f\n", "multi", "-",
+			       latency.front(), total_ms / latency.size(), latency[latency.size() / 2],
+			       latency[(latency.size() * 95) / 100], latency.back(),
+			       (1000.0 * latency.size()) / total_ms);
+		}
+	}
+
+	printf("peak rss %ld KB, %ld KB above the loaded frames\n", peak_rss_kb(), peak_rss_kb() - base_rss);
+
+	if( 0 != failures ) {
+		printf("%d check(s) failed\n", failures);
+		return RDKC_FAILURE;
+	}
+	return RDKC_SUCCESS;
+}
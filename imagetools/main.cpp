@@ -18,6 +18,7 @@
 
 #include <iostream>
 #include "RdkCVAImageTools.h"
+#include "RdkCVASnapshotService.h"
 #ifdef BREAKPAD
 #include "breakpadwrap.h"
 #endif
@@ -30,18 +31,81 @@ extern "C" {
 #endif
 #define DEFAULT_BUF_ID          0
 #define MAX_RETRY	3
+#define STDOUT_SNAPSHOT	"-"
+#define SERVICE_OPTION	"-d"
 
 void help()
 {
-	printf("Usage: ./rdkc_snapshooter <snapshot_image_name_with_full_path> <compression_scale> <new_width> <new_height> <optional: ROIcoords>\n");
+	printf("Usage: ./rdkc_snapshooter <snapshot_image_name_with_full_path> <compression_scale> <new_width> <new_height> <optional: ROIcoords> <optional: pts>\n");
+	printf("       Use %s as snapshot image name to write the JPEG to stdout\n", STDOUT_SNAPSHOT);
+	printf("       pts asks the snapshot service for its pre-roll frame closest to pts, e.g. the frame of a motion event\n");
+	printf("       ./rdkc_snapshooter %s <optional: socket_path> <optional: preroll_frames>\n", SERVICE_OPTION);
+	printf("       Runs as snapshot service on socket_path, default %s. Snapshots are requested from it when it is running\n", SNAPSHOT_SERVICE_SOCKET);
+	printf("       preroll_frames is the number of recent frames kept for pts requests, up to %d, default 0\n", PREROLL_MAX_SLOTS);
 	return;
 }
 
+void stop_service(int sig)
+{
+	SnapshotService::Stop();
+}
+
+/* Keep the frame source open and serve snapshot requests until SIGTERM */
+int run_service(int buf_id, std::string socket_path, int preroll_frames)
+{
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGTERM, stop_service);
+	signal(SIGINT, stop_service);
+
+	SnapshotService service(buf_id);
+	if( (RDKC_SUCCESS != service.EnablePreroll(preroll_frames)) || (RDKC_SUCCESS != service.Start(socket_path)) ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Unable to start the snapshot service\n",__FUNCTION__, __LINE__ );
+		return RDKC_FAILURE;
+	}
+	return service.Run();
+}
+
+/* Hand the request to a running snapshot service. served tells whether a service took the
+   request, a failure with served set must not be retried locally */
+int request_service(std::string snapshot_filename, int compression_scale, int new_width, int new_height, std::string roicoords,
+		    unsigned long long pts, bool &served)
+{
+	std::vector<unsigned char> jpeg;
+
+	served = false;
+	if( RDKC_SUCCESS != SnapshotService::Request(SNAPSHOT_SERVICE_SOCKET, compression_scale, new_width, new_height, roicoords, pts, jpeg) ) {
+		return RDKC_FAILURE;
+	}
+	served = true;
+
+	/* the file is written here, with the permissions of the caller, never by the service */
+	if( STDOUT_SNAPSHOT == snapshot_filename ) {
+		if( (jpeg.size() != fwrite(jpeg.data(), 1, jpeg.size(), stdout)) || (0 != fflush(stdout)) ) {
+			RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Unable to write snapshot to stdout\n", __FUNCTION__, __LINE__ );
+			return RDKC_FAILURE;
+		}
+		return RDKC_SUCCESS;
+	}
+
+	FILE *fp = fopen(snapshot_filename.c_str(), "wb");
+	if( NULL == fp ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Unable to open %s: %s\n", __FUNCTION__, __LINE__, snapshot_filename.c_str(), strerror(errno) );
+		return RDKC_FAILURE;
+	}
+	size_t written = fwrite(jpeg.data(), 1, jpeg.size(), fp);
+	if( (0 != fclose(fp)) || (written != jpeg.size()) ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Unable to write %s\n", __FUNCTION__, __LINE__, snapshot_filename.c_str() );
+		return RDKC_FAILURE;
+	}
+	return RDKC_SUCCESS;
+}
+
 int main(int argc, char* argv[])
 {
 	int retry_count = 0;
+	bool service_mode = (argc >= 2) && (SERVICE_OPTION == std::string(argv[1]));
 
-	if( argc < 5 ) {
+	if( !service_mode && (argc < 5) ) {
 		help();
 		return RDKC_FAILURE;
 	}
@@ -73,9 +137,12 @@ int main(int argc, char* argv[])
                 buf_id = atoi(configParam);
         }
 
-	ImageTools *imgt = new ImageTools();
-	if( NULL == imgt ) {
-		return RDKC_FAILURE;
+	if( service_mode ) {
+		int ret = run_service(buf_id, (argc >= 3) ? argv[2] : SNAPSHOT_SERVICE_SOCKET, (argc >= 4) ? atoi(argv[3]) : 0);
+		if( RDKC_SUCCESS != config_release() ) {
+			RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): config_release failed\n",__FILE__, __LINE__);
+		}
+		return ret;
 	}
 
 	std::string roicoords = "";
@@ -90,6 +157,34 @@ int main(int argc, char* argv[])
 		roicoords = argv[5];
 	}
 
+	// Optional parameter to pick an earlier frame from the pre-roll ring of the snapshot service
+	unsigned long long pts = 0;
+	if( argc >= 7 ) {
+		pts = strtoull(argv[6], NULL, 10);
+	}
+
+	bool served = false;
+	int service_ret = request_service(snapshot_filename, compression_scale, new_width, new_height, roicoords, pts, served);
+	if( served ) {
+		if( RDKC_SUCCESS == service_ret ) {
+			RDK_LOG( RDK_LOG_INFO,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): RdkC Snapshooter success through the snapshot service\n", __FUNCTION__, __LINE__ );
+		}
+		if( RDKC_SUCCESS != config_release() ) {
+			RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): config_release failed\n",__FILE__, __LINE__);
+		}
+		return service_ret;
+	}
+
+	if( 0 != pts ) {
+		RDK_LOG( RDK_LOG_INFO,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): No snapshot service, taking the next frame instead of pts %llu\n",__FUNCTION__, __LINE__, pts );
+	}
+
+	ImageTools *imgt = new ImageTools();
+	if( NULL == imgt ) {
+		return RDKC_FAILURE;
+	}
+
+	int result = RDKC_FAILURE;
 	do {
 		if( RDKC_SUCCESS != imgt->Init(buf_id) ) {
 			RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): RdkC Snapshooter Initializationt failed, retry count %d\n",__FUNCTION__, __LINE__, retry_count+1 );
@@ -97,13 +192,27 @@ int main(int argc, char* argv[])
 			usleep(10000);
 			continue;
 		}
-		if( RDKC_SUCCESS != imgt->GenerateSnapshot(snapshot_filename, compression_scale, new_width, new_height, roicoords) ) {
+		int ret = RDKC_FAILURE;
+		if( STDOUT_SNAPSHOT == snapshot_filename ) {
+			SnapshotBuffer jpeg = { NULL, 0, 0 };
+			ret = imgt->GenerateSnapshot(&jpeg, compression_scale, new_width, new_height, roicoords);
+			if( (RDKC_SUCCESS == ret) && ((jpeg.size != fwrite(jpeg.data, 1, jpeg.size, stdout)) || (0 != fflush(stdout))) ) {
+				/* part of the JPEG may be out already, a retry would corrupt the stream */
+				RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): Unable to write snapshot to stdout\n", __FUNCTION__, __LINE__ );
+				break;
+			}
+		}
+		else {
+			ret = imgt->GenerateSnapshot(snapshot_filename, compression_scale, new_width, new_height, roicoords);
+		}
+		if( RDKC_SUCCESS != ret ) {
 			RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): RdkC Snapshooter GenerateSnapshot failed, retry count %d\n", __FUNCTION__, __LINE__, retry_count+1 );
 			imgt->Close();
 			usleep(10000);
 		}
 		else {
 			RDK_LOG( RDK_LOG_INFO,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): RdkC Snapshooter success\n", __FUNCTION__, __LINE__ );
+			result = RDKC_SUCCESS;
 			break;
 		}
 	} while (++retry_count <= MAX_RETRY);
@@ -115,5 +224,5 @@ int main(int argc, char* argv[])
 	if( RDKC_SUCCESS != config_release() ) {
                 RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.THUMBNAILUPLOAD","%s(%d): config_release failed\n",__FILE__, __LINE__);
         }
-	return RDKC_SUCCESS;
+	return result;
 }
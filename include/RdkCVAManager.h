@@ -171,6 +171,11 @@ typedef struct _RdkCImage
 @return VA_SUCCESS on success, VA_FAILURE on failure */
 RDKCVA_API int RdkCVAProcessFrame( unsigned char *data, int size, int height, int width );
 
+/** Set time of the next frame
+@param	[in] wallSec: wall clock seconds of the frame, 0 to use the current time
+@return VA_SUCCESS on success, VA_FAILURE on failure */
+RDKCVA_API int RdkCVASetFrameTime(long long wallSec);
+
 RDKCVA_API int RdkCGetCurrentBlobArea(double blob_threshold, double *currentBlobArea);
 
 RDKCVA_API float RdkCVAGetMotionScore(int mode);
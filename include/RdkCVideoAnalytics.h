@@ -21,6 +21,7 @@
 
 /*************************       INCLUDES         *************************/
 #include <unistd.h>
+#include <time.h>
 /* common include */
 #include "RdkCVACommon.h"
 /* xcv includes */
@@ -80,6 +81,8 @@ public:
 	int RdkCVAGetEvent(iEvent *refEvent);
 	/* Process frame */
 	int RdkCVAProcessFrame( unsigned char *data, int size, int height, int width );
+	/* Set time of the next frame */
+	void RdkCVASetFrameTime(long long wallSec);
 	/* Set Property */
 	int RdkCVASetProperty(int PropID, float& val);
 	/* Get property */
@@ -136,6 +139,9 @@ private:
 	iObject *md_object;		/* Object structure for motion detected object details */
         iObject *md_obj_ptr;		/* copy of md_object pointer */
 	iEvent *md_evt;		/* Event structure for motion detected object details */
+	long long frameWallTime;	/* wall clock seconds of the frame being processed */
+	long long eventDateSec;		/* seconds eventDate was computed for */
+	struct tm eventDate;		/* broken down frame time used for events */
 	int scaleFactor;		/* Scale factor. 1 for YUV, 4 for ME1 frame typr */
 	float motionLevelPercentage;	/* Percentage of motion in one frame */
 	float motionDetection_Enable;	/* Motion Detection is enabled by default */
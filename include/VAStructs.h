@@ -45,6 +45,14 @@ typedef struct _iDateTime
     unsigned int m_i_second;     /**< seconds after the minute - [0,59]*/
 } iDateTime;
 
+/** Frame time, captured once per frame and shared by all results of that frame */
+typedef struct _iFrameTime
+{
+    unsigned long long m_u_pts;      /**< presentation timestamp from the frame source */
+    unsigned long long m_u_monoMs;   /**< CLOCK_MONOTONIC capture time in ms */
+    long long          m_l_wallSec;  /**< wall clock seconds derived from m_u_monoMs */
+} iFrameTime;
+
 
 /** Image */
 typedef struct _iImage
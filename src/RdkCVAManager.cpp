@@ -85,6 +85,21 @@ int RdkCVAProcessFrame( unsigned char *data, int size, int height, int width )
 	return VA_SUCCESS;
 }
 
+/** @description: Set time of the next frame, used to timestamp detected events.
+ *  @param[in] wallSec : wall clock seconds of the frame, 0 to use the current time
+ *  @return: VA_SUCCESS on success, VA_FAILURE on failure
+ */
+int RdkCVASetFrameTime(long long wallSec)
+{
+	if( NULL == VA ) {
+                RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.VIDEOANALYTICS","%s(%d): VideoAnalytics is not initialised.\n", __FUNCTION__, __LINE__);
+                return VA_FAILURE;
+        }
+
+	VA -> RdkCVASetFrameTime(wallSec);
+	return VA_SUCCESS;
+}
+
 /** @description: Get total blob area for current frame.
  *  @param[in]  blob_threshold : filter to select the blob areas for calculating 
 				 total blob area for current frame.
@@ -65,6 +65,8 @@ VideoAnalytics::VideoAnalytics():firstFrame(true), \
 				md_object(NULL), \
 				md_obj_ptr(NULL), \
 				md_evt(NULL), \
+				frameWallTime(0), \
+				eventDateSec(-1), \
 				scaleFactor(DEFAULT_SCALE_FACTOR), \
 				motionLevelPercentage(DEFAULT_MOTION_LEVEL_PERCENTAGE), \
 				motionDetection_Enable(RDKC_ENABLE), \
@@ -1074,9 +1076,12 @@ int VideoAnalytics::RdkCVAFillDetectedMotionEventDetail()
 {
 	numberOfEventsDetected++;
 
-	time_t     now = time(0);
-	struct tm  tstruct;
-	tstruct = *localtime(&now);
+	time_t now = (time_t)((0 != frameWallTime) ? frameWallTime : time(0));
+	if( now != eventDateSec ) {
+		localtime_r(&now, &eventDate);
+		eventDateSec = now;
+	}
+	const struct tm &tstruct = eventDate;
 
 	if( NULL != md_evt ) {
 		md_evt -> m_e_type = eMotionDetected;
@@ -1094,6 +1099,16 @@ int VideoAnalytics::RdkCVAFillDetectedMotionEventDetail()
 	return VA_SUCCESS;
 }
 
+/** @description: Set time of the next frame. Detected events carry this time
+ *                instead of sampling the clock.
+ *  @param[in] wallSec : wall clock seconds of the frame, 0 to use the current time
+ *  @return: void
+ */
+void VideoAnalytics::RdkCVASetFrameTime(long long wallSec)
+{
+	frameWallTime = wallSec;
+}
+
 /** @description: Reset all video-analytics components.
  *  @param: void
  *  @return: VA_SUCCESS on success, VA_FAILURE on failure
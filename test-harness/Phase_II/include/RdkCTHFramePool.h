@@ -0,0 +1,68 @@
+/*
+* Copyright 2020 Comcast Cable Communications Management, LLC
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* SPDX-License-Identifier: Apache-2.0
+*/
+
+#ifndef RDKCTHFRAMEPOOL_H
+#define RDKCTHFRAMEPOOL_H
+
+#include <vector>
+#include <mutex>
+#include <opencv2/core/core.hpp>
+
+/* Buffers for the camera frames RdkCTHUpload copies or converts for upload. The
+ * buffer travels with its payload through THInfoQue and the upload thread hands
+ * it back once the frame is sent, so create() and cvtColor() write into memory
+ * that is already mapped. The pool only caps how many idle buffers are kept,
+ * an empty pool makes the conversion allocate. */
+class THFramePool
+{
+public:
+	explicit THFramePool(size_t capacity) : maxFree(capacity) {}
+
+	/* an idle buffer of the last frame size, an empty Mat when every buffer is out */
+	cv::Mat Acquire()
+	{
+		std::unique_lock<std::mutex> lock(poolMutex);
+		if( freeFrames.empty() ) {
+			return cv::Mat();
+		}
+		cv::Mat frame = freeFrames.back();
+		freeFrames.pop_back();
+		return frame;
+	}
+
+	/* called by the upload thread after the send, frame is left empty. A buffer
+	   another Mat still shares or one OpenCV did not allocate is freed, so is one
+	   past the capacity */
+	void Release(cv::Mat &frame)
+	{
+		if( (NULL != frame.u) && (1 == frame.u->refcount) ) {
+			std::unique_lock<std::mutex> lock(poolMutex);
+			if( freeFrames.size() < maxFree ) {
+				freeFrames.push_back(frame);
+			}
+		}
+		frame.release();
+	}
+
+private:
+	std::vector<cv::Mat> freeFrames;
+	size_t maxFree;
+	std::mutex poolMutex;
+};
+
+#endif
@@ -0,0 +1,138 @@
+/*
+* Copyright 2020 Comcast Cable Communications Management, LLC
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* SPDX-License-Identifier: Apache-2.0
+*/
+
+#ifndef RDKCTHUPLOADQUEUE_H
+#define RDKCTHUPLOADQUEUE_H
+
+#include <queue>
+#include <mutex>
+#include <condition_variable>
+#include <utility>
+
+/* Payloads waiting for the upload thread. Frames go in with Emplace, which waits
+ * for room so the analytics thread is paced by the uplink. Delivery results and
+ * smart thumbnail statuses come from callbacks that must not stall, they use
+ * TryPush and the status is lost when the queue is full. The upload thread waits
+ * on the frame queue with Pop and empties the status queues with TryPop after
+ * every frame. Close ends the session, Pop still hands out the queued frames. */
+template <typename T>
+class THUploadQueue
+{
+public:
+	explicit THUploadQueue(size_t capacity) : maxSize(capacity ? capacity : 1), closed(false) {}
+
+	/* queue a payload, waits while the upload thread is behind, false after Close */
+	bool Push(const T &item)
+	{
+		return Emplace(item);
+	}
+
+	bool Push(T &&item)
+	{
+		return Emplace(std::move(item));
+	}
+
+	/* Push without the copy, the frame payload is built in place */
+	template <typename... Args>
+	bool Emplace(Args&&... args)
+	{
+		std::unique_lock<std::mutex> lock(queueMutex);
+		notFull.wait(lock, [this]{ return closed || (items.size() < maxSize); });
+		if( closed ) {
+			return false;
+		}
+		items.emplace(std::forward<Args>(args)...);
+		lock.unlock();
+		notEmpty.notify_one();
+		return true;
+	}
+
+	/* queue a status from a callback, false when full or closed and the status is dropped */
+	bool TryPush(const T &item)
+	{
+		return TryEmplace(item);
+	}
+
+	bool TryPush(T &&item)
+	{
+		return TryEmplace(std::move(item));
+	}
+
+	/* TryPush with the item built in place */
+	template <typename... Args>
+	bool TryEmplace(Args&&... args)
+	{
+		std::unique_lock<std::mutex> lock(queueMutex);
+		if( closed || (items.size() >= maxSize) ) {
+			return false;
+		}
+		items.emplace(std::forward<Args>(args)...);
+		lock.unlock();
+		notEmpty.notify_one();
+		return true;
+	}
+
+	/* next payload for the upload thread, waits for one, false once closed and drained */
+	bool Pop(T &item)
+	{
+		std::unique_lock<std::mutex> lock(queueMutex);
+		notEmpty.wait(lock, [this]{ return closed || !items.empty(); });
+		if( items.empty() ) {
+			return false;
+		}
+		item = std::move(items.front());
+		items.pop();
+		lock.unlock();
+		notFull.notify_one();
+		return true;
+	}
+
+	/* next queued status if there is one, the upload thread polls with it between frames */
+	bool TryPop(T &item)
+	{
+		std::unique_lock<std::mutex> lock(queueMutex);
+		if( items.empty() ) {
+			return false;
+		}
+		item = std::move(items.front());
+		items.pop();
+		lock.unlock();
+		notFull.notify_one();
+		return true;
+	}
+
+	/* end of session, fails further pushes and wakes the upload thread and any waiting producer */
+	void Close()
+	{
+		std::unique_lock<std::mutex> lock(queueMutex);
+		closed = true;
+		lock.unlock();
+		notEmpty.notify_all();
+		notFull.notify_all();
+	}
+
+private:
+	std::queue<T> items;
+	size_t maxSize;
+	bool closed;
+	std::mutex queueMutex;
+	std::condition_variable notEmpty;
+	std::condition_variable notFull;
+};
+
+#endif
@@ -69,6 +69,8 @@ using namespace cv;
 #ifdef TEST_HARNESS_SOCKET
 
 #include "socket_client.h"
+#include "RdkCTHUploadQueue.h"
+#include "RdkCTHFramePool.h"
 #ifdef __cplusplus
 extern "C" {
 #endif //__cplusplus
@@ -80,11 +82,18 @@ extern "C" {
 #define RESET_ALG_ON_FIRST_FRAME "Reset_Alg_on_First_Frame"		/* reset alg on first frame */
 #define TEST_HARNESS_WITH_ROI "Test_Harness_with_ROI"                   /* Testharness with ROI */
 #define TEST_HARNESS_WITH_DOI "Test_Harness_with_DOI"                   /* Testharness with DOI */
+#define TEST_HARNESS_FRAME_FORMAT "Test_Harness_Frame_Format"           /* frames on the socket: bgr (default), nv12 or gray */
+#define TEST_HARNESS_FRAME_CODEC "Test_Harness_Frame_Codec"             /* frame compression: raw (default), jpeg or lz4 */
+#define TEST_HARNESS_FRAMED_TRANSPORT "Test_Harness_Framed_Transport"   /* true for one header+payload message per frame */
+#define TEST_HARNESS_PIPELINED_FRAMES "Test_Harness_Pipelined_Frames"   /* true to let the server send frames ahead of their results */
 #define NW_INTERFACE "nw_interface"
 #define LOGGER_PATH "/etc/debug.ini"					/* rdklogger path */
 #define MAXSIZE 100
 #define MACSIZE 17
 #define MINSIZE 10
+#define TH_UPLOAD_QUEUE_SIZE 8						/* payloads waiting for the upload thread before the producer blocks */
+#define TH_STATUS_QUEUE_SIZE 32						/* delivery results and upload statuses waiting for the next payload, dropped when full */
+#define TH_FRAME_POOL_SIZE (TH_UPLOAD_QUEUE_SIZE + 2)			/* camera frame buffers kept for reuse */
 
 typedef struct frameData_s
 {
@@ -135,12 +144,14 @@ public:
 
 private:
 	Mat fileFrameBGR,fileFrameYUV,planeUV;				/* Mats to store color images */
+	Mat neutralUV;							/* constant chroma plane for gray frames */
+	FrameFormat frameFormat;					/* frames exchanged with the server */
+	FrameCodec frameCodec;						/* compression of the frames from the server */
 	vector<Mat> yuvChannels, yuvPlanes;				/* vectors to separate yuv channels from RGB */
 	cv::Mat RGBMat;							/* Mat contains RGB frame */
 	bool yuvDataMemoryAllocationDone;				/* check for yuv data memory allocation */
 	frameData_t frame;						/* structure contains y and uv data */
 	ProcessedData_s *meta_data;					/* structure contains meta-data for capyured frame */
-	TestHarnessInfo_s TH_info;					/* structure contains harnessed info */
 	TestHarnessInfo_s TH_info_recv_buf;				/* structure contains harnessed info */
 	SocketClient* client_ptr;					/* pointer to socket client */
 	char VAEngineID[MINSIZE+1];					/* to store Video-Analytics engine (i.e "IV" or "RDKCVA")*/
@@ -155,12 +166,13 @@ private:
 	bool fileEnd;
 	int th_frame_width;
 	int th_frame_height;
-	std::queue <TestHarnessInfo_s> THInfoQue;
-	std::queue <th_deliveryResult> DeliveryInfoQue;
-	std::queue <th_smtnUploadStatus> StnUploadStatusQue;
+	THUploadQueue <TestHarnessInfo_s> THInfoQue;
+	THUploadQueue <th_deliveryResult> DeliveryInfoQue;
+	THUploadQueue <th_smtnUploadStatus> StnUploadStatusQue;
+	THFramePool framePool;						/* camera frames recycled once uploaded */
 	pthread_t THUploadThread;
-	std::mutex QueueMutex;
-	std::mutex DQueMutex;
+	bool uploadThreadStarted;
+	int RdkCTHSendPayload();					/* send one payload with the pending delivery result and upload status */
 	bool isROICoordsChanged;
 	std::string roiCoords;
 	bool isDOIChanged;
@@ -172,6 +184,7 @@ private:
         int RdkCTHSetObject(th_iObject *object);			/* Set objects and event structure */
         int RdkCTHSetEvent(th_iEvent *event);				/* Set objects and event structure */
 	void RdkCTHRescaleBlob(Object_s *object);
+	int RdkCTHMapFrame(th_iImage *plane0, th_iImage *plane1);	/* map a NV12 or gray frame into the planes */
 };
 #ifdef __cplusplus
 }
@@ -19,6 +19,7 @@
 #ifndef SOCKET_CLIENT_HPP
 #define SOCKET_CLIENT_HPP
 
+#include <vector>
 #include <opencv2/core.hpp>
 #include "socket_common.h"
 #include "RdkCTHManager.h"
@@ -33,6 +34,23 @@ class SocketClient {
     cv::Size2i image_dims_;
     /// the mat type read from the last header
     int mat_type_;
+    /// the source frame size read from the last NV12 or gray header
+    cv::Size2i source_dims_;
+    /// frame format agreed with the server
+    FrameFormat frame_format_;
+    /// frame compression agreed with the server
+    FrameCodec frame_codec_;
+    /// compressed frame, reused between frames
+    std::vector<uchar> compressed_;
+    /// fixed header and payload in one message, TH_SERVER_VERSION_FRAMED
+    bool framed_;
+    /// payload size and fps read from the last framed header
+    int32_t payload_size_;
+    int32_t header_fps_;
+    /// sequence of the last framed image, echoed with its results
+    int32_t sequence_;
+    /// version announced to the server
+    int32_t server_version_;
 
     /** hostname */
     const char* hostname_;
@@ -41,6 +59,11 @@ class SocketClient {
     /** socket desc */
     int socket_fdesc_;
 
+    /** receive a compressed frame and decode it into image
+     *
+     */
+    bool ReceiveCompressedImage(cv::Mat& image, int32_t encoded_size);
+
  public:
     /** constructor
      *
@@ -102,7 +125,29 @@ class SocketClient {
     /** sends server version
      *
      */
-    bool SendServerVersion();
+    bool SendServerVersion(int32_t version = TH_SERVER_VERSION);
+
+    /** sends the frame format and the analysis resolution, needs TH_SERVER_VERSION_YUV
+     *
+     */
+    bool SendFrameFormat(FrameFormat format, int width, int height);
+
+    /** sends the wanted frame compression, needs TH_SERVER_VERSION_CODEC
+     *
+     * @param accepted receives the compression the server will use, raw if it cannot serve the request
+     * @return false if the exchange with the server failed
+     */
+    bool NegotiateFrameCodec(FrameCodec codec, FrameCodec *accepted);
+
+    /** source frame size of the last NV12 or gray image
+     *
+     */
+    cv::Size2i GetSourceDims() const { return source_dims_; }
+
+    /** sequence of the last framed image
+     *
+     */
+    int32_t GetSequence() const { return sequence_; }
 
     /** sends MAC id
      *
@@ -116,8 +161,9 @@ class SocketClient {
 
     /** sends meta data
      *
+     * @param sequence frame the data was computed on, sent from TH_SERVER_VERSION_PIPELINED
      */
-    bool SendTestHarnessMetaData(ProcessedData_s *data);
+    bool SendTestHarnessMetaData(ProcessedData_s *data, int32_t sequence = 0);
 
     /** sends ROI send state
      *
@@ -19,9 +19,17 @@
 #ifndef _SOCKETS_SOCKET_COMMON_H
 #define _SOCKETS_SOCKET_COMMON_H
 
+#include <utility>
+
 #define OD_MAX_NUM 32
 #define EV_MAX_NUM 32
 
+#define TH_SERVER_VERSION 4         /* DOI support */
+#define TH_SERVER_VERSION_YUV 5     /* frame format negotiation */
+#define TH_SERVER_VERSION_CODEC 6   /* frame compression negotiation */
+#define TH_SERVER_VERSION_FRAMED 7  /* fixed header and payload in one message */
+#define TH_SERVER_VERSION_PIPELINED 8   /* several frames in flight, results carry the frame sequence */
+
 enum HeaderType
 {
     H_END = 0,
@@ -48,6 +56,26 @@ enum ClientType
     TH_VIDEO = 2
 };
 
+/** Layout of the frames exchanged with the server, negotiated from TH_SERVER_VERSION_YUV
+  *
+  */
+enum FrameFormat
+{
+    TH_FRAME_BGR = 0,   /* decoded frame at source resolution */
+    TH_FRAME_NV12 = 1,  /* Y plane followed by interleaved UV, at analysis resolution */
+    TH_FRAME_GRAY = 2   /* Y plane only, at analysis resolution */
+};
+
+/** Compression of the frames received from the server, negotiated from TH_SERVER_VERSION_CODEC
+  *
+  */
+enum FrameCodec
+{
+    TH_CODEC_RAW = 0,   /* Mat bytes as is */
+    TH_CODEC_JPEG = 1,  /* per-frame JPEG, BGR and gray frames only */
+    TH_CODEC_LZ4 = 2    /* lossless, needs USE_LZ4=yes on both sides */
+};
+
 /** To get the Algorithm Type
   *
   */
@@ -70,6 +98,22 @@ struct MessageHeader
     int mat_type;
 };
 
+/** Fixed header of an image message from TH_SERVER_VERSION_FRAMED, sent in one call with its payload
+ *
+ */
+struct FrameHeader
+{
+    int32_t header_type;
+    int32_t rows;
+    int32_t cols;
+    int32_t mat_type;
+    int32_t source_rows;    /* decoded frame size, differs for NV12 and gray frames */
+    int32_t source_cols;
+    int32_t fps;            /* meaningful on H_FSTART */
+    int32_t sequence;       /* echoed with the processed data from TH_SERVER_VERSION_PIPELINED */
+    int32_t payload_size;   /* bytes following the header */
+};
+
 /** objects detected after processing
   *
   */
@@ -107,6 +151,17 @@ struct TestHarnessInfo_s
 
     cv::Mat frame;
     ProcessedData_s pData;
+    int32_t sequence;   /* sequence of the analysed frame */
+
+    TestHarnessInfo_s() : pData(), sequence(0) {}
+    TestHarnessInfo_s(cv::Mat &&image, const ProcessedData_s &data, int32_t seq) :
+        frame(std::move(image)), pData(data), sequence(seq) {}
+
+    /* payloads are moved through the upload queue, never duplicated */
+    TestHarnessInfo_s(TestHarnessInfo_s &&) = default;
+    TestHarnessInfo_s& operator=(TestHarnessInfo_s &&) = default;
+    TestHarnessInfo_s(const TestHarnessInfo_s &) = delete;
+    TestHarnessInfo_s& operator=(const TestHarnessInfo_s &) = delete;
 };
 
 #endif //_SOCKETS_SOCKET_COMMON_H
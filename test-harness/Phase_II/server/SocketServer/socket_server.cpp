@@ -18,11 +18,73 @@
 
 #include "socket_server.hpp"
 #include <unistd.h> // close
+#include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+#include <netinet/tcp.h>
 #include <opencv2/imgcodecs.hpp>
 #include <iostream>
+#ifdef _HAS_LZ4_
+#include <lz4.h>
+#endif
+
+// ------------------------------------------------------------------------------------------------------------------
+// Send every buffer, sendmsg may return before a large payload is out
+static bool send_all(int fdesc, struct iovec *iov, int iovcnt)
+{
+    struct msghdr msg;
+
+    while (iovcnt > 0) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovcnt;
+
+        ssize_t bytes_sent = sendmsg(fdesc, &msg, MSG_NOSIGNAL);
+        if (bytes_sent == -1) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
 
+        while ((iovcnt > 0) && ((size_t)bytes_sent >= iov->iov_len)) {
+            bytes_sent -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char*)iov->iov_base + bytes_sent;
+            iov->iov_len -= bytes_sent;
+        }
+    }
+    return true;
+}
+// ------------------------------------------------------------------------------------------------------------------
+// Receive exactly len bytes, false on error or when the peer closed
+static bool recv_all(int fdesc, void *buf, size_t len)
+{
+    size_t done = 0;
+
+    while (done < len) {
+        ssize_t bytes_recv = recv(fdesc, (char*)buf + done, len - done, MSG_WAITALL);
+        if (bytes_recv == 0)
+            return false;
+        if (bytes_recv == -1) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        done += bytes_recv;
+    }
+    return true;
+}
+// ------------------------------------------------------------------------------------------------------------------
+// Send one buffer whole
+static bool send_buffer(int fdesc, const void *buf, size_t len)
+{
+    struct iovec iov = { (void*)buf, len };
+    return send_all(fdesc, &iov, 1);
+}
 // ------------------------------------------------------------------------------------------------------------------
 SocketServer::SocketServer(int port) :
         image_dims_(cv::Size2i(0, 0)),
@@ -31,6 +93,29 @@ SocketServer::SocketServer(int port) :
         port_(port),
         sock_fdesc_init_(0),
         sock_fdesc_conn_(0),
+        frameFormat(TH_FRAME_BGR),
+        frameCodec(TH_CODEC_RAW),
+        jpegQuality(90),
+        payloadSize(0),
+        fileChangeStatus(false),
+        fileState(2),
+        fnum(0)  {
+        client_len_ = server_addr_size_;
+}
+// ------------------------------------------------------------------------------------------------------------------
+SocketServer::SocketServer(int port, int conn_fdesc) :
+        image_dims_(cv::Size2i(0, 0)),
+        client_len_(0),
+        server_addr_size_(sizeof(server_addr_)),
+        port_(port),
+        sock_fdesc_init_(-1),
+        sock_fdesc_conn_(conn_fdesc),
+        frameFormat(TH_FRAME_BGR),
+        frameCodec(TH_CODEC_RAW),
+        jpegQuality(90),
+        payloadSize(0),
+        fileChangeStatus(false),
+        fileState(2),
         fnum(0)  {
         client_len_ = server_addr_size_;
 }
@@ -100,74 +185,72 @@ bool SocketServer::Connect() {
 }
 
 // ------------------------------------------------------------------------------------------------------------------
-bool SocketServer::MonitorRequest() {
+int SocketServer::AcceptRequest() {
 
-    while(true){
+    struct sockaddr_in6 client_addr;
+    socklen_t client_len = sizeof(client_addr);
 
-        pid_t pid = -1;
-
-        // Block process until connection with client has been established.
-        // 'client_fdesc' set as new file descriptor to be used for communication
-	std::cout << "Monitoring the SocketServer Waiting for Client to join" << std::endl;
-        sock_fdesc_conn_ = accept(sock_fdesc_init_, (struct sockaddr *) &client_addr_, &client_len_);
-
-        if (sock_fdesc_conn_ == -1) {
-            perror("ERROR! Client couldn't connect!");
-            return false;
-        }
-	std::cout << "Creating a child process & exiting from Monitor Thread Loop" << std::endl;
-
-        pid = fork();
+    return accept(sock_fdesc_init_, (struct sockaddr *) &client_addr, &client_len);
+}
+// ------------------------------------------------------------------------------------------------------------------
+void SocketServer::CloseConnection() {
 
-        if (pid == 0)
-            return true;
+    if (sock_fdesc_conn_ > 0)
+    {
+        shutdown(sock_fdesc_conn_, SHUT_RDWR);
+        close(sock_fdesc_conn_);
+        sock_fdesc_conn_ = -1;
     }
 }
 
 // ------------------------------------------------------------------------------------------------------------------
 HeaderType SocketServer::ReceiveHeader() {
 
-    ssize_t bytes_recv = 0;
-    size_t dims_size = 0;
-
     int cols = 0;
     int rows = 0;
     int header_type = H_WAITING;
+
+    if (IsFramed()) {
+        FrameHeader_t header;
+
+        if (!recv_all(sock_fdesc_conn_, &header.header_type, sizeof(header.header_type))) {
+            printf("ERROR!: recv failed: (%s:%d)header_type \n", __FUNCTION__, __LINE__);
+            return H_ERROR;
+        }
+        if (header.header_type != (int) H_IMAGE)
+            return (HeaderType) header.header_type;
+
+        // rest of the fixed header
+        if (!recv_all(sock_fdesc_conn_, (char *) &header + sizeof(header.header_type), sizeof(header) - sizeof(header.header_type))) {
+            printf("ERROR!: recv failed: (%s:%d)frame header \n", __FUNCTION__, __LINE__);
+            return H_ERROR;
+        }
+        image_dims_ = cv::Size2i(header.cols, header.rows);
+        mat_type_ = header.mat_type;
+        payloadSize = header.payload_size;
+        return H_IMAGE;
+    }
    
     usleep(10000);
-    if ( (bytes_recv = recv(sock_fdesc_conn_, (char *) &header_type, sizeof(header_type), 0)) == -1) {
+    if (!recv_all(sock_fdesc_conn_, &header_type, sizeof(header_type))) {
         printf("ERROR!: recv failed: (%s:%d)header_type \n", __FUNCTION__, __LINE__);
         return H_ERROR;
     }
     if (header_type != (int) H_IMAGE)
         return (HeaderType) header_type;
 
-    if ((bytes_recv = recv(sock_fdesc_conn_, (char *) &rows, sizeof(rows), 0)) == -1) {
+    if (!recv_all(sock_fdesc_conn_, &rows, sizeof(rows))) {
         printf("ERROR!: recv failed: (%s:%d)rows \n", __FUNCTION__, __LINE__);
-        printf("ERROR!: recv failed\n"
-                       "sock_fdesc: %d\n"
-                       "image_size: %zu\n"
-                       "bytes_recv: %zu\n", sock_fdesc_conn_, dims_size, bytes_recv);
         return H_ERROR;
     }
 
-
-    if ((bytes_recv = recv(sock_fdesc_conn_, (char *) &cols, sizeof(cols), 0)) == -1) {
+    if (!recv_all(sock_fdesc_conn_, &cols, sizeof(cols))) {
         printf("ERROR!: recv failed: (%s:%d)cols \n", __FUNCTION__, __LINE__);
-        printf("ERROR!: recv failed\n"
-                       "sock_fdesc: %d\n"
-                       "image_size: %zu\n"
-                       "bytes_recv: %zu\n", sock_fdesc_conn_, dims_size, bytes_recv);
         return H_ERROR;
     }
 
-
-    if ((bytes_recv = recv(sock_fdesc_conn_, (char *) &mat_type_, sizeof(mat_type_), 0)) == -1) {
+    if (!recv_all(sock_fdesc_conn_, &mat_type_, sizeof(mat_type_))) {
         printf("ERROR!: recv failed: (%s:%d)mat_type \n", __FUNCTION__, __LINE__);
-        printf("ERROR!: recv failed\n"
-                       "sock_fdesc: %d\n"
-                       "image_size: %zu\n"
-                       "bytes_recv: %zu\n", sock_fdesc_conn_, dims_size, bytes_recv);
         return H_ERROR;
     }
 
@@ -179,10 +262,8 @@ HeaderType SocketServer::ReceiveHeader() {
 // ------------------------------------------------------------------------------------------------------------------
 bool SocketServer::SendHeader(HeaderType type)
 {
-    int bytes_sent = 0;
-
     // Send number of rows to server
-    if ((bytes_sent = send(sock_fdesc_conn_, (char*)&type, sizeof(type), 0)) == -1) {
+    if (!send_buffer(sock_fdesc_conn_, &type, sizeof(type))) {
         printf("ERROR!: send failed: (%s:%d)type \n", __FUNCTION__, __LINE__);
         perror("Error sending data");
         return false;
@@ -192,23 +273,28 @@ bool SocketServer::SendHeader(HeaderType type)
 // ------------------------------------------------------------------------------------------------------------------
 ServerVersion SocketServer::ReceiveServerVersion()
 {
-    ssize_t bytes_recv = 0;
-
-    if((bytes_recv=recv(sock_fdesc_conn_, (char*) &serverVersion, sizeof(int32_t),0)) == -1) {
+    if(!recv_all(sock_fdesc_conn_, &serverVersion, sizeof(int32_t))) {
         printf("ERROR!: recv failed: (%s:%d)serverVersion \n", __FUNCTION__, __LINE__);
         printf("ERROR!: recv failed\n");
     }
 
+    // every framed message leaves in one call, Nagle would only hold the small ones back
+    if (IsFramed()) {
+        int opt = 1;
+        if (setsockopt(sock_fdesc_conn_, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt)) == -1) {
+            perror("setsockopt TCP_NODELAY");
+        }
+    }
+
     return serverVersion;
 //return 3;
 }
 //-------------------------------------------------------------------------------------------------------------------
 Client SocketServer::ReceiveClientType()
 {
-    ssize_t bytes_recv = 0;
     int  client_type = TH_UNKNOWN;
 
-    if((bytes_recv=recv(sock_fdesc_conn_, (char*) &client_type, sizeof(int),0)) == -1) {
+    if(!recv_all(sock_fdesc_conn_, &client_type, sizeof(int))) {
         printf("ERROR!: recv failed: (%s:%d)client_type\n", __FUNCTION__, __LINE__);
         printf("ERROR!: recv failed\n");
     }
@@ -218,7 +304,7 @@ Client SocketServer::ReceiveClientType()
 //--------------------------------------------------------------------------------------------------------------------
 bool SocketServer::ReceiveStnUploadStatus(smtnUploadStatus_t * stnStatus )
 {
-    if(recv(sock_fdesc_conn_, (char*) &(stnStatus->status), sizeof(stnStatus->status),0) == -1) {
+    if(!recv_all(sock_fdesc_conn_, &(stnStatus->status), sizeof(stnStatus->status))) {
         printf("ERROR!: recv failed: (%s:%d)\n", __FUNCTION__, __LINE__);
         printf("ERROR!: recv failed: fileNum\n");
         return false;
@@ -234,20 +320,20 @@ bool SocketServer::ReceiveDeliveryResult(DeliveryResult_t* result) {
         return false;
     }*/
 
-    if(recv(sock_fdesc_conn_, (char*) &(result->fileNum), sizeof(result->fileNum),0) == -1) {
+    if(!recv_all(sock_fdesc_conn_, &(result->fileNum), sizeof(result->fileNum))) {
         printf("ERROR!: recv failed: (%s:%d)\n", __FUNCTION__, __LINE__);
         printf("ERROR!: recv failed: fileNum\n");
         return false;
     }
 
-    if(recv(sock_fdesc_conn_, (char*) &(result->frameNum), sizeof(result->frameNum),0) == -1) {
+    if(!recv_all(sock_fdesc_conn_, &(result->frameNum), sizeof(result->frameNum))) {
         printf("ERROR!: recv failed: (%s:%d)\n", __FUNCTION__, __LINE__);
         printf("ERROR!: recv failed: frameNum\n");
         return false;
     }
 
     int count = 0;
-    if(recv(sock_fdesc_conn_, (char*) &count, sizeof(int),0) == -1) {
+    if(!recv_all(sock_fdesc_conn_, &count, sizeof(int))) {
         printf("ERROR!: recv failed: (%s:%d)\n", __FUNCTION__, __LINE__);
         printf("ERROR!: recv failed: count\n");
         return false;
@@ -257,7 +343,7 @@ bool SocketServer::ReceiveDeliveryResult(DeliveryResult_t* result) {
         std::vector<int> bbox;
         for(int j = 0; j < 4; j++) {
             int coord = 0;
-            if(recv(sock_fdesc_conn_, (char*) &coord, sizeof(coord),0) == -1) {
+            if(!recv_all(sock_fdesc_conn_, &coord, sizeof(coord))) {
                 printf("ERROR!: recv failed: (%s:%d)\n", __FUNCTION__, __LINE__);
                 printf("ERROR!: recv failed: coords\n");
                 return false;
@@ -267,7 +353,7 @@ bool SocketServer::ReceiveDeliveryResult(DeliveryResult_t* result) {
 	result->personBBoxes.push_back(bbox);
 
 	double score = 0;
-	if(recv(sock_fdesc_conn_, (char*) &score, sizeof(score),0) == -1) {
+	if(!recv_all(sock_fdesc_conn_, &score, sizeof(score))) {
             printf("ERROR!: recv failed: (%s:%d)\n", __FUNCTION__, __LINE__);
             printf("ERROR!: recv failed: person score\n");
             return false;
@@ -277,7 +363,7 @@ bool SocketServer::ReceiveDeliveryResult(DeliveryResult_t* result) {
 
     if(serverVersion > TH_VERSION_1_0) {
         count = 0;
-        if(recv(sock_fdesc_conn_, (char*) &count, sizeof(int),0) == -1) {
+        if(!recv_all(sock_fdesc_conn_, &count, sizeof(int))) {
             printf("ERROR!: recv failed: (%s:%d)\n", __FUNCTION__, __LINE__);
             printf("ERROR!: recv failed: count\n");
             return false;
@@ -287,7 +373,7 @@ bool SocketServer::ReceiveDeliveryResult(DeliveryResult_t* result) {
             std::vector<int> bbox;
             for(int j = 0; j < 4; j++) {
                 int coord = 0;
-                if(recv(sock_fdesc_conn_, (char*) &coord, sizeof(coord),0) == -1) {
+                if(!recv_all(sock_fdesc_conn_, &coord, sizeof(coord))) {
                     printf("ERROR!: recv failed: (%s:%d)\n", __FUNCTION__, __LINE__);
                     printf("ERROR!: recv failed: coords\n");
                     return false;
@@ -297,7 +383,7 @@ bool SocketServer::ReceiveDeliveryResult(DeliveryResult_t* result) {
 	    result->nonROIPersonBBoxes.push_back(bbox);
 
 	    double score = 0;
-	    if(recv(sock_fdesc_conn_, (char*) &score, sizeof(score),0) == -1) {
+	    if(!recv_all(sock_fdesc_conn_, &score, sizeof(score))) {
                 printf("ERROR!: recv failed: (%s:%d)\n", __FUNCTION__, __LINE__);
                 printf("ERROR!: recv failed: person score\n");
                 return false;
@@ -306,37 +392,37 @@ bool SocketServer::ReceiveDeliveryResult(DeliveryResult_t* result) {
         }
     }
 
-    if(recv(sock_fdesc_conn_, (char*) &(result->deliveryScore), sizeof(result->deliveryScore),0) == -1) {
+    if(!recv_all(sock_fdesc_conn_, &(result->deliveryScore), sizeof(result->deliveryScore))) {
         printf("ERROR!: recv failed: (%s:%d)\n", __FUNCTION__, __LINE__);
         printf("ERROR!: recv failed: deliveryScore\n");
         return false;
     }
 
-    if(recv(sock_fdesc_conn_, (char*) &(result->maxAugScore), sizeof(result->maxAugScore),0) == -1) {
+    if(!recv_all(sock_fdesc_conn_, &(result->maxAugScore), sizeof(result->maxAugScore))) {
         printf("ERROR!: recv failed: (%s:%d)\n", __FUNCTION__, __LINE__);
         printf("ERROR!: recv failed: maxAugScore\n");
         return false;
     }
 
-    if(recv(sock_fdesc_conn_, (char*) &(result->motionTriggeredTime), sizeof(result->motionTriggeredTime),0) == -1) {
+    if(!recv_all(sock_fdesc_conn_, &(result->motionTriggeredTime), sizeof(result->motionTriggeredTime))) {
         printf("ERROR!: recv failed: (%s:%d)\n", __FUNCTION__, __LINE__);
         printf("ERROR!: recv failed: motionTriggeredTime\n");
         return false;
     }
 
-    if(recv(sock_fdesc_conn_, (char*) &(result->mpipeProcessedframes), sizeof(result->mpipeProcessedframes),0) == -1) {
+    if(!recv_all(sock_fdesc_conn_, &(result->mpipeProcessedframes), sizeof(result->mpipeProcessedframes))) {
         printf("ERROR!: recv failed: (%s:%d)\n", __FUNCTION__, __LINE__);
         printf("ERROR!: recv failed: mpipeProcessedframes\n");
         return false;
     }
 
-    if(recv(sock_fdesc_conn_, (char*) &(result->time_taken), sizeof(result->time_taken),0) == -1) {
+    if(!recv_all(sock_fdesc_conn_, &(result->time_taken), sizeof(result->time_taken))) {
         printf("ERROR!: recv failed: (%s:%d)\n", __FUNCTION__, __LINE__);
         printf("ERROR!: recv failed: time_taken\n");
         return false;
     }
 
-    if(recv(sock_fdesc_conn_, (char*) &(result->time_waited), sizeof(result->time_waited),0) == -1) {
+    if(!recv_all(sock_fdesc_conn_, &(result->time_waited), sizeof(result->time_waited))) {
         printf("ERROR!: recv failed: (%s:%d)\n", __FUNCTION__, __LINE__);
         printf("ERROR!: recv failed: time_waited\n");
         return false;
@@ -353,11 +439,10 @@ HeaderType SocketServer::ReceiveImage(cv::Mat &image) {
     if (header_type != H_IMAGE)
         return (HeaderType) header_type;
 
-    ssize_t bytes_recv = 0;
     size_t image_size = 0;
 
-    // Reset image
-    image = cv::Mat::zeros(image_dims_, mat_type_);
+    // The caller's buffer is reused when its geometry matches, it must not be shared. recv fills all of it
+    image.create(image_dims_, mat_type_);
 
     // Get image size
     image_size = image.total() * image.elemSize();
@@ -365,20 +450,25 @@ HeaderType SocketServer::ReceiveImage(cv::Mat &image) {
     // Allocate space for image buffer
     uchar *sock_data = image.ptr<uchar>();
 
-    // Save image data to buffer
-    for (int i = 0; i < image_size; i += bytes_recv) {
-
-        bytes_recv = recv(sock_fdesc_conn_, sock_data + i, image_size - i, 0);
-
-        if (bytes_recv == -1) {
+    if (IsFramed()) {
+        if ((size_t)payloadSize != image_size) {
+            printf("ERROR!: payload %d for a %zu bytes image: (%s:%d)\n", payloadSize, image_size, __FUNCTION__, __LINE__);
+            return H_ERROR;
+        }
+        if (!recv_all(sock_fdesc_conn_, sock_data, image_size)) {
             printf("ERROR!: recv failed: (%s:%d)\n", __FUNCTION__, __LINE__);
-            printf("ERROR!: recv failed\n"
-                           "i: %d\n"
-                           "sock_fdesc: %d\n"
-                           "image_size: %d\n"
-                           "bytes_recv: %d\n", i, sock_fdesc_conn_, (int)image_size, (int)bytes_recv);
             return H_ERROR;
         }
+        return header_type;
+    }
+
+    // Save image data to buffer
+    if (!recv_all(sock_fdesc_conn_, sock_data, image_size)) {
+        printf("ERROR!: recv failed: (%s:%d)\n", __FUNCTION__, __LINE__);
+        printf("ERROR!: recv failed\n"
+                       "sock_fdesc: %d\n"
+                       "image_size: %d\n", sock_fdesc_conn_, (int)image_size);
+        return H_ERROR;
     }
 
     return header_type;
@@ -387,8 +477,6 @@ HeaderType SocketServer::ReceiveImage(cv::Mat &image) {
 bool SocketServer::SendDOI(int threshold, std::string bitmap) {
     int header_type = (int)H_DOI;
 
-    int bytes_sent = 0;
-
     cv::Mat bitmap_image = cv::imread(bitmap.c_str(), cv::IMREAD_COLOR);
     if(bitmap_image.empty()) {
         printf("ERROR!: imead failed:DOI image (%s:%d)\n", __FUNCTION__, __LINE__);
@@ -396,53 +484,35 @@ bool SocketServer::SendDOI(int threshold, std::string bitmap) {
         return false;
     }
 
-    if (send(sock_fdesc_conn_, (char*)&header_type, sizeof(header_type), 0) == -1) {
-        printf("ERROR!: send failed: (%s:%d)\n", __FUNCTION__, __LINE__);
-        perror("Error sending header");
-        return false;
-    }
-
-    if (send(sock_fdesc_conn_, (char*)&threshold, sizeof(threshold), 0) == -1) {
-        printf("ERROR!: send failed: (%s:%d)\n", __FUNCTION__, __LINE__);
-        perror("Error sending doi threshold");
-        return false;
-    }
-
-    // Send number of rows to server
-    if (send(sock_fdesc_conn_, (char*)&bitmap_image.rows, sizeof(bitmap_image.rows), 0) == -1) {
-        printf("ERROR!: send failed: (%s:%d)\n", __FUNCTION__, __LINE__);
-        perror("Error sending rows");
-        return false;
-    }
-
-    // Send number of cols to server
-    if (send(sock_fdesc_conn_, (char*)&bitmap_image.cols, sizeof(bitmap_image.cols), 0) == -1) {
-        printf("ERROR!: send failed: (%s:%d)\n", __FUNCTION__, __LINE__);
-        perror("Error sending cols");
-        return false;
-    }
-
     int matType = bitmap_image.type();// & CV_MAT_DEPTH_MASK;
-    // Send number of cols to server
-    if (send(sock_fdesc_conn_, (char*)&matType, sizeof(matType), 0) == -1) {
-        printf("ERROR!: send failed: (%s:%d)\n", __FUNCTION__, __LINE__);
-        perror("Error sending type");
-        return false;
-    }
 
     cv::Mat out = bitmap_image;
     int image_size = bitmap_image.total() * bitmap_image.elemSize();
 
     if (bitmap_image.isContinuous() == false)
     {
-        bitmap_image.copyTo(out);
-    }
-
-    bytes_sent = send(sock_fdesc_conn_, out.data, image_size, 0);
-
-    if (bytes_sent != image_size) {
+        out = bitmap_image.clone();
+    }
+
+    // header, threshold, rows, cols, type and bitmap in one message
+    struct iovec iov[6];
+
+    iov[0].iov_base = &header_type;
+    iov[0].iov_len = sizeof(header_type);
+    iov[1].iov_base = &threshold;
+    iov[1].iov_len = sizeof(threshold);
+    iov[2].iov_base = &bitmap_image.rows;
+    iov[2].iov_len = sizeof(bitmap_image.rows);
+    iov[3].iov_base = &bitmap_image.cols;
+    iov[3].iov_len = sizeof(bitmap_image.cols);
+    iov[4].iov_base = &matType;
+    iov[4].iov_len = sizeof(matType);
+    iov[5].iov_base = out.data;
+    iov[5].iov_len = image_size;
+
+    if (!send_all(sock_fdesc_conn_, iov, 6)) {
         printf("ERROR!: send failed: (%s:%d)\n", __FUNCTION__, __LINE__);
-        perror("Error sending image");
+        perror("Error sending DOI");
         return false;
     }
 
@@ -454,28 +524,21 @@ bool SocketServer::SendROI(std::string roi) {
 
     int header_type = (int)H_ROI;
 
-    int bytes_sent = 0;
-
     int coord_count = roi.size();
 
-    // Header
-    if (send(sock_fdesc_conn_, (char*)&header_type, sizeof(header_type), 0) == -1) {
-        printf("ERROR!: send failed: (%s:%d)\n", __FUNCTION__, __LINE__);
-        perror("Error sending header");
-        return false;
-    }
+    // header, ROI coordinate count and coordinates in one message
+    struct iovec iov[3];
 
-    // Send ROI coordinate count
-    if (send(sock_fdesc_conn_, (char*)&coord_count, sizeof(coord_count), 0) == -1) {
-        printf("ERROR!: send failed: (%s:%d)\n", __FUNCTION__, __LINE__);
-        perror("Error sending ROI coordinate string size");
-        return false;
-    }
+    iov[0].iov_base = &header_type;
+    iov[0].iov_len = sizeof(header_type);
+    iov[1].iov_base = &coord_count;
+    iov[1].iov_len = sizeof(coord_count);
+    iov[2].iov_base = &roi[0];
+    iov[2].iov_len = coord_count;
 
-    // Send ROI coordinates
-    if (send(sock_fdesc_conn_, (char*)roi.c_str(), coord_count, 0) == -1) {
+    if (!send_all(sock_fdesc_conn_, iov, 3)) {
         printf("ERROR!: send failed: (%s:%d)\n", __FUNCTION__, __LINE__);
-        perror("Error sending ROI coordinate count");
+        perror("Error sending ROI");
         return false;
     }
 
@@ -483,7 +546,7 @@ bool SocketServer::SendROI(std::string roi) {
 }
 
 // ------------------------------------------------------------------------------------------------------------------
-bool SocketServer::SendImage(cv::Mat& image, int fps) {
+bool SocketServer::SendImage(cv::Mat& image, int fps, cv::Size source_size, int32_t sequence) {
 
     int matType = image.type();// & CV_MAT_DEPTH_MASK;
 
@@ -491,8 +554,6 @@ bool SocketServer::SendImage(cv::Mat& image, int fps) {
 
     int header_type = (int)H_IMAGE;
 
-    int bytes_sent = 0;
-
     if( fileChangeStatus == true && fileState == 0 ){
 	header_type = (int)H_FEND;
 	fileState ++;
@@ -501,55 +562,149 @@ bool SocketServer::SendImage(cv::Mat& image, int fps) {
 	fileState ++;
     }
 
+    if (IsFramed())
+        return SendFramedImage(image, header_type, fps, source_size, sequence);
 
-    // Header
-    if (send(sock_fdesc_conn_, (char*)&header_type, sizeof(header_type), 0) == -1) {
-        printf("ERROR!: send failed: (%s:%d)\n", __FUNCTION__, __LINE__);
-        perror("Error sending header");
-        return false;
+    cv::Mat out = image;
+    
+    if (image.isContinuous() == false)
+    {
+        image.copyTo(out);
     }
 
-    // Send number of rows to server
-    if (send(sock_fdesc_conn_, (char*)&image.rows, sizeof(image.rows), 0) == -1) {
-        printf("ERROR!: send failed: (%s:%d)\n", __FUNCTION__, __LINE__);
-        perror("Error sending rows");
-        return false;
+    if (frameCodec != TH_CODEC_RAW) {
+        if (!EncodeImage(out))
+            return false;
     }
 
-    // Send number of cols to server
-    if (send(sock_fdesc_conn_, (char*)&image.cols, sizeof(image.cols), 0) == -1) {
-        printf("ERROR!: send failed: (%s:%d)\n", __FUNCTION__, __LINE__);
-        perror("Error sending cols");
-        return false;
+    // header, rows, cols and type, then the optional fields, then the payload, in one message
+    struct iovec iov[8];
+    int iovcnt = 0;
+
+    iov[iovcnt].iov_base = &header_type;
+    iov[iovcnt++].iov_len = sizeof(header_type);
+    iov[iovcnt].iov_base = &image.rows;
+    iov[iovcnt++].iov_len = sizeof(image.rows);
+    iov[iovcnt].iov_base = &image.cols;
+    iov[iovcnt++].iov_len = sizeof(image.cols);
+    iov[iovcnt].iov_base = &matType;
+    iov[iovcnt++].iov_len = sizeof(matType);
+
+    // NV12 and gray frames are already scaled, tell the client the source size to map its blobs back
+    int source_dims[2];
+    if(frameFormat != TH_FRAME_BGR) {
+        if(source_size.area() == 0) {
+            source_size = image.size();
+        }
+        source_dims[0] = source_size.height;
+        source_dims[1] = source_size.width;
+        iov[iovcnt].iov_base = source_dims;
+        iov[iovcnt++].iov_len = sizeof(source_dims);
+    }
+
+    if(header_type == H_FSTART) {
+        iov[iovcnt].iov_base = &fps;
+        iov[iovcnt++].iov_len = sizeof(fps);
+    }
+
+    // compressed length, the client still gets rows, cols and type above to check the decoded frame
+    int encoded_size = (int)encodeBuffer.size();
+    if (frameCodec != TH_CODEC_RAW) {
+        iov[iovcnt].iov_base = &encoded_size;
+        iov[iovcnt++].iov_len = sizeof(encoded_size);
+        iov[iovcnt].iov_base = encodeBuffer.data();
+        iov[iovcnt++].iov_len = encodeBuffer.size();
+    } else {
+        iov[iovcnt].iov_base = out.data;
+        iov[iovcnt++].iov_len = image_size;
     }
 
-    // Send number of cols to server
-    if (send(sock_fdesc_conn_, (char*)&matType, sizeof(matType), 0) == -1) {
+    if (!send_all(sock_fdesc_conn_, iov, iovcnt)) {
         printf("ERROR!: send failed: (%s:%d)\n", __FUNCTION__, __LINE__);
-        perror("Error sending type");
+        perror("Error sending image");
         return false;
     }
 
-    if(header_type == H_FSTART) {
-        if (send(sock_fdesc_conn_, (char*)&fps, sizeof(fps), 0) == -1) {
-            printf("ERROR!: send failed: (%s:%d)\n", __FUNCTION__, __LINE__);
-            perror("Error sending fps");
-            return false;
-        }
-    }
+    return true;
+}
+
+// ------------------------------------------------------------------------------------------------------------------
+bool SocketServer::SendFramedImage(const cv::Mat& image, int header_type, int fps, cv::Size source_size, int32_t sequence) {
 
+    FrameHeader_t header;
+    struct iovec iov[2];
     cv::Mat out = image;
-    
+
     if (image.isContinuous() == false)
     {
-        image.copyTo(out);
+        out = image.clone();
     }
 
-    bytes_sent = send(sock_fdesc_conn_, out.data, image_size, 0);
+    if (source_size.area() == 0) {
+        source_size = image.size();
+    }
+
+    iov[1].iov_base = out.data;
+    iov[1].iov_len = out.total() * out.elemSize();
+
+    if (frameCodec != TH_CODEC_RAW) {
+        if (!EncodeImage(out))
+            return false;
+        iov[1].iov_base = encodeBuffer.data();
+        iov[1].iov_len = encodeBuffer.size();
+    }
+
+    header.header_type = header_type;
+    header.rows = out.rows;
+    header.cols = out.cols;
+    header.mat_type = out.type();
+    header.source_rows = source_size.height;
+    header.source_cols = source_size.width;
+    header.fps = fps;
+    header.sequence = sequence;
+    header.payload_size = (int32_t)iov[1].iov_len;
+
+    iov[0].iov_base = &header;
+    iov[0].iov_len = sizeof(header);
+
+    if (!send_all(sock_fdesc_conn_, iov, 2)) {
+        printf("ERROR!: send failed: (%s:%d)\n", __FUNCTION__, __LINE__);
+        perror("Error sending frame");
+        return false;
+    }
+
+    return true;
+}
 
-    if (bytes_sent == image_size)
+// ------------------------------------------------------------------------------------------------------------------
+bool SocketServer::EncodeImage(const cv::Mat& image) {
+
+    if (frameCodec == TH_CODEC_JPEG) {
+        std::vector<int> params;
+        params.push_back(cv::IMWRITE_JPEG_QUALITY);
+        params.push_back(jpegQuality);
+        if (!cv::imencode(".jpg", image, encodeBuffer, params)) {
+            printf("ERROR!: jpeg encode failed: (%s:%d)\n", __FUNCTION__, __LINE__);
+            return false;
+        }
+        return true;
+    }
+
+#ifdef _HAS_LZ4_
+    if (frameCodec == TH_CODEC_LZ4) {
+        int image_size = image.total() * image.elemSize();
+        encodeBuffer.resize(LZ4_compressBound(image_size));
+        int encoded_size = LZ4_compress_default((const char*)image.data, (char*)encodeBuffer.data(), image_size, (int)encodeBuffer.size());
+        if (encoded_size <= 0) {
+            printf("ERROR!: lz4 compress failed: (%s:%d)\n", __FUNCTION__, __LINE__);
+            return false;
+        }
+        encodeBuffer.resize(encoded_size);
         return true;
+    }
+#endif
 
+    printf("ERROR!: unsupported codec %d: (%s:%d)\n", frameCodec, __FUNCTION__, __LINE__);
     return false;
 }
 
@@ -603,9 +758,10 @@ bool SocketServer::SendImage(cv::Mat& image, int fps) {
 
 }*/
 // ------------------------------------------------------------------------------------------------------------------
-HeaderType SocketServer::ReceiveProcessedData(ProcessedData_t &pdata)
+HeaderType SocketServer::ReceiveProcessedData(ProcessedData_t &pdata, int32_t *sequence)
 {
     ssize_t bytes_recv = 0;
+    int32_t data_sequence = 0;
 
     HeaderType header_type = ReceiveHeader();
 
@@ -613,8 +769,19 @@ HeaderType SocketServer::ReceiveProcessedData(ProcessedData_t &pdata)
         return header_type;
     }
 
+    // sequence of the frame these results belong to
+    if(serverVersion >= TH_VERSION_PIPELINED) {
+        if(!recv_all(sock_fdesc_conn_, &data_sequence, sizeof(data_sequence))){
+            printf("ERROR!: recv failed: (%s:%d)sequence\n", __FUNCTION__, __LINE__);
+            return H_ERROR;
+        }
+    }
+    if(sequence != NULL) {
+        *sequence = data_sequence;
+    }
+
 #if 1
-    if((bytes_recv=recv(sock_fdesc_conn_, &pdata, sizeof(ProcessedData_t), 0)) == -1){
+    if(!recv_all(sock_fdesc_conn_, &pdata, sizeof(ProcessedData_t))){
         printf("ERROR!: recv failed: (%s:%d)\n", __FUNCTION__, __LINE__);
         printf("ERROR!: recv failed\n"
                        "sock_fdesc: %d\n"
@@ -677,15 +844,12 @@ HeaderType SocketServer::ReceiveProcessedData(ProcessedData_t &pdata)
 // ------------------------------------------------------------------------------------------------------------------
 std::string SocketServer::ReceiveMACId()
 {
-    ssize_t bytes_recv = 0;
     std::string mac = "";
 
     std::vector<char> recvBuff(MAC_LENGTH);
 
     // Save image data to buffer
-    bytes_recv = recv(sock_fdesc_conn_, recvBuff.data(), MAC_LENGTH, 0);
-
-    if (bytes_recv == -1) {
+    if (!recv_all(sock_fdesc_conn_, recvBuff.data(), MAC_LENGTH)) {
         printf("ERROR!: recv failed: (%s:%d)\n", __FUNCTION__, __LINE__);
         printf("ERROR!: recv failed\n");
         return std::string();
@@ -700,10 +864,9 @@ std::string SocketServer::ReceiveMACId()
 // -------------------------------------------------------------------------------------------------------------------
 AlgoType SocketServer::ReceiveAlg()
 {
-    ssize_t bytes_recv = 0;
     int  alg = TH_ALG_UNKNOWN;
 
-    if((bytes_recv=recv(sock_fdesc_conn_, (char*) &alg, sizeof(int),0)) == -1) {
+    if(!recv_all(sock_fdesc_conn_, &alg, sizeof(int))) {
         printf("ERROR!: recv failed: (%s:%d)\n", __FUNCTION__, __LINE__);
         printf("ERROR!: recv failed\n");
     }
@@ -713,10 +876,9 @@ AlgoType SocketServer::ReceiveAlg()
 
 bool SocketServer::ReceiveROIState()
 {
-    ssize_t bytes_recv = 0;
     bool state = true;
 
-    if((bytes_recv=recv(sock_fdesc_conn_, (char*) &state, sizeof(bool),0)) == -1) {
+    if(!recv_all(sock_fdesc_conn_, &state, sizeof(bool))) {
         printf("ERROR!: recv failed: (%s:%d)\n", __FUNCTION__, __LINE__);
         printf("ERROR!: recv failed\n");
     }
@@ -726,10 +888,9 @@ bool SocketServer::ReceiveROIState()
 
 bool SocketServer::ReceiveDOIState()
 {
-    ssize_t bytes_recv = 0;
     bool state = true;
 
-    if((bytes_recv=recv(sock_fdesc_conn_, (char*) &state, sizeof(bool),0)) == -1) {
+    if(!recv_all(sock_fdesc_conn_, &state, sizeof(bool))) {
         printf("ERROR!: recv failed: (%s:%d)\n", __FUNCTION__, __LINE__);
         printf("ERROR!: recv failed\n");
     }
@@ -737,15 +898,75 @@ bool SocketServer::ReceiveDOIState()
     return state;
 }
 
+bool SocketServer::ReceiveFrameFormat(FrameFormat *format, int *width, int *height)
+{
+    int format_resolution[3] = {TH_FRAME_BGR, 0, 0};
+
+    if(!recv_all(sock_fdesc_conn_, format_resolution, sizeof(format_resolution))) {
+        printf("ERROR!: recv failed: (%s:%d)\n", __FUNCTION__, __LINE__);
+        printf("ERROR!: recv failed\n");
+        return false;
+    }
+
+    if((format_resolution[0] < TH_FRAME_BGR) || (format_resolution[0] > TH_FRAME_GRAY)) {
+        printf("ERROR!: unknown frame format %d: (%s:%d)\n", format_resolution[0], __FUNCTION__, __LINE__);
+        return false;
+    }
+
+    if((format_resolution[0] != TH_FRAME_BGR) &&
+       ((format_resolution[1] <= 0) || (format_resolution[2] <= 0) ||
+        (format_resolution[1] % 2) || (format_resolution[2] % 2))) {
+        printf("ERROR!: invalid analysis resolution %dx%d: (%s:%d)\n", format_resolution[1], format_resolution[2], __FUNCTION__, __LINE__);
+        return false;
+    }
+
+    frameFormat = (FrameFormat)format_resolution[0];
+    *format = frameFormat;
+    *width = format_resolution[1];
+    *height = format_resolution[2];
+    return true;
+}
+
+FrameCodec SocketServer::NegotiateFrameCodec(int jpeg_quality)
+{
+    int requested = TH_CODEC_RAW;
+    int accepted = TH_CODEC_RAW;
+
+    if(!recv_all(sock_fdesc_conn_, &requested, sizeof(requested))) {
+        printf("ERROR!: recv failed: (%s:%d)\n", __FUNCTION__, __LINE__);
+        printf("ERROR!: recv failed\n");
+        requested = TH_CODEC_RAW;
+    }
+
+    if (requested == TH_CODEC_JPEG) {
+        // JPEG would smear the interleaved UV plane of NV12 frames
+        accepted = (frameFormat == TH_FRAME_NV12) ? TH_CODEC_RAW : TH_CODEC_JPEG;
+    }
+#ifdef _HAS_LZ4_
+    else if (requested == TH_CODEC_LZ4) {
+        accepted = TH_CODEC_LZ4;
+    }
+#endif
+
+    if (!send_buffer(sock_fdesc_conn_, &accepted, sizeof(accepted))) {
+        printf("ERROR!: send failed: (%s:%d)\n", __FUNCTION__, __LINE__);
+        perror("Error sending codec");
+        accepted = TH_CODEC_RAW;
+    }
+
+    frameCodec = (FrameCodec)accepted;
+    jpegQuality = jpeg_quality;
+    return frameCodec;
+}
+
 bool SocketServer::ReceiveImageResolution(int *width, int *height)
 {
-    ssize_t bytes_recv = 0;
-    if((bytes_recv=recv(sock_fdesc_conn_, (char*) width, sizeof(int),0)) == -1) {
+    if(!recv_all(sock_fdesc_conn_, width, sizeof(int))) {
         printf("ERROR!: recv failed: (%s:%d)\n", __FUNCTION__, __LINE__);
         printf("ERROR!: recv failed\n");
 	return false;
     }
-    if((bytes_recv=recv(sock_fdesc_conn_, (char*) height, sizeof(int),0)) == -1) {
+    if(!recv_all(sock_fdesc_conn_, height, sizeof(int))) {
         printf("ERROR!: recv failed: (%s:%d)\n", __FUNCTION__, __LINE__);
         printf("ERROR!: recv failed\n");
 	return false;
@@ -756,10 +977,8 @@ bool SocketServer::ReceiveImageResolution(int *width, int *height)
 // ------------------------------------------------------------------------------------------------------------------
 bool SocketServer::SendClipSize(int32_t segmentation_size)
 {
-    int bytes_sent = 0;
-
     // Send segmentation size
-    if ((bytes_sent = send(sock_fdesc_conn_, (char*)&segmentation_size, sizeof(segmentation_size), 0)) == -1) {
+    if (!send_buffer(sock_fdesc_conn_, &segmentation_size, sizeof(segmentation_size))) {
         perror("Error sending data");
         printf("ERROR!: send failed: (%s:%d)\n", __FUNCTION__, __LINE__);
         return false;
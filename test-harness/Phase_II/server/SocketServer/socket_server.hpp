@@ -23,7 +23,7 @@
 #include <sstream>
 #include <cstdio>
 #include <cstring>
-#include <list>
+#include <vector>
 #include <cctype>
 #include <signal.h> 
 #include <sys/socket.h>
@@ -55,11 +55,30 @@ class SocketServer {
     int sock_fdesc_conn_;
 
     ServerVersion serverVersion;
+    FrameFormat frameFormat;
+    FrameCodec frameCodec;
+    int jpegQuality;
+    /// compressed frame, reused between frames
+    std::vector<uchar> encodeBuffer;
+    /// payload size read from the last framed header
+    int payloadSize;
     bool fileChangeStatus;
+    /// 0 sends H_FEND next, 1 sends H_FSTART next, 2 plain H_IMAGE until the next file change
     int fileState;
     int fnum;
 
-    std::list<pid_t> pid_list;
+    /** Compress image into encodeBuffer with the negotiated codec
+     *
+     */
+    bool EncodeImage(const cv::Mat& image);
+    /** Send header and image in one call, TH_VERSION_FRAMED
+     *
+     */
+    bool SendFramedImage(const cv::Mat& image, int header_type, int fps, cv::Size source_size, int32_t sequence);
+    /** Framed messages from TH_VERSION_FRAMED
+     *
+     */
+    bool IsFramed() const { return serverVersion >= TH_VERSION_FRAMED; }
 
     public:
     /**
@@ -69,6 +88,12 @@ class SocketServer {
     */
     SocketServer(int port);
     /**
+    * constructor for a connection accepted elsewhere
+    * @param port the port the connection came in on
+    * @param conn_fdesc the connected socket, owned from now on
+    */
+    SocketServer(int port, int conn_fdesc);
+    /**
     * Destructor
     */
     virtual ~SocketServer();
@@ -76,23 +101,38 @@ class SocketServer {
     *
     */
     bool Connect();
+    /** Accept one pending connection on the listening socket
+     *
+     * @return the connected socket, -1 with errno set when there is none
+     */
+    int AcceptRequest();
+    /** Listening socket created by Connect, to be polled for new connections
+     *
+     */
+    int GetListenDesc() const { return sock_fdesc_init_; }
+    /** Shut down and close the client connection
+     *
+     */
+    void CloseConnection();
 
-    bool MonitorRequest();
     /** close connection
     *
     */
     void Close();
     /** Recieve the next image or header
     *
-    * @param image the output image
+    * @param image the output image, its buffer is reused when the size and type match
     * @return
     */
     HeaderType ReceiveImage(cv::Mat& image);
     /** Sends image data to the server
      *
      * @param image The opencv MAT
+     * @param source_size Size of the decoded frame, sent after the mat type
+     *        when the client asked for NV12 or gray frames
+     * @param sequence Frame sequence the client echoes with its results, framed messages only
      */
-    bool SendImage(cv::Mat& image, int fps);
+    bool SendImage(cv::Mat& image, int fps, cv::Size source_size = cv::Size(), int32_t sequence = 0);
     /** recieves the next header
     *
     * @return A HeaderType
@@ -139,14 +179,24 @@ class SocketServer {
      *
      */
     bool ReceiveDOIState();
+    /** Recieve the frame format and the analysis resolution of the client
+     *
+     */
+    bool ReceiveFrameFormat(FrameFormat *format, int *width, int *height);
+    /** Recieve the codec asked by the client and answer with the one used,
+     *  raw when the request cannot be served
+     *
+     */
+    FrameCodec NegotiateFrameCodec(int jpeg_quality);
     /** Recieve Image Resolution
      *
      */
     bool ReceiveImageResolution(int *width, int* height);
     /** Receive Processed data
       *
+      * @param sequence receives the frame sequence the data belongs to, TH_VERSION_PIPELINED
       */
-    HeaderType ReceiveProcessedData(ProcessedData_t& pdata);
+    HeaderType ReceiveProcessedData(ProcessedData_t& pdata, int32_t *sequence = NULL);
     /** Set File change status
      *
      */
@@ -16,20 +16,22 @@
 * SPDX-License-Identifier: Apache-2.0
 */
 
+#include "THSessionManager.hpp"
 #include "TestHarnessServer.hpp"
 
-THServer *thInstance = NULL;
+THSessionManager *thManager = NULL;
 
 void sigHandler(int signal)
 {
-    if(thInstance)
-        thInstance -> THServerStop();
+    if(thManager)
+        thManager -> THSessionManagerStop();
     return;
 }
 
 int main(int argc, char** argv)
 {
     std::string path;
+    THSessionManager manager;
 
     if(argc < 2){
         std::cout << "THServer requires path to config files" << std::endl;
@@ -39,25 +41,24 @@ int main(int argc, char** argv)
     path = argv[1];
     umask(0000);
 
-    std::signal(SIGINT, sigHandler);
-
-    thInstance = THServer::THCreateServerInstance();
-
-    if(!thInstance){
-        std::cout << "Error creating Server instance" << std::endl;
-        return -1;
-    }
+    // a device dropping its connection must only end its own session
+    std::signal(SIGPIPE, SIG_IGN);
 
-    if(!thInstance -> THServerInit(path)){
+    if(!manager.THSessionManagerInit(path)){
         std::cout << "Error initializing THServer" << std::endl;
         return -1;
     }
 
-    if(!thInstance -> THServerStart()){
+    if(!manager.THSessionManagerStart()){
         std::cout << "Test Harness server failed to start" << std::endl;
         return -1;
     }
 
-    while(thInstance ->THProcessFrames());
-    exit(0);
+    thManager = &manager;
+    std::signal(SIGINT, sigHandler);
+
+    manager.THSessionManagerRun();
+
+    thManager = NULL;
+    return 0;
 }
@@ -0,0 +1,295 @@
+/*
+* Copyright 2020 Comcast Cable Communications Management, LLC
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* SPDX-License-Identifier: Apache-2.0
+*/
+
+#include "THSessionManager.hpp"
+#include "TestHarnessServer.hpp"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#define MAX_EPOLL_EVENTS 2
+
+THSessionManager::THSessionManager():
+                 port(0),
+                 maxSessions(1),
+                 listener(NULL),
+                 epollDesc(-1),
+                 stopDesc(-1),
+                 stopping(false){}
+
+THSessionManager::~THSessionManager()
+{
+    if(epollDesc != -1)
+        close(epollDesc);
+
+    if(stopDesc != -1)
+        close(stopDesc);
+
+    if(listener){
+        listener->Close();
+        delete listener;
+    }
+}
+
+/**
+* @brief  The function reads the port and the session limit, every session reads
+*         the rest of the configuration itself
+* @param  configFilePath, Path to THServerConfigFile.
+* @return true on success, false otherwise
+*/
+bool THSessionManager::THSessionManagerInit(std::string configFilePath)
+{
+    THServer settings;
+
+    if(!settings.THServerInit(configFilePath))
+        return false;
+
+    configPath = configFilePath;
+    port = settings.THGetPort();
+    maxSessions = settings.THGetMaxSessions();
+
+    return true;
+}
+
+/**
+* @brief  This function is used to open the listening socket and spawn the session workers
+* @param  void
+* @return true on success, false otherwise
+*/
+bool THSessionManager::THSessionManagerStart()
+{
+    struct epoll_event event;
+    int flags = 0;
+
+    listener = new (std::nothrow) SocketServer(port);
+
+    if(listener == nullptr){
+        std::cout << "Unable to allocate memory" << std::endl;
+        return false;
+    }
+
+    if(!listener->Connect())
+        return false;
+
+    // connections are accepted until accept reports EAGAIN
+    flags = fcntl(listener->GetListenDesc(), F_GETFL, 0);
+    if((flags == -1) || (fcntl(listener->GetListenDesc(), F_SETFL, flags | O_NONBLOCK) == -1)){
+        perror("fcntl O_NONBLOCK");
+        return false;
+    }
+
+    if((stopDesc = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1){
+        perror("eventfd");
+        return false;
+    }
+
+    if((epollDesc = epoll_create1(EPOLL_CLOEXEC)) == -1){
+        perror("epoll_create1");
+        return false;
+    }
+
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = listener->GetListenDesc();
+    if(epoll_ctl(epollDesc, EPOLL_CTL_ADD, listener->GetListenDesc(), &event) == -1){
+        perror("epoll_ctl listener");
+        return false;
+    }
+
+    event.data.fd = stopDesc;
+    if(epoll_ctl(epollDesc, EPOLL_CTL_ADD, stopDesc, &event) == -1){
+        perror("epoll_ctl stop");
+        return false;
+    }
+
+    for(int i = 0; i < maxSessions; i++){
+        workers.push_back(std::thread(&THSessionManager::THWorkerThreadFunc, this));
+    }
+
+    std::cout << "Listening on port:" << port << ", up to " << maxSessions << " sessions" << std::endl;
+    return true;
+}
+
+/**
+* @brief  This function is used to accept connections until the manager is stopped,
+*         running sessions are ended before it returns
+* @param  void
+* @return None
+*/
+void THSessionManager::THSessionManagerRun()
+{
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    bool stopRequested = false;
+
+    while(!stopRequested){
+
+        int eventCount = epoll_wait(epollDesc, events, MAX_EPOLL_EVENTS, -1);
+
+        if(eventCount == -1){
+            if(errno == EINTR)
+                continue;
+            perror("epoll_wait");
+            break;
+        }
+
+        for(int i = 0; i < eventCount; i++){
+            if(events[i].data.fd == stopDesc)
+                stopRequested = true;
+            else
+                THAcceptSessions();
+        }
+    }
+
+    std::cout << "Stopping sessions..." << std::endl;
+    {
+        std::unique_lock<std::mutex> lock(sessionMutex);
+        stopping = true;
+
+        while(!pendingSessions.empty()){
+            close(pendingSessions.front());
+            pendingSessions.pop();
+        }
+
+        // blocked receives fail and the sessions wind down
+        for(std::set<int>::iterator it = activeSessions.begin(); it != activeSessions.end(); ++it){
+            shutdown(*it, SHUT_RDWR);
+        }
+        lock.unlock();
+    }
+    sessionCv.notify_all();
+
+    for(size_t i = 0; i < workers.size(); i++){
+        workers[i].join();
+    }
+    workers.clear();
+}
+
+/**
+* @brief  This function is used to stop the manager, safe to call from a signal handler
+* @param  void
+* @return None
+*/
+void THSessionManager::THSessionManagerStop()
+{
+    uint64_t one = 1;
+
+    if(stopDesc != -1){
+        if(write(stopDesc, &one, sizeof(one)) == -1){
+            // nothing to do from a signal handler
+        }
+    }
+}
+
+/**
+* @brief  This function is used to queue every pending connection for the workers
+* @param  void
+* @return None
+*/
+void THSessionManager::THAcceptSessions()
+{
+    while(true){
+
+        int connDesc = listener->AcceptRequest();
+
+        if(connDesc == -1){
+            if(errno == EINTR)
+                continue;
+            if((errno != EAGAIN) && (errno != EWOULDBLOCK))
+                perror("ERROR! Client couldn't connect!");
+            return;
+        }
+
+        size_t waiting = 0;
+        {
+            std::unique_lock<std::mutex> lock(sessionMutex);
+            pendingSessions.push(connDesc);
+            waiting = pendingSessions.size();
+            if(activeSessions.size() < (size_t)maxSessions)
+                waiting = 0;
+            lock.unlock();
+        }
+        sessionCv.notify_one();
+
+        if(waiting)
+            std::cout << "Client connected, " << waiting << " waiting for a free session" << std::endl;
+        else
+            std::cout << "Client connected" << std::endl;
+    }
+}
+
+/**
+* @brief  Session worker, serves one connection after the other
+* @param  void
+* @return None
+*/
+void THSessionManager::THWorkerThreadFunc()
+{
+    while(true){
+
+        int connDesc = -1;
+        {
+            std::unique_lock<std::mutex> lock(sessionMutex);
+            sessionCv.wait(lock, [this]{ return stopping || !pendingSessions.empty(); });
+            if(stopping)
+                return;
+
+            connDesc = pendingSessions.front();
+            pendingSessions.pop();
+            activeSessions.insert(connDesc);
+            lock.unlock();
+        }
+
+        THRunSession(connDesc);
+    }
+}
+
+/**
+* @brief  This function is used to serve one device until it disconnects or runs out of files
+* @param  connDesc, connected socket
+* @return None
+*/
+void THSessionManager::THRunSession(int connDesc)
+{
+    THServer session;
+    bool initialized = session.THServerInit(configPath);
+
+    if(!initialized){
+        std::cout << "Error initializing session" << std::endl;
+    }
+    else if(!session.THServerStart(connDesc)){
+        std::cout << "Session failed to start" << std::endl;
+    }
+    else{
+        while(session.THProcessFrames());
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(sessionMutex);
+        activeSessions.erase(connDesc);
+        lock.unlock();
+    }
+
+    // the session owns the socket once it is started
+    if(!initialized)
+        close(connDesc);
+
+    session.THServerStop();
+    std::cout << "Session ended" << std::endl;
+}
@@ -0,0 +1,69 @@
+/*
+* Copyright 2020 Comcast Cable Communications Management, LLC
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* SPDX-License-Identifier: Apache-2.0
+*/
+
+#ifndef TH_SESSION_MANAGER_HPP
+#define TH_SESSION_MANAGER_HPP
+
+#include <string>
+#include <queue>
+#include <set>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "socket_server.hpp"
+
+/* Accepts devices on one port and serves each of them with its own THServer
+ * session. An epoll loop accepts the connections, max_sessions worker threads
+ * run the sessions and connections beyond that wait for a free worker. */
+class THSessionManager
+{
+public:
+    THSessionManager();
+    ~THSessionManager();
+
+    bool THSessionManagerInit(std::string configFilePath);
+    bool THSessionManagerStart();
+    // accept connections until THSessionManagerStop is called
+    void THSessionManagerRun();
+    // async-signal-safe
+    void THSessionManagerStop();
+
+private:
+    void THWorkerThreadFunc();
+    void THRunSession(int connDesc);
+    void THAcceptSessions();
+
+    std::string configPath;
+    int port;
+    int maxSessions;
+
+    SocketServer *listener;
+    int epollDesc;
+    int stopDesc;
+
+    bool stopping;
+    std::queue<int> pendingSessions;
+    std::set<int> activeSessions;
+    std::vector<std::thread> workers;
+    std::mutex sessionMutex;
+    std::condition_variable sessionCv;
+};
+
+#endif  //TH_SESSION_MANAGER_HPP
@@ -63,12 +63,24 @@
 #define DEFAULT_SOURCE_VIDEO_DIR "/tmp"
 #define DEFAULT_FARME_LIMIT 100
 #define DEFAULT_PORT 9000
+#define DEFAULT_JPEG_QUALITY 90
+#define DEFAULT_FRAME_WINDOW 1
+#define DEFAULT_FRAME_POOL_SIZE 8
+#define DEFAULT_DECODE_QUEUE_SIZE 8
+#define VIDEO_LIST_WAIT_TIME 20         /* seconds the decode thread waits for a new file once the list is empty */
+#define DEFAULT_ANNOTATE_QUEUE_SIZE 8
+#define DEFAULT_ENCODE_QUEUE_SIZE 8
+#define DEFAULT_ANNOTATION_THREADS 2
+#define DROPPED_FRAMES_LOG_INTERVAL 100
+#define DEFAULT_MAX_SESSIONS 4
 #define CLIP_DURATION 16
 
 #define EVENT_SIZE  ( sizeof (struct inotify_event) )
 #define BUF_LEN     ( 1024 * ( EVENT_SIZE + 16 ) )
 #define CONF_FILE_SUFFIX ".conf"
 #define DD_RESULT_FILE "DeliveryDetectionResults.json"
+#define JSON_WRITE_BUFFER_SIZE (64 * 1024)
+#define JSON_FLUSH_INTERVAL 2           /* seconds between flushes of the json file */
 
 
 /* Specific parameters to displaying objects and event and timestamp on the frame */
@@ -102,23 +114,11 @@ cv::Scalar textColorForTime(0, 0, 0); //black
 cv::Scalar textColorForROIMotion(255,0,255); //magenta
 cv::Scalar textColorForDOIMotion(0,0,128); //maroon
 
-THServer *THServer::thServerInstance = 0;
-
-
-int  THServer::stnStatus_count=0;
-smtnUploadStatus_t jsonStatus;
-cJSON * THServer::json_stnStatus=cJSON_CreateNumber(jsonStatus.status);
-
-THServer* THServer::THCreateServerInstance(){
-    if(!thServerInstance){
-        thServerInstance = new THServer();
-    }
-    return thServerInstance;
-}
 
 
 THServer::THServer():
                  port(DEFAULT_PORT),
+                 maxSessions(DEFAULT_MAX_SESSIONS),
                  ss(NULL),
                  clientType(TH_UNKNOWN),
                  outputVideoDir(DEFAULT_OUTPUT_VIDEO_DIR),
@@ -131,6 +131,7 @@ THServer::THServer():
                  frameNum(0),
                  fileNum(0),
                  frameCountLimit(DEFAULT_FARME_LIMIT),
+                 decodedFrames(DEFAULT_DECODE_QUEUE_SIZE),
                  processingDataInProgress(false),
                  fileChangeStatus(true),
                  firstFrame(true),
@@ -142,7 +143,31 @@ THServer::THServer():
 		 outputProcessedVideo(false),
 		 raw_video(false),
 		 ImageRows(0),
-		 ImageCols(0){}
+		 ImageCols(0),
+		 frameFormat(TH_FRAME_BGR),
+		 AnalysisImageColumn(0),
+		 AnalysisImageRow(0),
+		 frameCodec(TH_CODEC_RAW),
+		 jpegQuality(DEFAULT_JPEG_QUALITY),
+		 frameWindow(DEFAULT_FRAME_WINDOW),
+		 frameSequence(0),
+		 sentFrameCtr(0),
+		 framePool(DEFAULT_FRAME_POOL_SIZE + DEFAULT_DECODE_QUEUE_SIZE + DEFAULT_ANNOTATE_QUEUE_SIZE),
+		 annotateQueue(DEFAULT_ANNOTATE_QUEUE_SIZE),
+		 encodeQueue(DEFAULT_ENCODE_QUEUE_SIZE),
+		 annotationThreads(DEFAULT_ANNOTATION_THREADS),
+		 processedFrameSample(0),
+		 encodeOrder(0),
+		 droppedFrames(0),
+		 monitorVideoFiles(false),
+		 decodeStop(false),
+		 jsonFile(NULL),
+		 jsonFirstRecord(true),
+		 jsonLastFlush(0),
+		 g_delivery_result_array(NULL),
+		 g_Upload_Status_array(NULL),
+		 lastStnStatus(0),
+		 stnStatus_count(0){}
 
 /**
 * @brief  The function trims the blank spaces from string 
@@ -256,41 +281,65 @@ bool THServer::THServerInit(std::string configFilePath){
         else if (param.compare("segmentation_size") == 0 ){
              segmentation_size = std::stoi(value);
         }
+        else if (param.compare("jpeg_quality") == 0 ){
+             jpegQuality = std::stoi(value);
+        }
+        else if (param.compare("frame_window") == 0 ){
+             frameWindow = std::stoi(value);
+        }
+        else if (param.compare("max_sessions") == 0 ){
+             maxSessions = std::stoi(value);
+        }
+        else if (param.compare("annotation_threads") == 0 ){
+             annotationThreads = std::stoi(value);
+        }
+        else if (param.compare("processed_frame_sample") == 0 ){
+             processedFrameSample = std::stoi(value);
+        }
         else{
             std::cout << "Cannot initialize Parameter:" <<  param  << std::endl;
         }
      }
+     fclose(fileDesc);
+
+     if(maxSessions < 1)
+         maxSessions = 1;
+
+     if(annotationThreads < 1)
+         annotationThreads = 1;
+
+     if(processedFrameSample < 0)
+         processedFrameSample = 0;
+
+     // HighGUI windows can only be driven from one thread
+     if(supportFrameDisplay && (maxSessions > 1)) {
+         std::cout << "support_imshow needs max_sessions = 1, frame display disabled" << std::endl;
+         supportFrameDisplay = false;
+     }
 
      return true;
 }
 
 /**
-* @brief  This function is used to start the Server and spawn processing Thread 
-*         and Video file Monitor thread 
-* @param  void
+* @brief  This function is used to start the session of a connected client and spawn
+*         processing Thread and Video file Monitor thread
+* @param  connDesc, connected socket, owned by the session from now on
 * @return true on success, false otherwise
 */
-bool THServer::THServerStart(){
+bool THServer::THServerStart(int connDesc){
 
-    ss = new (std::nothrow) SocketServer(port);
+    ss = new (std::nothrow) SocketServer(port, connDesc);
     
     if(ss == nullptr){
         std::cout << "Unable to allocate memory" << std::endl;
+        close(connDesc);
         return false;
     }
 
-    if(!ss->Connect())
-        return false;
-
-    std::cout << "Listening on port:" << port << std::endl;
-
-    if(!ss->MonitorRequest())
-        return false;
-
     msg = {};
     msg.msgType = TH_CLIENT_INFO;
 
-    ServerVersion server_version = ss -> ReceiveServerVersion();
+    server_version = ss -> ReceiveServerVersion();
     std::cout << "Server Version: " << server_version << std::endl;
 
     msg.clientInfo.mac = ss -> ReceiveMACId();
@@ -327,6 +376,25 @@ bool THServer::THServerStart(){
         isDoiEnabled = ss-> ReceiveDOIState();
     }
 
+    if(server_version >= TH_VERSION_YUV) {
+        if(!ss-> ReceiveFrameFormat(&frameFormat, &AnalysisImageColumn, &AnalysisImageRow)) {
+            std::cout << "Error receiving frame format" << std::endl;
+            return false;
+        }
+        std::cout << "Frame format: " << frameFormat << " " << AnalysisImageColumn << "x" << AnalysisImageRow << std::endl;
+    }
+
+    if(server_version >= TH_VERSION_CODEC) {
+        frameCodec = ss-> NegotiateFrameCodec(jpegQuality);
+        std::cout << "Frame codec: " << frameCodec << std::endl;
+    }
+
+    // only a pipelining device echoes the frame sequence needed to match results
+    if((server_version < TH_VERSION_PIPELINED) || (frameWindow < 1)) {
+        frameWindow = 1;
+    }
+    std::cout << "Frame window: " << frameWindow << std::endl;
+
     if(msg.clientInfo.algType == TH_ALG_UNKNOWN){
         std::cout << "Error Identifying the algoritm used" << std::endl;
         return false;
@@ -342,12 +410,14 @@ bool THServer::THServerStart(){
     if(TH_FAILURE == THPopulateVideoList())
         return false;
 
+    monitorVideoFiles = true;
     videoFileMonitor = std::thread(&THServer::THMonitorVideoFile, this);
+    decodeThread = std::thread(&THServer::THDecodeVideoFiles, this);
     }
 
     frameProcessThread = std::thread(&THServer::MessageQueueThreadFunc,this);
 
-    THPushMessage(msg);
+    THPushMessage(std::move(msg));
    
     return true;
     
@@ -371,7 +441,7 @@ void THServer::THArchiveProcessedFiles()
 
     cmd.clear();
     time (&timestamp);
-    timeinfo = localtime (&timestamp);
+    timeinfo = localtime_r (&timestamp, &timeinfoBuf);
     if((num_bytes = strftime(videoTimeStamp,50,"%m%d%H%M%S",timeinfo)) == 0){
         std::cout << "Error generating Timestamp" << std::endl;
         return;
@@ -522,12 +592,18 @@ bool THServer::THProcessFrames()
 {
     if(clientType == TH_VIDEO){
         Status sendFrameStatus;
-        while((sendFrameStatus = SendFrame()) == TH_RETRY);
+        do {
+            // results of the current file come in before the next file is announced
+            if(fileChangeStatus && !inFlightFrames.empty())
+                break;
 
-        if(sendFrameStatus == TH_FAILURE)
-        {
-                return false;
-        }
+            sendFrameStatus = SendFrame();
+
+            if(sendFrameStatus == TH_FAILURE)
+            {
+                    return false;
+            }
+        } while((server_version >= TH_VERSION_PIPELINED) && (inFlightFrames.size() < (size_t)frameWindow));
     }
     else if( clientType == TH_CAMERA && firstFrame == true){
 
@@ -535,7 +611,7 @@ bool THServer::THProcessFrames()
         size_t num_bytes = 0;
 
         time (&timestamp);
-        timeinfo = localtime (&timestamp);
+        timeinfo = localtime_r (&timestamp, &timeinfoBuf);
         if((num_bytes = strftime(videoTimeStamp,50,"%m%d%H%M%S",timeinfo)) == 0){
             std::cout << "Error generating Timestamp" << std::endl;
             return false;
@@ -546,7 +622,7 @@ bool THServer::THProcessFrames()
         msg.fileInfo.fps = 10;
         msg.fileInfo.rows = ImageRows;
         msg.fileInfo.cols = ImageCols;
-        THPushMessage(msg);
+        THPushMessage(std::move(msg));
         firstFrame = false;
     }
 
@@ -556,93 +632,142 @@ bool THServer::THProcessFrames()
 }
 
 /**
-* @brief  This function is used to check if video files are available to be processed.
-* @param  void
-* @return TH_SUCCESS on success, TH_FAILURE in all other cases
+* @brief  This function is used to read the next frame of the open video into a pool
+*         buffer, resized when resize_frame is set
+* @param  image, receives the frame
+* @return true on success, false at the end of the video
 */
-bool THServer::THVideoListIsEmpty()
+bool THServer::THReadVideoFrame(cv::Mat &image)
 {
+    image = framePool.Acquire();
 
-    std::unique_lock<std::mutex> lock(videoListMutex);
-    bool videoListEmpty = false;
-    videoListEmpty = videoList.empty();
-    lock.unlock();
-    return videoListEmpty;
+    if(resizeFrame){
+        if(!vCap.read(decodeFrame)){
+            framePool.Release(image);
+            return false;
+        }
+        cv::resize(decodeFrame, image, cv::Size(ResizedImageColumn,ResizedImageRow));
+    }
+    else if(!vCap.read(image)){
+        framePool.Release(image);
+        return false;
+    }
+
+    return true;
 }
 
 /**
-* @brief  This function is used to send the frames from the video file to camera.
+* @brief  Decode thread, decodes the listed video files ahead of SendFrame. The next file
+*         is opened while the frames of the current one are still queued. With the list
+*         empty it waits for the file monitor, up to VIDEO_LIST_WAIT_TIME, or THServerStop
 * @param  void
-* @return TH_SUCCESS on success, TH_FAILURE in all other cases
+* @return None
 */
-Status THServer::SendFrame()
+void THServer::THDecodeVideoFiles()
 {
-    std::string fileBaseName;
     std::string currVideoFilename;
     std::string fullpath;
-    std::string delimiter (".");
-    std::size_t periodPos;
-    std::string roiFileName;
-
-    if(fileChangeStatus && !THVideoListIsEmpty()){
-
-        msg = {};
-        msg.msgType = TH_FILE_END;
-    //    sleep(20);
-        THPushMessage(msg);
-        frameCtr = 0;
 
+    while(true){
         {
         std::unique_lock<std::mutex> lock(videoListMutex);
-        
-        currVideoFilename = videoList.front();
-        videoList.pop();
+        if(videoList.empty() && !decodeStop)
+            std::cout << "Waiting for files..." << std::endl;
 
-        processedFileList.push_back(currVideoFilename);
+        // a file copied in while the last one was decoded arrives through vListCv
+        if(!vListCv.wait_for(lock, std::chrono::seconds(VIDEO_LIST_WAIT_TIME),
+                             [this]{ return decodeStop || !videoList.empty(); }) || decodeStop)
+            break;
 
+        currVideoFilename = videoList.front();
+        videoList.pop();
         lock.unlock();
         }
 
-        if((periodPos = currVideoFilename.rfind(delimiter)) != std::string::npos) {
-            fileBaseName = currVideoFilename.substr(0, periodPos); 
-        }
-
-        //search for the files in the list.
         fullpath = srcVideoPath + "/" + currVideoFilename;
         vCap.open(fullpath);
 
         if(!vCap.isOpened()) {
             std::cout << "Error opening file:" << currVideoFilename << " ,Skipping to next video " << std::endl;
-            return TH_RETRY;
+            continue;
         }
-        if(!vCap.read(nextFrame)){
+
+        THDecodedFrame frame;
+        if(!THReadVideoFrame(frame.image)){
             std::cout << "Error reading frame from video" << std::endl;
-            return TH_RETRY;
+            vCap.release();
+            continue;
         }
 
+        frame.newFile = true;
+        frame.fileName = currVideoFilename;
+        frame.frameTotal = vCap.get(cv::CAP_PROP_FRAME_COUNT);
+        frame.fps = vCap.get(cv::CAP_PROP_FPS);
+
+        // one frame of look-ahead marks the last frame of the file
+        bool lastFrame = false;
+        while(!lastFrame){
+            THDecodedFrame next;
+            lastFrame = frame.lastFrame = !THReadVideoFrame(next.image);
+
+            if(!decodedFrames.Push(std::move(frame))){
+                vCap.release();
+                return;
+            }
+            frame = std::move(next);
+        }
+        vCap.release();
+    }
+
+    // SendFrame stops once the queued frames are sent
+    decodedFrames.Close();
+}
+
+/**
+* @brief  This function is used to send the frames from the video file to camera.
+* @param  void
+* @return TH_SUCCESS on success, TH_FAILURE in all other cases
+*/
+Status THServer::SendFrame()
+{
+    std::string fileBaseName;
+    std::string delimiter (".");
+    std::size_t periodPos;
+    THDecodedFrame decoded;
+
+    if(!decodedFrames.Pop(decoded)){
         msg = {};
+        msg.msgType = TH_FILE_END;
+        THPushMessage(std::move(msg));
+        sleep(20);
+        std::cout << "Stopping processing..." << std::endl;
+        return TH_FAILURE;
+    }
 
-        if(resizeFrame){
-        currFrame = nextFrame.clone();
+    if(decoded.newFile){
 
-        // resize
-        cv::resize(currFrame,currFrame,cv::Size(ResizedImageColumn,ResizedImageRow));
+        msg = {};
+        msg.msgType = TH_FILE_END;
+        THPushMessage(std::move(msg));
+        frameCtr = 0;
+        sentFrameCtr = 0;
+
+        processedFileList.push_back(decoded.fileName);
+
+        if((periodPos = decoded.fileName.rfind(delimiter)) != std::string::npos) {
+            fileBaseName = decoded.fileName.substr(0, periodPos); 
         }
 
+        msg = {};
         msg.msgType = TH_FILE_INFO;
         msg.fileInfo.name = fileBaseName;
-        msg.fileInfo.frameTotal = vCap.get(cv::CAP_PROP_FRAME_COUNT);
-        msg.fileInfo.fps = vCap.get(cv::CAP_PROP_FPS);
+        msg.fileInfo.frameTotal = decoded.frameTotal;
+        msg.fileInfo.fps = decoded.fps;
 	v_file_fps = msg.fileInfo.fps;
-        if(resizeFrame){
-            msg.fileInfo.rows = currFrame.rows;
-            msg.fileInfo.cols = currFrame.cols;
-        }else{
-            msg.fileInfo.rows = vCap.get(cv::CAP_PROP_FRAME_HEIGHT);
-            msg.fileInfo.cols = vCap.get(cv::CAP_PROP_FRAME_WIDTH);
-        }
+        msg.fileInfo.rows = decoded.image.rows;
+        msg.fileInfo.cols = decoded.image.cols;
 
-        THPushMessage(msg);
+        THPushMessage(std::move(msg));
 
 	    if((fileNum == 0) && (!ss->SetFileChangeStatus(true))) {
 	        std::cout<<" Not able to set file change status"<<std::endl;
@@ -665,44 +790,39 @@ Status THServer::SendFrame()
 	    ss->SendDOI(config.doi_threshold, config.doi_bitmap);
         }
     }
-    else if(fileChangeStatus){
-        msg = {};
-        msg.msgType = TH_FILE_END;
-        THPushMessage(msg);
-        sleep(20);
-	if( NULL != g_json_message) {
-		cJSON_Delete(g_json_message);
-		g_json_message = NULL;
-	}
-        std::cout << "Stopping processing..." << std::endl;
-        return TH_FAILURE;
-        std::cout << "Waiting for files..." << std::endl;
-        {
-            std::unique_lock<std::mutex> lock(videoListMutex);
-            vListCv.wait(lock,[this]{return !videoList.empty();});
-
-            lock.unlock();
-        }
-
-        return TH_RETRY;
-    }
-
-    //std::cout << "height:" << currFrame.rows << " " << currFrame.size().height << std::endl;
-    //std::cout << "width:"  << currFrame.cols << " " << currFrame.size().width <<std::endl;
 
-    currFrame = nextFrame.clone();
-    if(resizeFrame){
-        cv::resize(currFrame,currFrame,cv::Size(ResizedImageColumn,ResizedImageRow));
-    }
+    // a buffer of its own per frame, the processing thread may still hold the previous ones
+    currFrame = decoded.image;
+    decoded.image.release();
 
-    if(!vCap.read(nextFrame)){
+    if(decoded.lastFrame){
         fileChangeStatus = true;
         if(!ss->SetFileChangeStatus(true)) {
             std::cout<<" Not able to set file change status"<<std::endl;
         }
     }
-    if(!ss->SendImage(currFrame, v_file_fps))
-        return TH_RETRY;
+    int32_t sequence = ++frameSequence;
+    bool sent;
+    if(frameFormat != TH_FRAME_BGR) {
+        THPackFrame(currFrame, packedFrame);
+        sent = ss->SendImage(packedFrame, v_file_fps, currFrame.size(), sequence);
+    }
+    else
+        sent = ss->SendImage(currFrame, v_file_fps, cv::Size(), sequence);
+
+    // the client is gone or the stream is out of step, sending the frame again cannot help
+    if(!sent){
+        std::cout << "Error sending frame, stopping processing..." << std::endl;
+        framePool.Release(currFrame);
+        return TH_FAILURE;
+    }
+
+    if(server_version >= TH_VERSION_PIPELINED) {
+        THInFlightFrame &frame = inFlightFrames[sequence];
+        frame.image = currFrame;
+        frame.frameIndex = ++sentFrameCtr;
+        currFrame.release();
+    }
 
     if(!ss->SetFileChangeStatus(false)) {
         std::cout<<" Not able to set file change status"<<std::endl;
@@ -719,13 +839,21 @@ Status THServer::SendFrame()
 bool THServer::ReceiveTHInfo(){
 
     HeaderType htype = H_WAITING;
+    int32_t sequence = 0;
+    bool matchSequence = (clientType == TH_VIDEO) && (server_version >= TH_VERSION_PIPELINED);
     msg = {};
 
     msg.msgType = TH_FRAME_INFO;
 
+    // NV12 and gray frames land in packedFrame, only their BGR conversion is queued
+    if(clientType == TH_CAMERA){
+      msg.frameInfo.image = framePool.Acquire();
+    }
+    cv::Mat &received = (frameFormat != TH_FRAME_BGR) ? packedFrame : msg.frameInfo.image;
+
 read_image:
     if(clientType == TH_CAMERA){
-      if((htype = ss -> ReceiveImage(msg.frameInfo.image)) != H_IMAGE ) {
+      if((htype = ss -> ReceiveImage(received)) != H_IMAGE ) {
         if(htype==H_STNLD_STATUS){
           smtnUploadStatus_t stnStatus;
           if(!ss->ReceiveStnUploadStatus(&stnStatus)){
@@ -748,20 +876,26 @@ read_image:
           }
           goto read_image;
         }
+        // nothing usable in the buffer
+        msg.frameInfo.image.release();
       }
       msg.frameInfo.frameIndex = ++frameCtr;
-    }else{
+      if((frameFormat != TH_FRAME_BGR) && (htype == H_IMAGE)) {
+        THUnpackFrame(packedFrame, msg.frameInfo.image);
+      }
+    }else if(!matchSequence){
       msg.frameInfo.image = currFrame;
+      currFrame.release();
       msg.frameInfo.frameIndex = ++frameCtr;
     }
 
-    if(msg.frameInfo.image.empty()){
+    if(!matchSequence && msg.frameInfo.image.empty()){
         std::cout << "Error frame not received" << std::endl;
         return false;
     }
 
 read_processed_data:
-    if((htype = ss -> ReceiveProcessedData(msg.frameInfo.meta_data)) != H_DATA){
+    if((htype = ss -> ReceiveProcessedData(msg.frameInfo.meta_data, &sequence)) != H_DATA){
         if(htype == H_STNLD_STATUS){
           smtnUploadStatus_t stnStatus;
           if(!ss->ReceiveStnUploadStatus(&stnStatus)){
@@ -787,6 +921,20 @@ read_processed_data:
         //return false;
     }
 
+    if(matchSequence){
+      // results may arrive in any order, pair them with the frame they were computed on
+      std::map<int32_t, THInFlightFrame>::iterator frame = inFlightFrames.find(sequence);
+      if(frame == inFlightFrames.end()){
+          std::cout << "Error result for unknown frame sequence:" << sequence << std::endl;
+          return false;
+      }
+      msg.frameInfo.image = frame->second.image;
+      frame->second.image.release();
+      msg.frameInfo.frameIndex = frame->second.frameIndex;
+      inFlightFrames.erase(frame);
+      ++frameCtr;
+    }
+
     //std::cout << "Object Count:" << msg.frameInfo.meta_data.objectCount << std::endl;
     //std::cout << "Event Count: " << msg.frameInfo.meta_data.eventCount << std::endl;
 
@@ -806,7 +954,7 @@ read_processed_data:
     //    ctr++;
     //} 
     
-    THPushMessage(msg);
+    THPushMessage(std::move(msg));
     msg.frameInfo.image.release();
 
     if((clientType == TH_CAMERA) && (frameCountLimit == frameCtr)){
@@ -817,16 +965,64 @@ read_processed_data:
     return true;
 }
 
+/**
+* @brief  This function is used to convert a decoded frame to the format the client
+*         analyses, at the analysis resolution. The conversion matches the full range
+*         BGR to YUV the client used to run on every frame.
+* @param  frame, decoded BGR frame
+* @param  packed, NV12 (rows * 3/2 x cols) or gray frame to be sent
+* @return void
+*/
+void THServer::THPackFrame(const cv::Mat &frame, cv::Mat &packed)
+{
+    int rows = AnalysisImageRow;
+    int cols = AnalysisImageColumn;
+
+    cv::resize(frame, scaledFrame, cv::Size(cols, rows), 0, 0, cv::INTER_AREA);
+
+    if(frameFormat == TH_FRAME_GRAY) {
+        cv::cvtColor(scaledFrame, packed, cv::COLOR_BGR2GRAY);
+        return;
+    }
+
+    cv::cvtColor(scaledFrame, scaledFrame, cv::COLOR_BGR2YUV);
+    cv::split(scaledFrame, yuvPlanes);
+
+    packed.create(rows + rows/2, cols, CV_8UC1);
+    yuvPlanes[0].copyTo(packed.rowRange(0, rows));
+
+    // subsample the chroma and interleave it straight into the UV plane
+    cv::Mat uvPlane(rows/2, cols/2, CV_8UC2, packed.ptr(rows));
+    cv::resize(yuvPlanes[1], yuvPlanes[1], uvPlane.size(), 0, 0, cv::INTER_AREA);
+    cv::resize(yuvPlanes[2], yuvPlanes[2], uvPlane.size(), 0, 0, cv::INTER_AREA);
+    cv::merge(&yuvPlanes[1], 2, uvPlane);
+}
+
+/**
+* @brief  This function is used to convert a NV12 or gray frame from the camera to BGR
+* @param  packed, received frame
+* @param  bgr, BGR version, reuses its buffer when the size matches
+* @return void
+*/
+void THServer::THUnpackFrame(const cv::Mat &packed, cv::Mat &bgr)
+{
+    if(frameFormat == TH_FRAME_NV12) {
+        cv::cvtColor(packed, bgr, cv::COLOR_YUV2BGR_NV12);
+    } else {
+        cv::cvtColor(packed, bgr, cv::COLOR_GRAY2BGR);
+    }
+}
+
 /**
 * @brief  This function is used to push the message to processing Thread
 * @param  msg, message to posted for processing thread 
 * @return void
 */
-void THServer::THPushMessage(THMsgQueBuf msg)
+void THServer::THPushMessage(THMsgQueBuf &&msg)
 {
     {
         std::unique_lock<std::mutex> lock(msgQueueMutex);
-        msgQue.push(msg);
+        msgQue.emplace(std::move(msg));
         lock.unlock();
     }
     msgCv.notify_one();
@@ -858,83 +1054,113 @@ void THServer::RdkCTHResetObjEvtCount()
 }
 
 /**
-* @brief This function is used to process the frame for objects
-* @param frame, frame to processed
+* @brief Text printed on a frame for an event, NULL for events that are not shown
+*/
+static const char *THEventText(int eventType)
+{
+    switch(eventType)
+    {
+        case th_eSceneChange:        return "CAMERA TAMPERED";
+        case th_eLightsOn:           return "LIGHTS ON";
+        case th_eLightsOff:          return "LIGHTS OFF";
+        case th_eMotionDetected:     return "MOTION DETECTED";
+        case th_eObjectEnteredEvent: return "OBJECT ENTERED";
+        case th_eObjectExitedEvent:  return "OBJECT EXITED";
+        case th_eObjectLeftEvent:    return "OBJECT LEFT";
+        case th_eObjectLost:         return "OBJECT LOST";
+        case th_eObjectRemovedEvent: return "OBJECT REMOVED";
+        case th_eUnknownEvent:       return "UNKNOWN EVENT";
+        default:                     return NULL;
+    }
+}
+
+/**
+* @brief This function is used to hand the frame to the annotation and encoding stages.
+*        The frame is dropped from the processed video when they are behind, results
+*        keep coming in either way
+* @param frame, frame to processed, its image is taken over
 * @return 0 on success, -1 on failure.
 */
-int THServer::RdkCTHGenerateProcessedFrame(THFrameInfo frame)
+int THServer::RdkCTHGenerateProcessedFrame(THFrameInfo &frame)
 {
+    THEncodeJob job;
 
-    int temp = 0;
-    int i = 0;
-    int j = 0;
-    int tempHDCount = 0;
-    int tempUDCount = 0;
-    int tempTDCount = 0;
-    int tempVDCount = 0;
-    int tempPDCount = 0;
+    if(!outputProcessedVideo && !supportFrameDisplay)
+        return 0;
 
-    /* matrix to store color image */
-    cv::Mat fileFrameBGR = cv::Mat( frame.image.size().height, frame.image.size().width, CV_8UC4);
+    job.frameIndex = frame.frameIndex;
+    job.meta_data = frame.meta_data;
 
-    //Event 
-    int x_cord = fileFrameBGR.size().width - 200;
-    int y_cord = 20;
-    int y_cord_time = fileFrameBGR.size().height - 40;
-    cv::Point textOrgForEventCount(x_cord,y_cord);
-    
-    //memset(EventInfo, 0, EVENT_LENGTH);
-    EventInfo = "";
+    /* totals run over every frame, sampled ones included */
+    if(raw_video == false)
+        RdkCTHCountObjEvt(job);
 
-    //Time
-    cv::Point textOrgForTime(x_cord,y_cord_time);
+    if((processedFrameSample > 0) && (((frame.frameIndex - 1) % processedFrameSample) != 0))
+        return 0;
 
-    /* convert the frame to BGR format */
-    fileFrameBGR =  frame.image;
+    job.image = frame.image;
+    frame.image.release();
+    job.order = encodeOrder;
 
-    if( raw_video == true ) {
-	if(outputProcessedVideo) {
-	    g_videoWriter.write(fileFrameBGR);
-        }
-	return 0;
+    /* a new output file starts with the first frame that makes it into the queue */
+    if(pendingOpen.openFile){
+        job.openFile = true;
+        job.fileName = pendingOpen.fileName;
+        job.fourcc = pendingOpen.fourcc;
+        job.fps = pendingOpen.fps;
+        job.size = pendingOpen.size;
     }
 
-    /* process the frame to mark all the object detected */
-    int objectCounter = frame.meta_data.objectCount;
-    int eventCounter = frame.meta_data.eventCount;
+    if(!annotateQueue.TryPush(std::move(job))) {
+        if((droppedFrames++ % DROPPED_FRAMES_LOG_INTERVAL) == 0)
+            std::cout << "MAC:" << clientMAC << " Annotation is behind, " << droppedFrames << " frames left out of the processed video" << std::endl;
+        framePool.Release(job.image);
+        return -1;
+    }
+    encodeOrder++;
+    pendingOpen.openFile = false;
 
-    while(objectCounter-- > 0) {
-        cv::Point x( frame.meta_data.objects[i].lcol,frame.meta_data.objects[i].trow );
-        cv::Point y( frame.meta_data.objects[i].rcol,frame.meta_data.objects[i].brow );
+    return 0;
+}
 
-        cv::Rect rect( x, y );
-        if (frame.meta_data.objects[i].object_class == th_eOC_Human) {
-            /* Draw a rectangle on the detected human face */
-            rectangle( fileFrameBGR, rect, boxColorForHuman, BOX_THICKNESS );
+/**
+* @brief This function is used to count the objects and events of a frame into the totals
+*        printed on it. Runs on the processing thread, frames are counted in order
+* @param job, frame to be counted
+* @return None
+*/
+void THServer::RdkCTHCountObjEvt(THEncodeJob &job)
+{
+    int i = 0;
+    int tempHDCount = 0;
+    int tempTDCount = 0;
+    int tempVDCount = 0;
+    int tempPDCount = 0;
+
+    for(i = 0; i < job.meta_data.objectCount; i++) {
+        if (job.meta_data.objects[i].object_class == th_eOC_Human) {
             HDCount++;
             tempHDCount++;
-        } else if (frame.meta_data.objects[i].object_class == th_eOC_Vehicle) {
-            /* Draw a rectangle on the detected object */
-            rectangle( fileFrameBGR, rect, boxColorForVehicle, BOX_THICKNESS );
+        } else if (job.meta_data.objects[i].object_class == th_eOC_Vehicle) {
             VDCount++;
             tempVDCount++;
-        } else if (frame.meta_data.objects[i].object_class == th_eOC_Train) {
-            /* Draw a rectangle on the detected object */
-            rectangle( fileFrameBGR, rect, boxColorForTrain, BOX_THICKNESS );
+        } else if (job.meta_data.objects[i].object_class == th_eOC_Train) {
             TDCount++;
             tempTDCount++;
-        } else if (frame.meta_data.objects[i].object_class == th_eOC_Pet) {
-            /* Draw a rectangle on the detected object */
-            rectangle( fileFrameBGR, rect, boxColorForPet, BOX_THICKNESS );
+        } else if (job.meta_data.objects[i].object_class == th_eOC_Pet) {
             PDCount++;
             tempPDCount++;
         } else {
-            /* Draw a rectangle on the detected object */
-            rectangle( fileFrameBGR, rect, boxColorForUnknown, BOX_THICKNESS );
             UDCount++;
-            tempUDCount++;
         }
-        i++;
+    }
+
+    /* every detected class counts as one event */
+    EventCount += (tempHDCount > 0) + (tempVDCount > 0) + (tempTDCount > 0) + (tempPDCount > 0);
+
+    for(i = 0; i < job.meta_data.eventCount; i++) {
+        if(THEventText(job.meta_data.events[i].event_type) != NULL)
+            EventCount++;
     }
 
     /* count no. of objects */
@@ -944,157 +1170,231 @@ int THServer::RdkCTHGenerateProcessedFrame(THFrameInfo frame)
     TDString  = "Train:" + std::to_string(TDCount);
     PDString  = "Pet:" + std::to_string(PDCount);
     UDString  = "Unknown:" + std::to_string(UDCount);
+    EventString = "Total Events:" + std::to_string(EventCount);
 
-    putText(fileFrameBGR, "Events:", cv::Point(x_cord,temp*20+40), cv::FONT_HERSHEY_SIMPLEX, FONT_SCALE , textColorForEvent, TEXT_THICKNESS);
+    job.objString = OBJString;
+    job.humanString = HDString;
+    job.unknownString = UDString;
+    job.eventString = EventString;
+    return;
+}
 
-    if(tempHDCount > 0 ){
-        EventCount++;
-        temp++;
-        putText(fileFrameBGR, "HUMAN DETECTED", cv::Point(x_cord,temp*20+40), cv::FONT_HERSHEY_SIMPLEX, FONT_SCALE , textColorForEvent, TEXT_THICKNESS);
+/**
+* @brief This function is used to mark the objects and events on the frame. Only touches
+*        the job, several frames are drawn in parallel
+* @param job, frame to be marked
+* @return None
+*/
+void THServer::RdkCTHDrawProcessedFrame(THEncodeJob &job)
+{
+
+    int temp = 0;
+    int i = 0;
+    bool humanDetected = false;
+    bool vehicleDetected = false;
+    bool trainDetected = false;
+    bool petDetected = false;
+    const char *eventInfo = NULL;
+
+    /* marks are drawn straight onto the received frame */
+    cv::Mat &fileFrameBGR = job.image;
+
+    //Event 
+    int x_cord = fileFrameBGR.size().width - 200;
+    int y_cord = 20;
+    cv::Point textOrgForEventCount(x_cord,y_cord);
+
+    /* process the frame to mark all the object detected */
+    for(i = 0; i < job.meta_data.objectCount; i++) {
+        cv::Point x( job.meta_data.objects[i].lcol,job.meta_data.objects[i].trow );
+        cv::Point y( job.meta_data.objects[i].rcol,job.meta_data.objects[i].brow );
+
+        cv::Rect rect( x, y );
+        if (job.meta_data.objects[i].object_class == th_eOC_Human) {
+            /* Draw a rectangle on the detected human face */
+            rectangle( fileFrameBGR, rect, boxColorForHuman, BOX_THICKNESS );
+            humanDetected = true;
+        } else if (job.meta_data.objects[i].object_class == th_eOC_Vehicle) {
+            /* Draw a rectangle on the detected object */
+            rectangle( fileFrameBGR, rect, boxColorForVehicle, BOX_THICKNESS );
+            vehicleDetected = true;
+        } else if (job.meta_data.objects[i].object_class == th_eOC_Train) {
+            /* Draw a rectangle on the detected object */
+            rectangle( fileFrameBGR, rect, boxColorForTrain, BOX_THICKNESS );
+            trainDetected = true;
+        } else if (job.meta_data.objects[i].object_class == th_eOC_Pet) {
+            /* Draw a rectangle on the detected object */
+            rectangle( fileFrameBGR, rect, boxColorForPet, BOX_THICKNESS );
+            petDetected = true;
+        } else {
+            /* Draw a rectangle on the detected object */
+            rectangle( fileFrameBGR, rect, boxColorForUnknown, BOX_THICKNESS );
+        }
     }
 
-#if 0
-    if(tempUDCount > 0 ){
-        EventCount++;
+    putText(fileFrameBGR, "Events:", cv::Point(x_cord,temp*20+40), cv::FONT_HERSHEY_SIMPLEX, FONT_SCALE , textColorForEvent, TEXT_THICKNESS);
+
+    if(humanDetected){
         temp++;
-        putText(fileFrameBGR, "MOTION DETECTED", cv::Point(x_cord,temp*20+40), cv::FONT_HERSHEY_SIMPLEX, FONT_SCALE , textColorForEvent, TEXT_THICKNESS);
+        putText(fileFrameBGR, "HUMAN DETECTED", cv::Point(x_cord,temp*20+40), cv::FONT_HERSHEY_SIMPLEX, FONT_SCALE , textColorForEvent, TEXT_THICKNESS);
     }
-#endif
-
-    if(tempVDCount > 0 ){
-        EventCount++;
+    if(vehicleDetected){
         temp++;
         putText(fileFrameBGR, "VEHICLE DETECTED", cv::Point(x_cord,temp*20+40), cv::FONT_HERSHEY_SIMPLEX, FONT_SCALE , textColorForEvent, TEXT_THICKNESS);
     }
-    if(tempTDCount > 0 ){
-        EventCount++;
+    if(trainDetected){
         temp++;
         putText(fileFrameBGR, "TRAIN DETECTED", cv::Point(x_cord,temp*20+40), cv::FONT_HERSHEY_SIMPLEX, FONT_SCALE , textColorForEvent, TEXT_THICKNESS);
     }
-    if(tempPDCount > 0 ){
-        EventCount++;
+    if(petDetected){
         temp++;
         putText(fileFrameBGR, "PET DETECTED", cv::Point(x_cord,temp*20+40), cv::FONT_HERSHEY_SIMPLEX, FONT_SCALE , textColorForEvent, TEXT_THICKNESS);
     }
 
     /* process the frame to mark all the event detected */
-    while(eventCounter-- >0) {
-        switch(frame.meta_data.events[j].event_type)
-        {
-            case th_eSceneChange:
-                EventCount++;
-                temp++;
-                //sprintf(EventInfo, "%s", "CAMERA TAMPERED");
-                EventInfo = "CAMERA TAMPERED";
-                putText(fileFrameBGR, EventInfo, cv::Point(x_cord,temp*20+40), cv::FONT_HERSHEY_SIMPLEX, FONT_SCALE , textColorForEvent, TEXT_THICKNESS);
-            break;
+    for(i = 0; i < job.meta_data.eventCount; i++) {
+        if((eventInfo = THEventText(job.meta_data.events[i].event_type)) == NULL)
+            continue;
 
-            case th_eLightsOn:
-                EventCount++;
-                temp++;
-                //sprintf(EventInfo, "%s", "LIGHTS ON");
-                EventInfo = "LIGHTS ON";
-                putText(fileFrameBGR, EventInfo, cv::Point(x_cord,temp*20+40), cv::FONT_HERSHEY_SIMPLEX, FONT_SCALE , textColorForEvent, TEXT_THICKNESS);
-            break;
+        temp++;
+        putText(fileFrameBGR, eventInfo, cv::Point(x_cord,temp*20+40), cv::FONT_HERSHEY_SIMPLEX, FONT_SCALE , textColorForEvent, TEXT_THICKNESS);
 
-            case th_eLightsOff:
-                EventCount++;
+        if(job.meta_data.events[i].event_type == th_eMotionDetected) {
+            if(job.meta_data.isMotionInsideROI) {
                 temp++;
-                //sprintf(EventInfo, "%s", "LIGHTS OFF");
-                EventInfo = "LIGHTS OFF";
-                putText(fileFrameBGR, EventInfo, cv::Point(x_cord,temp*20+40), cv::FONT_HERSHEY_SIMPLEX, FONT_SCALE , textColorForEvent, TEXT_THICKNESS);
-            break;
-
-            case th_eMotionDetected:
-                EventCount++;
+                putText(fileFrameBGR, "Inside ROI", cv::Point(x_cord,temp*20+40), cv::FONT_HERSHEY_SIMPLEX, FONT_SCALE , textColorForROIMotion, TEXT_THICKNESS);
+            }
+            if(job.meta_data.isMotionInsideDOI) {
                 temp++;
-                //sprintf(EventInfo, "%s", "MOTION DETECTED");
-                EventInfo = "MOTION DETECTED";
-                putText(fileFrameBGR, EventInfo, cv::Point(x_cord,temp*20+40), cv::FONT_HERSHEY_SIMPLEX, FONT_SCALE , textColorForEvent, TEXT_THICKNESS);
+                putText(fileFrameBGR, "Inside DOI", cv::Point(x_cord,temp*20+40), cv::FONT_HERSHEY_SIMPLEX, FONT_SCALE , textColorForDOIMotion, TEXT_THICKNESS);
+            }
+        }
+    }
 
-                if(frame.meta_data.isMotionInsideROI) {
-                    temp++;
-                    putText(fileFrameBGR, "Inside ROI", cv::Point(x_cord,temp*20+40), cv::FONT_HERSHEY_SIMPLEX, FONT_SCALE , textColorForROIMotion, TEXT_THICKNESS);
-                }
-                if(frame.meta_data.isMotionInsideDOI) {
-                    temp++;
-                    putText(fileFrameBGR, "Inside DOI", cv::Point(x_cord,temp*20+40), cv::FONT_HERSHEY_SIMPLEX, FONT_SCALE , textColorForDOIMotion, TEXT_THICKNESS);
-                }
+    /* Provide all the information regarding objects and events on frame */
+    putText(fileFrameBGR, job.objString, textOrgForObj, cv::FONT_HERSHEY_SIMPLEX, FONT_SCALE , textColorForObj, TEXT_THICKNESS);
+    putText(fileFrameBGR, job.humanString, textOrgForHuman, cv::FONT_HERSHEY_SIMPLEX, FONT_SCALE , textColorForHuman, TEXT_THICKNESS);
+    putText(fileFrameBGR, job.unknownString, textOrgForVehicle, cv::FONT_HERSHEY_SIMPLEX, FONT_SCALE , textColorForUnknown, TEXT_THICKNESS);
+    putText(fileFrameBGR, job.eventString, textOrgForEventCount, cv::FONT_HERSHEY_SIMPLEX, FONT_SCALE , textColorForEventCount, TEXT_THICKNESS);
 
+    return;
+}
 
-            break;
+/**
+* @brief This function is used to start the annotation threads and the encode thread
+* @param void
+* @return None
+*/
+void THServer::THStartEncodeStages()
+{
+    if(!outputProcessedVideo && !supportFrameDisplay)
+        return;
 
-            case th_eObjectEnteredEvent:
-                EventCount++;
-                temp++;
-                //sprintf(EventInfo, "%s", "OBJECT ENTERED");
-                EventInfo = "OBJECT ENTERED";
-                putText(fileFrameBGR, EventInfo, cv::Point(x_cord,temp*20+40), cv::FONT_HERSHEY_SIMPLEX, FONT_SCALE , textColorForEvent, TEXT_THICKNESS);
-            break;
+    for(int i = 0; i < annotationThreads; i++){
+        annotateThreads.push_back(std::thread(&THServer::THAnnotateThreadFunc, this));
+    }
+    encodeThread = std::thread(&THServer::THEncodeThreadFunc, this);
+    return;
+}
 
-            case th_eObjectExitedEvent:
-                EventCount++;
-                temp++;
-                //sprintf(EventInfo, "%s", "OBJECT EXITED");
-                EventInfo = "OBJECT EXITED";
-                putText(fileFrameBGR, EventInfo, cv::Point(x_cord,temp*20+40), cv::FONT_HERSHEY_SIMPLEX, FONT_SCALE , textColorForEvent, TEXT_THICKNESS);
-            break;
+/**
+* @brief This function is used to stop the stages once the queued frames are written
+* @param void
+* @return None
+*/
+void THServer::THStopEncodeStages()
+{
+    annotateQueue.Close();
+    for(size_t i = 0; i < annotateThreads.size(); i++){
+        annotateThreads[i].join();
+    }
+    annotateThreads.clear();
 
-            case th_eObjectLeftEvent:
-                EventCount++;
-                temp++;
-                //sprintf(EventInfo, "%s", "OBJECT LEFT");
-                EventInfo = "OBJECT LEFT";
-                putText(fileFrameBGR, EventInfo, cv::Point(x_cord,temp*20+40), cv::FONT_HERSHEY_SIMPLEX, FONT_SCALE , textColorForEvent, TEXT_THICKNESS);
-            break;
+    encodeQueue.Close();
+    if(encodeThread.joinable())
+        encodeThread.join();
+    return;
+}
 
-            case th_eObjectLost:
-                EventCount++;
-                temp++;
-                //sprintf(EventInfo, "%s", "OBJECT LOST");
-                EventInfo = "OBJECT LOST";
-                putText(fileFrameBGR, EventInfo, cv::Point(x_cord,temp*20+40), cv::FONT_HERSHEY_SIMPLEX, FONT_SCALE , textColorForEvent, TEXT_THICKNESS);
-            break;
+/**
+* @brief Annotation thread, marks the queued frames and passes them on to the encode thread
+* @param void
+* @return None
+*/
+void THServer::THAnnotateThreadFunc()
+{
+    THEncodeJob job;
 
-            case th_eObjectRemovedEvent:
-                EventCount++;
-                temp++;
-                //sprintf(EventInfo, "%s", "OBJECT REMOVED");
-                EventInfo = "OBJECT REMOVED";
-                putText(fileFrameBGR, EventInfo, cv::Point(x_cord,temp*20+40), cv::FONT_HERSHEY_SIMPLEX, FONT_SCALE , textColorForEvent, TEXT_THICKNESS);
-            break;
-            case th_eUnknownEvent:
-                EventCount++;
-                temp++;
-                //sprintf(EventInfo, "%s", "UNKNOWN EVENT");
-                EventInfo = "UNKNOWN EVENT";
-                putText(fileFrameBGR, EventInfo, cv::Point(x_cord,temp*20+40), cv::FONT_HERSHEY_SIMPLEX, FONT_SCALE , textColorForEvent, TEXT_THICKNESS);
-            break;
-        }
-        j++;
+    while(annotateQueue.Pop(job)){
+        if(raw_video == false)
+            RdkCTHDrawProcessedFrame(job);
 
+        if(!encodeQueue.Push(std::move(job)))
+            framePool.Release(job.image);
     }
+    return;
+}
 
-    /* No. of events */
-    //sprintf(EventString, "Total Events: %d ", EventCount);
-    EventString = "Total Events:" + std::to_string(EventCount);
+/**
+* @brief Encode thread, writes the annotated frames in their original order
+* @param void
+* @return None
+*/
+void THServer::THEncodeThreadFunc()
+{
+    // annotation threads finish out of order, frames wait here for their turn
+    std::map<unsigned long, THEncodeJob> pending;
+    std::map<unsigned long, THEncodeJob>::iterator it;
+    unsigned long nextOrder = 0;
+    std::string framePrefix;
+    THEncodeJob job;
+
+    while(encodeQueue.Pop(job)){
+        unsigned long order = job.order;
+        pending.insert(std::make_pair(order, std::move(job)));
+
+        while((it = pending.find(nextOrder)) != pending.end()){
+            THEncodeJob &next = it->second;
+
+            if(next.openFile){
+                if(processedFrameSample > 0){
+                    framePrefix = next.fileName;
+                } else {
+                    g_videoWriter.open(next.fileName.c_str(), next.fourcc, next.fps, next.size, true);
+                    if(!g_videoWriter.isOpened())
+                    {
+                        std::cout << "Error while opening file" << std::endl;
+                        ExitTHThread("g_videoWriter.open");
+                    }
+                }
+            }
 
-    /* Provide all the information regarding objects and events on frame */
-    putText(fileFrameBGR, OBJString, textOrgForObj, cv::FONT_HERSHEY_SIMPLEX, FONT_SCALE , textColorForObj, TEXT_THICKNESS);
-    putText(fileFrameBGR, HDString, textOrgForHuman, cv::FONT_HERSHEY_SIMPLEX, FONT_SCALE , textColorForHuman, TEXT_THICKNESS);
-    putText(fileFrameBGR, UDString, textOrgForVehicle, cv::FONT_HERSHEY_SIMPLEX, FONT_SCALE , textColorForUnknown, TEXT_THICKNESS);
-    putText(fileFrameBGR, EventString, textOrgForEventCount, cv::FONT_HERSHEY_SIMPLEX, FONT_SCALE , textColorForEventCount, TEXT_THICKNESS);
+            if(outputProcessedVideo){
+                if(processedFrameSample > 0){
+                    cv::imwrite(framePrefix + "_" + std::to_string(next.frameIndex) + ".jpg", next.image);
+                } else if(g_videoWriter.isOpened()){
+                    g_videoWriter.write(next.image);
+                }
+            }
 
-    if(outputProcessedVideo) {
-        g_videoWriter.write(fileFrameBGR);
+            if(supportFrameDisplay){
+                cv::imshow(clientMAC, next.image);
+                cv::waitKey(30);
+            }
+            framePool.Release(next.image);
+
+            pending.erase(it);
+            nextOrder++;
+        }
     }
 
-    if(supportFrameDisplay){
-        cv::imshow(clientMAC, fileFrameBGR);
-        if(cv::waitKey(30) >= 0) return 0;
+    for(it = pending.begin(); it != pending.end(); ++it){
+        framePool.Release(it->second.image);
     }
 
-    return 0;
+    if(g_videoWriter.isOpened())
+        g_videoWriter.release();
+    return;
 }
 
 /** @brief VA Message Queue data is monitored in separate thread and following is the thread function.
@@ -1111,15 +1411,16 @@ void THServer::MessageQueueThreadFunc()
     std::string clientDir;
     std::string currVideoFile;
     std::string processedVideoFilename;
-    std::string xmlFilename;
+    std::string jsonFilename;
     std::string command;
 
+    THStartEncodeStages();
 
     while(!exitProcessLoop) {
             {
                     std::unique_lock<std::mutex> lock(msgQueueMutex);
                 msgCv.wait(lock,[this]{return !msgQue.empty();});
-                    RecvBuf = msgQue.front();
+                    RecvBuf = std::move(msgQue.front());
                     msgQue.pop();
 
                 lock.unlock();
@@ -1155,38 +1456,38 @@ void THServer::MessageQueueThreadFunc()
                     currVideoFile = RecvBuf.fileInfo.name;
 
                     processedVideoFilename =  clientDir + "/Processed_video_" + currVideoFile + ".avi";
-                    xmlFilename = clientDir + "/Processed_json_" + RecvBuf.fileInfo.name + ".xml";
+                    jsonFilename = clientDir + "/Processed_json_" + RecvBuf.fileInfo.name + ".json";
 
                     v_file_fps = RecvBuf.fileInfo.fps;
                 
-                    /* Frames are written in MJPEG format */
+                    /* The encode thread opens the writer with the first frame of the file,
+                       once the frames before are written. Never waits on the bounded queues */
                     if(outputProcessedVideo) {
+                        THEncodeJob &openJob = pendingOpen;
+                        openJob.openFile = true;
+                        openJob.fps = RecvBuf.fileInfo.fps;
+                        openJob.size = cv::Size(RecvBuf.fileInfo.cols,RecvBuf.fileInfo.rows);
+                        if(processedFrameSample > 0) {
+                            openJob.fileName = clientDir + "/Processed_frame_" + currVideoFile;
+                        } else {
+                            openJob.fileName = processedVideoFilename;
+                        }
+
                         if(encodingFormat.compare("h264") == 0) {
-                            g_videoWriter.open(processedVideoFilename.c_str(), CV_FOURCC('X','2','6','4'), 
-                            RecvBuf.fileInfo.fps, cv::Size(RecvBuf.fileInfo.cols,RecvBuf.fileInfo.rows), true);
+                            openJob.fourcc = CV_FOURCC('X','2','6','4');
                         } else if (encodingFormat.compare("hfyu") == 0) {
-                            g_videoWriter.open(processedVideoFilename.c_str(), CV_FOURCC('H','F','Y','U'),
-                            RecvBuf.fileInfo.fps, cv::Size(RecvBuf.fileInfo.cols,RecvBuf.fileInfo.rows), true);
+                            openJob.fourcc = CV_FOURCC('H','F','Y','U');
                         } else {
-                            g_videoWriter.open(processedVideoFilename.c_str(), CV_FOURCC('M','J','P','G'), 
-                            RecvBuf.fileInfo.fps, cv::Size(RecvBuf.fileInfo.cols,RecvBuf.fileInfo.rows), true);
+                            openJob.fourcc = CV_FOURCC('M','J','P','G');
                         }
                     }
 
                     //Time stamp
                     time (&file_start_time);
-                    timeinfo = localtime (&file_start_time);
+                    timeinfo = localtime_r (&file_start_time, &timeinfoBuf);
                     /* Create a JSON file */
                     //std::cout << "Calling RdkCTHPrepareJSONHeader API to create Global objects for JSON content " << std::endl;
-                    RdkCTHPrepareJSONHeader(xmlFilename.c_str(), timeinfo);
-
-                    if(outputProcessedVideo) {
-                        if(!g_videoWriter.isOpened())
-                        {
-                            std::cout << "Error while opening file" << std::endl;
-                            ExitTHThread("g_videoWriter.open");
-                        }
-                    }
+                    RdkCTHPrepareJSONHeader(jsonFilename.c_str(), timeinfo);
 
                     frameNum = RecvBuf.fileInfo.frameTotal;
 
@@ -1206,6 +1507,7 @@ void THServer::MessageQueueThreadFunc()
                     if(frameNum > RecvBuf.frameInfo.frameIndex)
                         std::cout << "MAC:" << clientMAC << "Processed frame " << RecvBuf.frameInfo.frameIndex << " of " << frameNum << ", For " << currVideoFile << std::endl;
 
+                    framePool.Release(RecvBuf.frameInfo.image);
                     break;
                 }
 
@@ -1214,7 +1516,7 @@ void THServer::MessageQueueThreadFunc()
 //                    else if (frameNum == RecvBuf.frameInfo.frameIndex){
                     if( !currVideoFile.empty() ) {
 
-                        RdkCTHWriteJSONInfoToFile(xmlFilename.c_str());
+                        RdkCTHWriteJSONInfoToFile();
                         std::cout << "Processing complete for " << currVideoFile << std::endl;
 
                         fwrite(currVideoFile.c_str(), sizeof(char), currVideoFile.length(), fileDesc);
@@ -1226,7 +1528,11 @@ void THServer::MessageQueueThreadFunc()
 
                 case TH_PROCESS_THREAD_EXIT:
                 {   
-                    fclose(fileDesc);
+                    // results of a file cut short are kept as well
+                    if(jsonFile)
+                        RdkCTHWriteJSONInfoToFile();
+                    if(fileDesc)
+                        fclose(fileDesc);
                     std::cout << "Exiting Process Loop" << std::endl;
                     exitProcessLoop = true;
                     break;
@@ -1238,6 +1544,9 @@ void THServer::MessageQueueThreadFunc()
             }
 	    //sleep(5);
     }
+
+    // what was handed to the stages is still written
+    THStopEncodeStages();
     return;
 }
 
@@ -1279,39 +1588,67 @@ void THServer::GetTimeStamp(char* timestamp)
 }
 
 /**
- * @brief This function is used to form json initial header
+ * @brief This function is used to open the json file of a video and write its header,
+ *        the frame records are appended to it as they come in
  * @param xml_file_name , xml file name
  * @param timeinfo , time the first frame is received
  * @return , None
  */
-void THServer::RdkCTHPrepareJSONHeader(const char * xml_filename ,struct tm * timeinfo)
+void THServer::RdkCTHPrepareJSONHeader(const char * json_filename ,struct tm * timeinfo)
 {
 
         char time_str[STR_LENGTH] = {0};
-        cJSON * json_file_obj;
-        g_json_message = cJSON_CreateObject();
+        char *str = NULL;
+        cJSON * json_header;
+
+        if(jsonFile != NULL)
+                RdkCTHWriteJSONInfoToFile();
 
-        json_file_obj = cJSON_CreateString(xml_filename);
-        if (( NULL != g_json_message ) && ( NULL != json_file_obj ))
+        json_header = cJSON_CreateObject();
+        if ( NULL == json_header )
         {
-                //RDK_LOG( RDK_LOG_INFO,"before adding json infor:%s:%s:%u: \n", json_file_obj->valuestring, json_file_obj->string , json_file_obj->type );
+                std::cout << "could not allocate json object \n";
+                return;
+        }
 
-                cJSON_AddItemToObject( g_json_message, JSON_FILENAME , json_file_obj);
+        cJSON_AddStringToObject( json_header, JSON_FILENAME , json_filename);
+        strftime (time_str , STR_LENGTH ,"%m/%d/%Y: %H:%M:%S:",timeinfo);
+        cJSON_AddStringToObject( json_header , JSON_FILE_TIMESTAMP , time_str);
 
-                //RDK_LOG( RDK_LOG_INFO,"before adding json infor:%s:%s:%u: \n", json_file_obj->valuestring, json_file_obj->string , json_file_obj->type );
-                strftime (time_str , STR_LENGTH ,"%m/%d/%Y: %H:%M:%S:",timeinfo);
+        str = cJSON_PrintUnformatted(json_header);
+        cJSON_Delete(json_header);
+        if ( NULL == str )
+        {
+                std::cout << "could not allocate json object \n";
+                return;
+        }
 
-                cJSON_AddStringToObject( g_json_message , JSON_FILE_TIMESTAMP , time_str);
+        jsonFile = fopen(json_filename ,"w");
+        if ( NULL == jsonFile )
+        {
+                std::cout << " could not open file" << json_filename << std::endl;
+                free(str);
+                return;
+        }
+        setvbuf(jsonFile, NULL, _IOFBF, JSON_WRITE_BUFFER_SIZE);
 
+        // the header object is left open, one frame record per line follows
+        str[strlen(str) - 1] = '\0';
+        fprintf(jsonFile, "%s,\"%s\":[\n", str, OBJECT_EVENT_INFO);
+        free(str);
+        fflush(jsonFile);
+
+        jsonFirstRecord = true;
+        time(&jsonLastFlush);
 
-                g_object_event_array = cJSON_CreateArray();
-                g_delivery_result_array = cJSON_CreateArray();
-                std::cout << "Successfully allocated json object \n";
-                //g_Upload_Status_array=cJSON_CreateArray();
-        } else
         {
-             std::cout << "could not allocate json object \n";//RDK_LOG( RDK_LOG_ERROR,"could not allocate json object:%s:%d:\n",__FUNCTION__,__LINE__);
+                std::unique_lock<std::mutex> lock(jsonMutex);
+                if ( NULL != g_delivery_result_array )
+                        cJSON_Delete(g_delivery_result_array);
+                g_delivery_result_array = cJSON_CreateArray();
+                lock.unlock();
         }
+        std::cout << "Writing results to " << json_filename << std::endl;
 
         return;
 }
@@ -1327,10 +1664,10 @@ int THServer::getFileName(int fnum, char * fname)
     return 0;
 }
 
-void THServer::RdkCTHAddUploadStatusJSONFile(smtnUploadStatus_t stnStatus)
+void THServer::RdkCTHAddUploadStatusJSONFile(smtnUploadStatus_t status)
 {
     stnStatus_count++;
-    json_stnStatus = cJSON_CreateNumber(stnStatus.status);
+    lastStnStatus = status.status;
 
 }
 
@@ -1346,6 +1683,7 @@ void THServer::RdkCTHAddDeliveryJSONFile(DeliveryResult_t result)
     cJSON * person_json_array = cJSON_CreateArray();
     cJSON * json_fileName = cJSON_CreateString(fileName);
 
+    std::unique_lock<std::mutex> lock(jsonMutex);
     if ( ( NULL != person_json_array) && ( NULL != combined_json_object) && ( NULL != g_delivery_result_array )) {
 
         //cJSON_AddItemToObject(combined_json_object, TIME_STAMP  , json_frame_time_stamp);
@@ -1357,7 +1695,7 @@ void THServer::RdkCTHAddDeliveryJSONFile(DeliveryResult_t result)
 	cJSON_AddNumberToObject(combined_json_object, "mpipeProcessedframes", result.mpipeProcessedframes);
 	cJSON_AddNumberToObject(combined_json_object, "time_taken", result.time_taken);
 	cJSON_AddNumberToObject(combined_json_object, "time_waited", result.time_waited);
-	cJSON_AddItemToObject(combined_json_object, "smarthumbnail_status"  , json_stnStatus);
+	cJSON_AddNumberToObject(combined_json_object, "smarthumbnail_status", lastStnStatus);
     cJSON * json_stnStatus_count = cJSON_CreateNumber(stnStatus_count);
     cJSON_AddItemToObject(combined_json_object, "smarthumbnail_UploadCount"  , json_stnStatus_count);
 
@@ -1429,7 +1767,7 @@ void THServer::RdkCTHAddDeliveryJSONFile(DeliveryResult_t result)
  * @param frame, frame information (objects and event detected) 
  * @return , None
  */
-void THServer::RdkCTHAddJSONInfo(THFrameInfo frame)
+void THServer::RdkCTHAddJSONInfo(const THFrameInfo &frame)
 {
     char time_str[STR_LENGTH] = {0};
     int i;
@@ -1447,7 +1785,7 @@ void THServer::RdkCTHAddJSONInfo(THFrameInfo frame)
     cJSON * json_doi_motion = cJSON_CreateString( (frame.meta_data.isMotionInsideDOI == true) ? "true" : "false" );
 
     if ( ( NULL != object_json_array) && ( NULL != event_json_array ) &&
-        ( NULL != combined_json_object) && ( NULL != g_object_event_array )) {
+        ( NULL != combined_json_object) && ( NULL != jsonFile )) {
 
         cJSON_AddNumberToObject(combined_json_object, FRAME_COUNTER, frame.frameIndex);
         cJSON_AddItemToObject(combined_json_object, OBJECT_INFO  , object_json_array);
@@ -1486,7 +1824,21 @@ void THServer::RdkCTHAddJSONInfo(THFrameInfo frame)
             }
             i++ ;
         }
-        cJSON_AddItemToArray( g_object_event_array , combined_json_object  );
+
+        // written right away, nothing of the frame is kept in memory
+        char *str = cJSON_PrintUnformatted(combined_json_object);
+        cJSON_Delete(combined_json_object);
+        if ( NULL != str ) {
+            fprintf(jsonFile, "%s%s", jsonFirstRecord ? "" : ",\n", str);
+            jsonFirstRecord = false;
+            free(str);
+        }
+
+        time (&timestamp);
+        if ( difftime(timestamp, jsonLastFlush) >= JSON_FLUSH_INTERVAL ) {
+            fflush(jsonFile);
+            jsonLastFlush = timestamp;
+        }
     } else {
         std::cout << "could not allocate json object \n";
     }
@@ -1494,72 +1846,69 @@ void THServer::RdkCTHAddJSONInfo(THFrameInfo frame)
 }
 
 /**
- * @brief This function is used to add json information to a file
+ * @brief This function is used to complete the json file of a video with its end time
+ *        and delivery results and close it
  * @return 0 on success, otherwise -1
  */
-int THServer::RdkCTHWriteJSONInfoToFile(const char * xml_filename)
+int THServer::RdkCTHWriteJSONInfoToFile()
 {
         char *str = NULL;
-        FILE *f_xml = NULL ;
-        int rc = 0;
-        int ret = -1 ;
+        int ret = 0;
         char time_str[STR_LENGTH] = {0};
+        cJSON * json_trailer;
 
 
-        if ( ( NULL == g_json_message ) || ( NULL == g_object_event_array ) || ( NULL == g_delivery_result_array ))
+        if ( NULL == jsonFile )
         {
-                std::cout << "json object is null" << std::endl;
-                ret = -1;
-        } else
-        {
-                //Time stamp
-                time (&timestamp);
-                timeinfo = localtime (&timestamp);
+                std::cout << "json file is not open" << std::endl;
+                return -1;
+        }
 
-		if(g_json_message == NULL) {
-			g_json_message = cJSON_CreateObject();
-			std::cout << "Creating g_json_message object here \n";
-		}
+        //Time stamp
+        time (&timestamp);
+        timeinfo = localtime_r (&timestamp, &timeinfoBuf);
 
+        json_trailer = cJSON_CreateObject();
+        if ( NULL != json_trailer )
+        {
                 strftime (time_str , STR_LENGTH ,"%m/%d/%Y: %H:%M:%S:",timeinfo);
-                cJSON_AddStringToObject( g_json_message, JSON_FILE_END_TIMESTAMP , time_str);
+                cJSON_AddStringToObject( json_trailer, JSON_FILE_END_TIMESTAMP , time_str);
 
                 double time_diff = difftime(timestamp,file_start_time);
 		memset(time_str, 0, sizeof(time_str));
 		sprintf(time_str, "%dm %ds",(int) time_diff/60, (int)fmod(time_diff, 60));
                 printf("Time taken to process: %s", time_str);
 
-                cJSON_AddStringToObject( g_json_message, JSON_FILE_PROCESS_TIME, time_str);
-                cJSON_AddItemToObject(g_json_message, OBJECT_EVENT_INFO , g_object_event_array );
-                cJSON_AddItemToObject(g_json_message, DELIVERY_RESULTS_INFO , g_delivery_result_array );
-                str = cJSON_Print(g_json_message);
-                f_xml = fopen(xml_filename ,"a+");
-                if ( (NULL != f_xml) && ( NULL != str)){
-		  std::cout << "Writing into the file \n";
-                  rc = fwrite(str , 1 , strlen(str),f_xml);
-                  if ( EOF == rc ){
-                    printf( " xml file fputs error ,%s rc:%d:line:%d:\n",xml_filename,rc,__LINE__);
-                    rc = fclose(f_xml);
-                    ret = -1;
-                    } else{
-                      rc = fclose(f_xml);
-                      sync();
-                    }
-                    if (str != NULL){
-                      std::cout << "Deleting the string Object \n";
-                      free(str);
-                      str = NULL;
-                    }
-                    if (g_json_message != NULL){
-                      std::cout << "Deleting the g_json_message Object \n";
-                      cJSON_Delete(g_json_message);
-                      g_json_message = NULL;
-                    }
-                } else {
-			std::cout << " could not open file" << xml_filename << std::endl;
-			ret = -1;
+                cJSON_AddStringToObject( json_trailer, JSON_FILE_PROCESS_TIME, time_str);
+                {
+                        std::unique_lock<std::mutex> lock(jsonMutex);
+                        if ( NULL != g_delivery_result_array ) {
+                                cJSON_AddItemToObject(json_trailer, DELIVERY_RESULTS_INFO , g_delivery_result_array );
+                                g_delivery_result_array = NULL;
+                        }
+                        lock.unlock();
                 }
+                str = cJSON_PrintUnformatted(json_trailer);
+                cJSON_Delete(json_trailer);
+        }
+
+        // close the frame array, the trailer members complete the header object
+        if ( NULL != str ) {
+                fprintf(jsonFile, "\n],%s\n", str + 1);
+                free(str);
+        } else {
+                std::cout << "could not allocate json object \n";
+                fprintf(jsonFile, "\n]}\n");
+                ret = -1;
+        }
+
+        if ( (EOF == fflush(jsonFile)) || (0 != fsync(fileno(jsonFile))) ) {
+                std::cout << "Error writing json file" << std::endl;
+                ret = -1;
         }
+        fclose(jsonFile);
+        jsonFile = NULL;
+
         return ret;
 }
 
@@ -1636,7 +1985,8 @@ void THServer::THMonitorVideoFile( )
  
     wd = inotify_add_watch( fd, srcVideoPath.c_str(), IN_CLOSE_WRITE);
 
-    while(true){
+    // checked at least every select timeout
+    while(monitorVideoFiles){
 
         ctr = 0;
 
@@ -1700,19 +2050,55 @@ void THServer::THMonitorVideoFile( )
     return;
 }
 
+/**
+* @brief  This function is used to end the session, the processing thread handles
+*         what is queued before it exits
+* @param  void
+* @return None
+*/
 void THServer::THServerStop()
 {
-    if(ss){
-        delete ss;
+    if(frameProcessThread.joinable()){
+        msg = {};
+        msg.msgType = TH_PROCESS_THREAD_EXIT;
+        THPushMessage(std::move(msg));
+        frameProcessThread.join();
     }
 
-    if(thServerInstance){
-        delete thServerInstance;
+    if(decodeThread.joinable()){
+        {
+        std::unique_lock<std::mutex> lock(videoListMutex);
+        decodeStop = true;
+        }
+        vListCv.notify_all();
+        decodedFrames.Close();
+        decodeThread.join();
+    }
+
+    if(videoFileMonitor.joinable()){
+        monitorVideoFiles = false;
+        videoFileMonitor.join();
+    }
+
+    if(ss){
+        ss->CloseConnection();
+        delete ss;
+        ss = NULL;
     }
     return;
 }
 
 THServer::~THServer()
 {
-    system("killall THServer");
+    THServerStop();
+
+    if(jsonFile != NULL){
+        fclose(jsonFile);
+        jsonFile = NULL;
+    }
+
+    if(g_delivery_result_array != NULL){
+        cJSON_Delete(g_delivery_result_array);
+        g_delivery_result_array = NULL;
+    }
 }
@@ -23,9 +23,12 @@
 #include <fstream>
 #include <queue>
 #include <set>
+#include <map>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <chrono>
+#include <atomic>
 #include <csignal>
 #include <dirent.h>
 #include <unistd.h>
@@ -45,6 +48,8 @@
 
 #include "socket_server.hpp"
 #include "TestHarnessMsgQueue.h"
+#include "THFramePool.h"
+#include "THFrameQueue.h"
 
 typedef struct
 {
@@ -54,49 +59,59 @@ typedef struct
 } SourceFileConfig;
 
 
+/* One connected device. THSessionManager runs one instance per connection */
 class THServer
 {
 public:
     //member functions
+    THServer();
+    ~THServer();
     bool THServerInit(std::string configFilePath);
-    bool THServerStart();
+    bool THServerStart(int connDesc);
     void THServerStop();
 
     bool THProcessFrames();
 
-    void THPushMessage(THMsgQueBuf msg);
-    static THServer* THCreateServerInstance();
+    void THPushMessage(THMsgQueBuf &&msg);
+    int THGetPort() const { return port; }
+    int THGetMaxSessions() const { return maxSessions; }
 
 private:
+    struct THEncodeJob;
 
-    THServer();
-    ~THServer();
     bool ReceiveTHInfo();
     Status SendFrame();
-    int RdkCTHGenerateProcessedFrame(THFrameInfo frame);
+    int RdkCTHGenerateProcessedFrame(THFrameInfo &frame);
+    void RdkCTHCountObjEvt(THEncodeJob &job);
+    void RdkCTHDrawProcessedFrame(THEncodeJob &job);
     void MessageQueueThreadFunc();
     void THMonitorVideoFile();
-    void RdkCTHPrepareJSONHeader(const char * xml_filename ,struct tm * timeinfo);
-    void RdkCTHAddJSONInfo(THFrameInfo frame);
+    void THDecodeVideoFiles();
+    bool THReadVideoFrame(cv::Mat &image);
+    void THStartEncodeStages();
+    void THStopEncodeStages();
+    void THAnnotateThreadFunc();
+    void THEncodeThreadFunc();
+    void RdkCTHPrepareJSONHeader(const char * json_filename ,struct tm * timeinfo);
+    void RdkCTHAddJSONInfo(const THFrameInfo &frame);
     void RdkCTHAddDeliveryJSONFile(DeliveryResult_t result);
-    void RdkCTHAddUploadStatusJSONFile(smtnUploadStatus_t stnStatus);
+    void RdkCTHAddUploadStatusJSONFile(smtnUploadStatus_t status);
     int getFileName(int, char*);
-    int RdkCTHWriteJSONInfoToFile(const char * xml_filename);
+    int RdkCTHWriteJSONInfoToFile();
     void ExitTHThread(const char *s);
     void RdkCTHResetObjEvtCount();
     void GetTimeStamp(char* timestamp);
-    bool THVideoListIsEmpty();
     Status THPopulateVideoList();
     void THGetProcessedVideos();
     std::string THTrim(const std::string& str);
     void THArchiveProcessedFiles();
     bool loadSourceFileConfig(std::string fname);
-
-    //static variables
-    static THServer *thServerInstance;
+    void THPackFrame(const cv::Mat &frame, cv::Mat &packed);
+    void THUnpackFrame(const cv::Mat &packed, cv::Mat &bgr);
 
     //member variables
     int port;
+    int maxSessions;
     SocketServer *ss;
     Client clientType;
     enum ServerVersion server_version;
@@ -116,9 +131,22 @@ private:
     std::set<std::string> recurringVideos;
     std::vector<std::string> processedFileList;
 
+    // a frame decoded ahead of SendFrame, the first one of a file carries the file info
+    struct THDecodedFrame {
+        cv::Mat image;
+        bool newFile;
+        bool lastFrame;
+        std::string fileName;
+        double frameTotal;
+        double fps;
+        THDecodedFrame() : newFile(false), lastFrame(false), frameTotal(0), fps(0) {}
+    };
+
+    // vCap and decodeFrame belong to the decode thread
     cv::VideoCapture vCap;
+    cv::Mat decodeFrame;
+    THFrameQueue<THDecodedFrame> decodedFrames;
     cv::Mat currFrame;
-    cv::Mat nextFrame;
     unsigned long frameCtr;
     unsigned long frameNum;
     int fileNum;
@@ -140,8 +168,65 @@ private:
     int ImageRows;
     int ImageCols;
 
+    FrameFormat frameFormat;
+    int AnalysisImageColumn;
+    int AnalysisImageRow;
+    FrameCodec frameCodec;
+    int jpegQuality;
+    cv::Mat scaledFrame;
+    cv::Mat packedFrame;
+    std::vector<cv::Mat> yuvPlanes;
+
+    // frames sent to a pipelining device whose results are not in yet, by sequence
+    struct THInFlightFrame {
+        cv::Mat image;
+        unsigned long frameIndex;
+    };
+    std::map<int32_t, THInFlightFrame> inFlightFrames;
+    // frame buffers recycled by the processing thread
+    THFramePool framePool;
+    int frameWindow;
+    int32_t frameSequence;
+    unsigned long sentFrameCtr;
+
     std::thread frameProcessThread;
     std::thread videoFileMonitor;
+    std::thread decodeThread;
+
+    // a processed frame on its way through the annotation and encoding stages.
+    // openFile is set on the first frame of a new output file, order is the position in the output
+    struct THEncodeJob {
+        unsigned long order;
+        bool openFile;
+        std::string fileName;
+        int fourcc;
+        double fps;
+        cv::Size size;
+        int frameIndex;
+        cv::Mat image;
+        ProcessedData_t meta_data;
+        // object and event totals up to this frame, as printed on it
+        std::string objString;
+        std::string humanString;
+        std::string unknownString;
+        std::string eventString;
+        THEncodeJob() : order(0), openFile(false), fourcc(0), fps(0), frameIndex(0) {}
+    };
+    // filled by the processing thread, drained by the annotation threads
+    THFrameQueue<THEncodeJob> annotateQueue;
+    // filled by the annotation threads, drained by the encode thread
+    THFrameQueue<THEncodeJob> encodeQueue;
+    std::vector<std::thread> annotateThreads;
+    std::thread encodeThread;
+    int annotationThreads;
+    int processedFrameSample;
+    unsigned long encodeOrder;
+    // output file to open, carried by the next frame handed to the annotation threads
+    THEncodeJob pendingOpen;
+    unsigned long droppedFrames;
+    std::atomic<bool> monitorVideoFiles;
+    // set by THServerStop under videoListMutex, the decode thread stops waiting for files
+    bool decodeStop;
     std::mutex msgQueueMutex;
     std::mutex videoListMutex;
     std::condition_variable msgCv;
@@ -164,7 +249,6 @@ private:
     double videoFPS;
 
     std::string EventString;
-    std::string EventInfo;
     int EventCount;
 
     cv::VideoWriter g_videoWriter;
@@ -173,6 +257,7 @@ private:
     time_t timestamp;
     time_t file_start_time;
     struct tm * timeinfo;
+    struct tm timeinfoBuf;
     int second;
     int minute;
     int hour;
@@ -183,12 +268,16 @@ private:
     int ResizedImageColumn;
     int ResizedImageRow;
 
-    cJSON *g_json_message;
-    cJSON *g_object_event_array;
+    // frame records are written to jsonFile as they come in, the delivery
+    // results are kept until the file ends. jsonMutex guards the latter
+    FILE *jsonFile;
+    bool jsonFirstRecord;
+    time_t jsonLastFlush;
+    std::mutex jsonMutex;
     cJSON *g_delivery_result_array;
     cJSON *g_Upload_Status_array;
-    static  cJSON * json_stnStatus;
-    static int stnStatus_count;
+    int lastStnStatus;
+    int stnStatus_count;
 
 };
 
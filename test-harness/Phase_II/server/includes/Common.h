@@ -26,7 +26,11 @@ enum ServerVersion
     TH_VERSION_1_0 = 1,
     TH_VERSION_1_2 = 2,
     TH_VERSION_1_3 = 3,
-    TH_VERSION_DOI = 4
+    TH_VERSION_DOI = 4,
+    TH_VERSION_YUV = 5,
+    TH_VERSION_CODEC = 6,
+    TH_VERSION_FRAMED = 7,
+    TH_VERSION_PIPELINED = 8
 };
 
 enum Status 
@@ -63,6 +67,26 @@ enum Client
     TH_VIDEO = 2
 };
 
+/** Layout of the frames exchanged with the client, negotiated from TH_VERSION_YUV
+  *
+  */
+enum FrameFormat
+{
+    TH_FRAME_BGR = 0,   /* decoded frame at source resolution */
+    TH_FRAME_NV12 = 1,  /* Y plane followed by interleaved UV, at analysis resolution */
+    TH_FRAME_GRAY = 2   /* Y plane only, at analysis resolution */
+};
+
+/** Compression of the frames sent to the client, negotiated from TH_VERSION_CODEC
+  *
+  */
+enum FrameCodec
+{
+    TH_CODEC_RAW = 0,   /* Mat bytes as is */
+    TH_CODEC_JPEG = 1,  /* per-frame JPEG, BGR and gray frames only */
+    TH_CODEC_LZ4 = 2    /* lossless, needs USE_LZ4=yes on both sides */
+};
+
 /** To get the Algorithm Type
   *
   */
@@ -73,6 +97,22 @@ enum AlgoType
     TH_ALG_RDKC_ENGINE = 2,
 };
 
+/** Fixed header of an image message from TH_VERSION_FRAMED, sent in one call with its payload
+  *
+  */
+typedef struct FrameHeader_s
+{
+    int32_t header_type;
+    int32_t rows;
+    int32_t cols;
+    int32_t mat_type;
+    int32_t source_rows;    /* decoded frame size, differs for NV12 and gray frames */
+    int32_t source_cols;
+    int32_t fps;            /* meaningful on H_FSTART */
+    int32_t sequence;       /* echoed with the processed data from TH_VERSION_PIPELINED */
+    int32_t payload_size;   /* bytes following the header */
+}FrameHeader_t;
+
 /** objects detected after processing
   *
   */
@@ -0,0 +1,66 @@
+/*
+* Copyright 2020 Comcast Cable Communications Management, LLC
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* SPDX-License-Identifier: Apache-2.0
+*/
+
+#ifndef _TH_FRAME_POOL_H_
+#define _TH_FRAME_POOL_H_
+
+#include <vector>
+#include <mutex>
+#include "opencv2/opencv.hpp"
+
+/* Buffers for the frames decoded from the video files and the frames received
+ * from a camera client. They are acquired by the decode thread or ReceiveTHInfo
+ * and come back from the encode thread once the frame is written, or from
+ * whichever stage drops it. vCap.read(), cv::resize() and recv fill an acquired
+ * buffer in place while the frame size stays the same. */
+class THFramePool
+{
+public:
+    explicit THFramePool(size_t capacity) : maxFree(capacity) {}
+
+    // a recycled buffer, an empty Mat for the reader to allocate when none is idle
+    cv::Mat Acquire()
+    {
+        std::unique_lock<std::mutex> lock(poolMutex);
+        if(freeFrames.empty())
+            return cv::Mat();
+
+        cv::Mat frame = freeFrames.back();
+        freeFrames.pop_back();
+        return frame;
+    }
+
+    // frame is left empty. A frame another Mat still shares is freed rather than
+    // handed out again, as is any buffer beyond the capacity
+    void Release(cv::Mat &frame)
+    {
+        if((frame.u != NULL) && (frame.u->refcount == 1)) {
+            std::unique_lock<std::mutex> lock(poolMutex);
+            if(freeFrames.size() < maxFree)
+                freeFrames.push_back(frame);
+        }
+        frame.release();
+    }
+
+private:
+    std::vector<cv::Mat> freeFrames;
+    size_t maxFree;
+    std::mutex poolMutex;
+};
+
+#endif
@@ -0,0 +1,101 @@
+/*
+* Copyright 2020 Comcast Cable Communications Management, LLC
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* SPDX-License-Identifier: Apache-2.0
+*/
+
+#ifndef _TH_FRAME_QUEUE_H_
+#define _TH_FRAME_QUEUE_H_
+
+#include <queue>
+#include <mutex>
+#include <condition_variable>
+#include <utility>
+
+/* Carries decoded frames to SendFrame and processed frames through annotation to
+ * the encoder. The decode and annotation threads use Push and wait for room, so
+ * they never run more than the capacity ahead of their consumer. The processing
+ * thread uses TryPush and skips the frame when annotation is behind, receiving
+ * from the client must not stall. Close fails the pushes and lets Pop hand out
+ * the frames already queued before it returns false. */
+template <typename T>
+class THFrameQueue
+{
+public:
+    explicit THFrameQueue(size_t capacity) : maxSize(capacity ? capacity : 1), closed(false) {}
+
+    // waits until the consumer has taken a frame, false once the stage is closed
+    bool Push(T &&item)
+    {
+        std::unique_lock<std::mutex> lock(queueMutex);
+        notFull.wait(lock, [this]{ return closed || (items.size() < maxSize); });
+        if(closed)
+            return false;
+
+        items.push(std::move(item));
+        lock.unlock();
+        notEmpty.notify_one();
+        return true;
+    }
+
+    // never waits. On false item is left alone, the caller still owns its pool
+    // buffer and releases it
+    bool TryPush(T &&item)
+    {
+        std::unique_lock<std::mutex> lock(queueMutex);
+        if(closed || (items.size() >= maxSize))
+            return false;
+
+        items.push(std::move(item));
+        lock.unlock();
+        notEmpty.notify_one();
+        return true;
+    }
+
+    // next frame in push order, waits for one, false once closed and drained
+    bool Pop(T &item)
+    {
+        std::unique_lock<std::mutex> lock(queueMutex);
+        notEmpty.wait(lock, [this]{ return closed || !items.empty(); });
+        if(items.empty())
+            return false;
+
+        item = std::move(items.front());
+        items.pop();
+        lock.unlock();
+        notFull.notify_one();
+        return true;
+    }
+
+    // the producer is done or the session ended, wakes both sides
+    void Close()
+    {
+        std::unique_lock<std::mutex> lock(queueMutex);
+        closed = true;
+        lock.unlock();
+        notEmpty.notify_all();
+        notFull.notify_all();
+    }
+
+private:
+    std::queue<T> items;
+    size_t maxSize;
+    bool closed;
+    std::mutex queueMutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+};
+
+#endif
@@ -20,6 +20,7 @@
 #define _TEST_HARNESS_MSG_QUEUE_
 
 /*************************       INCLUDES         *************************/
+#include <utility>
 #include "Common.h"
 
 enum THObjectClass
@@ -90,6 +91,13 @@ struct THFrameInfo{
     cv::Mat image;
     int frameIndex;
     ProcessedData_t meta_data;
+
+    THFrameInfo() = default;
+    // frames are moved to the processing thread, never duplicated
+    THFrameInfo(THFrameInfo &&) = default;
+    THFrameInfo& operator=(THFrameInfo &&) = default;
+    THFrameInfo(const THFrameInfo &) = delete;
+    THFrameInfo& operator=(const THFrameInfo &) = delete;
 };
 
 struct THFileInfo{
@@ -106,6 +114,10 @@ struct THMsgQueBuf{
     THClientInfo clientInfo;
     THFileInfo fileInfo;
     THFrameInfo frameInfo;
+
+    THMsgQueBuf() = default;
+    THMsgQueBuf(THMsgQueBuf &&) = default;
+    THMsgQueBuf& operator=(THMsgQueBuf &&) = default;
 };
 
 #endif
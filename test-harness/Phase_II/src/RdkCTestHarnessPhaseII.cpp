@@ -32,10 +32,15 @@ TestHarness::TestHarness() : yuvDataMemoryAllocationDone(false)
                            , imageHeight(0)
                            , clipSize(0)
                            , fileEnd(false)
+                           , frameFormat(TH_FRAME_BGR)
+                           , frameCodec(TH_CODEC_RAW)
+                           , THInfoQue(TH_UPLOAD_QUEUE_SIZE)
+                           , DeliveryInfoQue(TH_STATUS_QUEUE_SIZE)
+                           , StnUploadStatusQue(TH_STATUS_QUEUE_SIZE)
+                           , framePool(TH_FRAME_POOL_SIZE)
+                           , uploadThreadStarted(false)
 {
         memset(&frame, 0, sizeof(frame));
-        memset(&(TH_info.pData), 0, sizeof(ProcessedData_s));
-        memset(&(TH_info_recv_buf.pData), 0, sizeof(ProcessedData_s));
         memset(&VAEngineID, 0, sizeof(VAEngineID));
         memset(&mac_id, 0, sizeof(mac_id));
 
@@ -168,6 +173,7 @@ int TestHarness::RdkCTHInit()
 {
 	char hostname[MAXSIZE+1] = {0};
 	int port = 0;
+	int32_t serverVersion = TH_SERVER_VERSION;
 	configParam = (char*) malloc(MAXSIZE);
 	if( NULL == configParam ) {
         	RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.TESTHARNESS","%s(%d): Could not allocate memory for configParam. \n",__FUNCTION__, __LINE__);
@@ -248,7 +254,55 @@ int TestHarness::RdkCTHInit()
 	        return RDKC_FAILURE;
     	}
 
-        if(!client_ptr->SendServerVersion()) {
+	/* Reading Test_Harness_Frame_Format from configuration file, BGR frames when absent */
+	configParam = (char*) rdkc_envGet(TEST_HARNESS_FRAME_FORMAT);
+	if( NULL != configParam ) {
+		if( strcmp(configParam,"nv12") == 0 ) {
+			frameFormat = TH_FRAME_NV12;
+		}
+		else if( strcmp(configParam,"gray") == 0 ) {
+			frameFormat = TH_FRAME_GRAY;
+		}
+		RDK_LOG( RDK_LOG_INFO,"LOG.RDK.TESTHARNESS","%s(%d): Successfully got parameter for frame format: %d.\n", __FUNCTION__, __LINE__, frameFormat);
+	}
+
+	/* Reading Test_Harness_Frame_Codec from configuration file, raw frames when absent */
+	configParam = (char*) rdkc_envGet(TEST_HARNESS_FRAME_CODEC);
+	if( NULL != configParam ) {
+		if( strcmp(configParam,"jpeg") == 0 ) {
+			frameCodec = TH_CODEC_JPEG;
+		}
+#ifdef _HAS_LZ4_
+		else if( strcmp(configParam,"lz4") == 0 ) {
+			frameCodec = TH_CODEC_LZ4;
+		}
+#endif
+		RDK_LOG( RDK_LOG_INFO,"LOG.RDK.TESTHARNESS","%s(%d): Successfully got parameter for frame codec: %d.\n", __FUNCTION__, __LINE__, frameCodec);
+	}
+
+	/* Reading Test_Harness_Framed_Transport from configuration file, field by field messages when absent */
+	configParam = (char*) rdkc_envGet(TEST_HARNESS_FRAMED_TRANSPORT);
+	if( (NULL != configParam) && (strcmp(configParam,"true") == 0) ) {
+		serverVersion = TH_SERVER_VERSION_FRAMED;
+		RDK_LOG( RDK_LOG_INFO,"LOG.RDK.TESTHARNESS","%s(%d): Successfully got parameter for framed transport.\n", __FUNCTION__, __LINE__);
+	}
+
+	/* Reading Test_Harness_Pipelined_Frames from configuration file, pipelining needs the framed transport */
+	configParam = (char*) rdkc_envGet(TEST_HARNESS_PIPELINED_FRAMES);
+	if( (NULL != configParam) && (strcmp(configParam,"true") == 0) ) {
+		serverVersion = TH_SERVER_VERSION_PIPELINED;
+		RDK_LOG( RDK_LOG_INFO,"LOG.RDK.TESTHARNESS","%s(%d): Successfully got parameter for pipelined frames.\n", __FUNCTION__, __LINE__);
+	}
+
+        /* older servers only understand the frame format, codec and framing from the versions
+           adding them, a later version includes the handshake steps of the earlier ones */
+        if( (TH_SERVER_VERSION == serverVersion) && (TH_CODEC_RAW != frameCodec) ) {
+                serverVersion = TH_SERVER_VERSION_CODEC;
+        }
+        else if( (TH_SERVER_VERSION == serverVersion) && (TH_FRAME_BGR != frameFormat) ) {
+                serverVersion = TH_SERVER_VERSION_YUV;
+        }
+        if(!client_ptr->SendServerVersion(serverVersion)) {
                 RDK_LOG( RDK_LOG_INFO,"LOG.RDK.TESTHARNESS","%s(%d): unable to send server version.\n",__FUNCTION__, __LINE__);
                 return RDKC_FAILURE;
         }
@@ -328,7 +382,28 @@ int TestHarness::RdkCTHInit()
 		}
         }
 
-	pthread_create(&THUploadThread, NULL, ThraedFunction, this);
+	/* Server sends file frames already at the analysis resolution */
+	if( serverVersion >= TH_SERVER_VERSION_YUV ) {
+		if(!client_ptr->SendFrameFormat(frameFormat, DEFAULT_WIDTH, DEFAULT_HEIGHT)) {
+			RDK_LOG( RDK_LOG_INFO,"LOG.RDK.TESTHARNESS","%s(%d): unable to send frame format to TH Server.\n",__FUNCTION__, __LINE__);
+			return RDKC_FAILURE;
+		}
+	}
+
+	/* Server falls back to raw frames when it cannot serve the codec */
+	if( serverVersion >= TH_SERVER_VERSION_CODEC ) {
+		if(!client_ptr->NegotiateFrameCodec(frameCodec, &frameCodec)) {
+			RDK_LOG( RDK_LOG_INFO,"LOG.RDK.TESTHARNESS","%s(%d): unable to negotiate frame codec with TH Server.\n",__FUNCTION__, __LINE__);
+			return RDKC_FAILURE;
+		}
+		RDK_LOG( RDK_LOG_INFO,"LOG.RDK.TESTHARNESS","%s(%d): frame codec in use: %d.\n",__FUNCTION__, __LINE__, frameCodec);
+	}
+
+	if( 0 != pthread_create(&THUploadThread, NULL, ThraedFunction, this) ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.TESTHARNESS","%s(%d): unable to create upload thread.\n",__FUNCTION__, __LINE__);
+		return RDKC_FAILURE;
+	}
+	uploadThreadStarted = true;
 	pthread_setname_np(THUploadThread,"TH_upload_thraed");
 	return RDKC_SUCCESS;
 }
@@ -409,19 +484,19 @@ int TestHarness::RdkCTHCreatePayload(int objCount,int evtCount,th_iObject *th_ob
 	meta_data -> eventCount = eventCounter;
 	meta_data -> isMotionInsideROI = th_isMotionInsideROI;
 	meta_data -> isMotionInsideDOI = th_isMotionInsideDOI;
-
+	/* the camera frame is handed over, the queue holds its only reference */
+	cv::Mat payloadFrame;
 	if( strcmp(enableTestHarnessOnFileFeed,"false") == 0) {
-		TH_info.frame = RGBMat;
-		TH_info.pData = *meta_data;
+		payloadFrame = RGBMat;
+		RGBMat.release();
 	}
-	else if( strcmp(enableTestHarnessOnFileFeed,"true") == 0) {
-                TH_info.frame.release();
-                TH_info.pData = *meta_data;
-        }
 
-	std::unique_lock<std::mutex> lock(QueueMutex);
-	THInfoQue.push(TH_info);
-	lock.unlock();
+	/* blocks while the upload thread is behind, fails once it is gone.
+	   The server may have sent later frames already, the sequence tells which one these results are for */
+	if( !THInfoQue.Emplace(std::move(payloadFrame), *meta_data, client_ptr -> GetSequence()) ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.TESTHARNESS","%s(%d): upload queue closed\n",__FUNCTION__,__LINE__);
+		return RDKC_FAILURE;
+	}
 
 	return RDKC_SUCCESS;
 }
@@ -445,57 +520,68 @@ void* ThraedFunction(void* args)
  */
 int TestHarness::RdkCTHUploadPayload()
 {
+	int ret = RDKC_SUCCESS;
+
 	cout <<"Thread has been created"<<endl;
-	while(1) {
-		if( !THInfoQue.empty() ) {
-			std::unique_lock<std::mutex> lock(QueueMutex);
-			TH_info_recv_buf = THInfoQue.front();
-			THInfoQue.pop();
-			lock.unlock();
-			/* Send Image if the frame is from camera */
-			if( strcmp(enableTestHarnessOnFileFeed,"false") == 0) {
-				if(!client_ptr -> SendImage(TH_info_recv_buf.frame)){
-					std::cout << "Error sending image" <<  std::endl;
-				        return RDKC_FAILURE;
-        			}
-			}
-
-                        if(fileEnd) {
-                            sleep(15); //Wait for last delivery result in case of File End
-			    fileEnd = false;
-                        }
-
-			if( NULL != meta_data ) {
-                            if( !DeliveryInfoQue.empty() ) {
-                                std::unique_lock<std::mutex> lock(DQueMutex);
-                                th_deliveryResult result = DeliveryInfoQue.front();
-                                DeliveryInfoQue.pop();
-                                lock.unlock();
-			        if(!client_ptr -> SendDeliveryResult(result)) {
-				    std::cout << "Error sending delivery result"  <<  std::endl;
-				    return RDKC_FAILURE;
-			        }
-                            }
-			    if(!StnUploadStatusQue.empty()){
-				th_smtnUploadStatus stnStatus=StnUploadStatusQue.front();
-				if(!client_ptr->SendStnUploadStatus(stnStatus)){
-				    std::cout<<"Error sending smartThumbnail UploadStatus"<< std::endl;
-			    	}
-			    }
-			    if(!client_ptr -> SendTestHarnessMetaData(&TH_info_recv_buf.pData)) {
-				std::cout << "Error sending meta_data" <<  std::endl;
-				return RDKC_FAILURE;
-			    }
-			}
-			else {
-				RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.TESTHARNESS","%s(%d): Inavlid memory pointer for meta_data\n",__FUNCTION__,__LINE__);
-				return RDKC_FAILURE;
-			}
+	/* sleeps until a payload is queued, returns once the queue is closed and drained */
+	while( THInfoQue.Pop(TH_info_recv_buf) ) {
+		if( RDKC_FAILURE == (ret = RdkCTHSendPayload()) ) {
+			break;
+		}
+	}
+
+	/* nothing drains the queues anymore, release the producers */
+	THInfoQue.Close();
+	DeliveryInfoQue.Close();
+	StnUploadStatusQue.Close();
+	return ret;
+}
+
+/**
+ * @brief This function is used to send one payload
+ * @param void.
+ * @return RDKC_SUCCESS on success.
+ */
+int TestHarness::RdkCTHSendPayload()
+{
+	/* Send Image if the frame is from camera */
+	if( strcmp(enableTestHarnessOnFileFeed,"false") == 0) {
+		bool sent = client_ptr -> SendImage(TH_info_recv_buf.frame);
+		framePool.Release(TH_info_recv_buf.frame);
+		if(!sent){
+			std::cout << "Error sending image" <<  std::endl;
+			return RDKC_FAILURE;
+		}
+	}
+
+	if(fileEnd) {
+		sleep(15); //Wait for last delivery result in case of File End
+		fileEnd = false;
+	}
+
+	if( NULL == meta_data ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.TESTHARNESS","%s(%d): Inavlid memory pointer for meta_data\n",__FUNCTION__,__LINE__);
+		return RDKC_FAILURE;
+	}
+
+	/* send every status queued since the last payload */
+	th_deliveryResult result;
+	while( DeliveryInfoQue.TryPop(result) ) {
+		if(!client_ptr -> SendDeliveryResult(result)) {
+			std::cout << "Error sending delivery result"  <<  std::endl;
+			return RDKC_FAILURE;
 		}
-		else {
-			usleep(10);
+	}
+	th_smtnUploadStatus stnStatus;
+	while( StnUploadStatusQue.TryPop(stnStatus) ) {
+		if(!client_ptr->SendStnUploadStatus(stnStatus)){
+			std::cout<<"Error sending smartThumbnail UploadStatus"<< std::endl;
 		}
 	}
+	if(!client_ptr -> SendTestHarnessMetaData(&TH_info_recv_buf.pData, TH_info_recv_buf.sequence)) {
+		std::cout << "Error sending meta_data" <<  std::endl;
+		return RDKC_FAILURE;
+	}
 	return RDKC_SUCCESS;
 }
 
@@ -508,7 +594,9 @@ int TestHarness::RdkCTHUploadPayload()
 int TestHarness::RdkCTHGetFrame(th_iImage *plane0, th_iImage *plane1, int &fps)
 {
 	int image_header = RDKC_SUCCESS;
-	image_header = (client_ptr->ReceiveImage(fileFrameBGR, fps));
+	/* NV12 and gray frames are received as one single channel buffer */
+	Mat &socketFrame = (TH_FRAME_BGR == frameFormat) ? fileFrameBGR : fileFrameYUV;
+	image_header = (client_ptr->ReceiveImage(socketFrame, fps));
 
         /* TODO: The metadata of each file will be send to the camera before the first frame
          * of each file. The metadata should be send with a header H_FILE_METADATA. Inside the
@@ -518,13 +606,13 @@ int TestHarness::RdkCTHGetFrame(th_iImage *plane0, th_iImage *plane1, int &fps)
         if(image_header == H_ROI) {
             isROICoordsChanged = true;
             roiCoords = client_ptr->ReceiveROI();
-            image_header = (client_ptr->ReceiveImage(fileFrameBGR, fps));
+            image_header = (client_ptr->ReceiveImage(socketFrame, fps));
         } 
         if(image_header == H_DOI) {
 	    isDOIChanged = true;
 	    doi_enable = true;
 	    client_ptr->ReceiveDOI(doiThreshold);
-            image_header = (client_ptr->ReceiveImage(fileFrameBGR, fps));
+            image_header = (client_ptr->ReceiveImage(socketFrame, fps));
         }
 
         if((image_header == H_FSTART) && (!isROICoordsChanged)) {
@@ -544,7 +632,12 @@ int TestHarness::RdkCTHGetFrame(th_iImage *plane0, th_iImage *plane1, int &fps)
         	cout << "received image" << endl;
 
 
-	if( !fileFrameBGR.empty() ) {
+	if( TH_FRAME_BGR != frameFormat ) {
+		if( RDKC_FAILURE == RdkCTHMapFrame(plane0, plane1) ) {
+			return RDKC_FAILURE;
+		}
+	}
+	else if( !fileFrameBGR.empty() ) {
 		cvtColor(fileFrameBGR, fileFrameYUV, COLOR_BGR2YUV);
 		th_frame_width = fileFrameYUV.cols;
 		th_frame_height = fileFrameYUV.rows;
@@ -606,6 +699,22 @@ int TestHarness::RdkCTHPassFrame(th_iImage *plane0, th_iImage *plane1)
         frame.uv_height = plane1->height;
         frame.uv_width = plane1->width;
 
+	/* The upload queue may still hold the previous frames, each frame gets a buffer
+	   of its own from the pool */
+	RGBMat = framePool.Acquire();
+
+	/* NV12 or gray goes up as is and the server converts it */
+	if( TH_FRAME_BGR != frameFormat ) {
+		int y_size = frame.y_width * frame.y_height;
+		int rows = (TH_FRAME_NV12 == frameFormat) ? (frame.y_height + frame.y_height/2) : frame.y_height;
+		RGBMat.create( rows, frame.y_width, CV_8UC1 );
+		memcpy( RGBMat.data, frame.y_data, y_size );
+		if( TH_FRAME_NV12 == frameFormat ) {
+			memcpy( RGBMat.data + y_size, frame.uv_data, y_size/2 );
+		}
+		return RDKC_SUCCESS;
+	}
+
 	if(!yuvDataMemoryAllocationDone) {
 		yuvData = (unsigned char *) malloc((frame.y_size + frame.uv_size) * sizeof(unsigned char));
 		yuvDataMemoryAllocationDone = true;
@@ -621,8 +730,6 @@ int TestHarness::RdkCTHPassFrame(th_iImage *plane0, th_iImage *plane1)
 	yuvMat = cv::Mat( frame.y_height + frame.y_height/2, frame.y_width, CV_8UC1, yuvData );
 
 
-        /* matrix to store color image */
-        RGBMat = cv::Mat( frame.y_height, frame.y_width, CV_8UC4);
         /* convert the frame to BGR format */
         cv::cvtColor(yuvMat, RGBMat, CV_YUV2BGR_NV12);
 
@@ -636,6 +743,53 @@ int TestHarness::RdkCTHPassFrame(th_iImage *plane0, th_iImage *plane1)
         return RDKC_SUCCESS;
 }
 
+/**
+ * @brief This function is used to map a NV12 or gray frame from the server into the planes, no copy.
+ * @param plane0 is y plane
+ * @param plane1 is uv plane, constant for gray frames
+ * @return RDKC_SUCCESS on success.
+ */
+int TestHarness::RdkCTHMapFrame(th_iImage *plane0, th_iImage *plane1)
+{
+	int width = fileFrameYUV.cols;
+	int height = (TH_FRAME_NV12 == frameFormat) ? (fileFrameYUV.rows * 2) / 3 : fileFrameYUV.rows;
+
+	if( fileFrameYUV.empty() || (CV_8UC1 != fileFrameYUV.type()) ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.TESTHARNESS","%s(%d): Frame is empty!!!! \n", __FUNCTION__, __LINE__);
+		return RDKC_FAILURE;
+	}
+	if( (DEFAULT_WIDTH != width) || (DEFAULT_HEIGHT != height) ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.TESTHARNESS","%s(%d): Unexpected frame size %dx%d\n", __FUNCTION__, __LINE__, width, height);
+		return RDKC_FAILURE;
+	}
+
+	/* blobs are scaled back to the decoded frame */
+	th_frame_width = client_ptr->GetSourceDims().width;
+	th_frame_height = client_ptr->GetSourceDims().height;
+
+	plane0 -> data = fileFrameYUV.data;
+	plane0 -> size = width * height;
+	plane0 -> width = width;
+	plane0 -> height = height;
+	plane0 -> step = 0;
+
+	if( TH_FRAME_NV12 == frameFormat ) {
+		plane1 -> data = fileFrameYUV.ptr(height);
+	}
+	else {
+		if( (neutralUV.cols != width) || (neutralUV.rows != height/2) ) {
+			neutralUV = Mat(height/2, width, CV_8UC1, Scalar(128));
+		}
+		plane1 -> data = neutralUV.data;
+	}
+	plane1 -> size = (width * height)/2;
+	plane1 -> width = width;
+	plane1 -> height = height;
+	plane1 -> step = 0;
+
+	return RDKC_SUCCESS;
+}
+
 /**
  * @brief This function is used to rescale the blob data to original frame size.
  * @param object object structure
@@ -739,6 +893,31 @@ bool TestHarness::RdkCTHGetDOIConfig(int &threshold)
 
 int TestHarness::RdkCTHWriteFrame(std::string filename)
 {
+	/* NV12 and gray frames are written at the analysis resolution */
+	if( TH_FRAME_GRAY == frameFormat ) {
+		if( fileFrameYUV.empty() ) {
+			RDK_LOG( RDK_LOG_INFO,"LOG.RDK.TESTHARNESS","%s(%d): fileFrameYUV.empty()\n",__FUNCTION__, __LINE__);
+			return RDKC_FAILURE;
+		}
+		imwrite(filename.c_str(), fileFrameYUV);
+		return RDKC_SUCCESS;
+	}
+	if( TH_FRAME_NV12 == frameFormat ) {
+		if( fileFrameYUV.empty() ) {
+			RDK_LOG( RDK_LOG_INFO,"LOG.RDK.TESTHARNESS","%s(%d): fileFrameYUV.empty()\n",__FUNCTION__, __LINE__);
+			return RDKC_FAILURE;
+		}
+		/* the server packs full range YUV, undo it the same way */
+		int height = (fileFrameYUV.rows * 2) / 3;
+		Mat uv(height/2, fileFrameYUV.cols/2, CV_8UC2, fileFrameYUV.ptr(height));
+		split(uv, yuvChannels);
+		yuvPlanes.resize(3);
+		yuvPlanes[0] = fileFrameYUV.rowRange(0, height);
+		resize(yuvChannels[0], yuvPlanes[1], yuvPlanes[0].size());
+		resize(yuvChannels[1], yuvPlanes[2], yuvPlanes[0].size());
+		merge(yuvPlanes, fileFrameBGR);
+		cvtColor(fileFrameBGR, fileFrameBGR, COLOR_YUV2BGR);
+	}
 	if( fileFrameBGR.empty() ) {
         	RDK_LOG( RDK_LOG_INFO,"LOG.RDK.TESTHARNESS","%s(%d): fileFrameBGR.empty()\n",__FUNCTION__, __LINE__);
 		return RDKC_FAILURE;
@@ -749,16 +928,20 @@ int TestHarness::RdkCTHWriteFrame(std::string filename)
 
 int TestHarness::RdkCTHAddDeliveryResult(th_deliveryResult result)
 {
-	//Add delivery result to queue
-	std::unique_lock<std::mutex> lock(DQueMutex);
-	DeliveryInfoQue.push(result);
-	lock.unlock();
+	//Add delivery result to queue, called from the rtMessage callback so it must not wait
+	if( !DeliveryInfoQue.TryPush(result) ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.TESTHARNESS","%s(%d): status queue full or closed, delivery result dropped\n",__FUNCTION__,__LINE__);
+		return RDKC_FAILURE;
+	}
 	return RDKC_SUCCESS;
 }
 
 int TestHarness::RdkCTHAddSTNUploadStatus(th_smtnUploadStatus stnStatus)
 {
-	StnUploadStatusQue.push(stnStatus);
+	if( !StnUploadStatusQue.TryPush(stnStatus) ) {
+		RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.TESTHARNESS","%s(%d): status queue full or closed, upload status dropped\n",__FUNCTION__,__LINE__);
+		return RDKC_FAILURE;
+	}
 	return RDKC_SUCCESS;
 }
 
@@ -769,6 +952,15 @@ int TestHarness::RdkCTHAddSTNUploadStatus(th_smtnUploadStatus stnStatus)
  */
 int TestHarness::RdkCTHRelease()
 {
+	/* Let the upload thread send what is queued and exit before the socket goes away */
+	THInfoQue.Close();
+	DeliveryInfoQue.Close();
+	StnUploadStatusQue.Close();
+	if( uploadThreadStarted ) {
+		pthread_join(THUploadThread, NULL);
+		uploadThreadStarted = false;
+	}
+
 	/* Close the socket connection */
 	delete client_ptr;
 	client_ptr = NULL;
@@ -23,12 +23,83 @@
 #include <netinet/in.h>
 #include <sys/types.h> 
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/tcp.h>
+#include <errno.h>
 #include <unistd.h>
 #include <opencv2/highgui.hpp>
+#include <opencv2/imgcodecs.hpp>
+#ifdef _HAS_LZ4_
+#include <lz4.h>
+#endif
 #include "socket_common.h"
 #define BUFFLEN 250
 //#include "Packer.h"
 
+// ------------------------------------------------------------------------------------------------------------------
+// Send every buffer, sendmsg may return before a large payload is out
+static bool send_all(int fdesc, struct iovec *iov, int iovcnt)
+{
+    struct msghdr msg;
+
+    while (iovcnt > 0) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovcnt;
+
+        ssize_t bytes_sent = sendmsg(fdesc, &msg, MSG_NOSIGNAL);
+        if (bytes_sent == -1) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+
+        while ((iovcnt > 0) && ((size_t)bytes_sent >= iov->iov_len)) {
+            bytes_sent -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char*)iov->iov_base + bytes_sent;
+            iov->iov_len -= bytes_sent;
+        }
+    }
+    return true;
+}
+// ------------------------------------------------------------------------------------------------------------------
+// Receive exactly len bytes, false on error or when the peer closed
+static bool recv_all(int fdesc, void *buf, size_t len)
+{
+    size_t done = 0;
+
+    while (done < len) {
+        ssize_t bytes_recv = recv(fdesc, (char*)buf + done, len - done, MSG_WAITALL);
+        if (bytes_recv == 0)
+            return false;
+        if (bytes_recv == -1) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        done += bytes_recv;
+    }
+    return true;
+}
+// ------------------------------------------------------------------------------------------------------------------
+// Send one buffer whole
+static bool send_buffer(int fdesc, const void *buf, size_t len)
+{
+    struct iovec iov = { (void*)buf, len };
+    return send_all(fdesc, &iov, 1);
+}
+// ------------------------------------------------------------------------------------------------------------------
+// Append the raw bytes of a field, small messages are built up and sent in one call
+template <typename T>
+static void append_field(std::string &msg, const T &field)
+{
+    msg.append((const char*)&field, sizeof(field));
+}
+
 #define DOI_BITMAP_FILE "/opt/doi_bitmap.bmp"
 
 // ------------------------------------------------------------------------------------------------------------------
@@ -36,6 +107,13 @@ SocketClient::SocketClient(const char* hostname, int port) :
     hostname_ (hostname),
     port_(port),
     mat_type_(0),
+    frame_format_(TH_FRAME_BGR),
+    frame_codec_(TH_CODEC_RAW),
+    framed_(false),
+    payload_size_(0),
+    header_fps_(0),
+    sequence_(0),
+    server_version_(TH_SERVER_VERSION),
     socket_fdesc_(0) {}
 
 // ------------------------------------------------------------------------------------------------------------------
@@ -143,7 +221,7 @@ bool SocketClient::Connect() {
 bool SocketClient::SendHeader(HeaderType type)
 {
   // Send number of rows to server
-  if (send(socket_fdesc_, (char*)&type, sizeof(type), 0) == -1) {
+  if (!send_buffer(socket_fdesc_, &type, sizeof(type))) {
     perror("Error sending rows");
     return false;
   }
@@ -152,52 +230,80 @@ bool SocketClient::SendHeader(HeaderType type)
 // ------------------------------------------------------------------------------------------------------------------
 HeaderType SocketClient::ReceiveHeader() {
 
-    ssize_t bytes_sent = 0;
-    size_t dims_size = 0;
-
     int cols = 0;
     int rows = 0;
     int header_type = H_WAITING;
 
+    if (framed_) {
+        FrameHeader header;
 
-    if ((bytes_sent = recv(socket_fdesc_, (char *) &header_type, sizeof(header_type), 0)) == -1) {
+        if (!recv_all(socket_fdesc_, &header.header_type, sizeof(header.header_type))) {
+            perror("Error receiving header type");
+            return H_ERROR;
+        }
+        if (header.header_type != (int) H_IMAGE && header.header_type != (int) H_FSTART && header.header_type != (int) H_FEND)
+            return (HeaderType) header.header_type;
+
+        // rest of the fixed header
+        if (!recv_all(socket_fdesc_, (char *) &header + sizeof(header.header_type), sizeof(header) - sizeof(header.header_type))) {
+            perror("Error receiving frame header");
+            return H_ERROR;
+        }
+        image_dims_ = cv::Size2i(header.cols, header.rows);
+        mat_type_ = header.mat_type;
+        source_dims_ = cv::Size2i(header.source_cols, header.source_rows);
+        header_fps_ = header.fps;
+        sequence_ = header.sequence;
+        payload_size_ = header.payload_size;
+        return (HeaderType) header.header_type;
+    }
+
+    if (!recv_all(socket_fdesc_, &header_type, sizeof(header_type))) {
         printf("ERROR!: recv failed\n"
                        "socket_fdesc_: %d\n"
-                       "image_size: %zu\n"
-                       "bytes_sent: %zu\n", socket_fdesc_, dims_size, bytes_sent);
+                       "image_size: %zu\n", socket_fdesc_, sizeof(header_type));
         return H_ERROR;
     }
 
     if (header_type != (int) H_IMAGE && header_type != (int) H_FSTART)
         return (HeaderType) header_type;
 
-    if ((bytes_sent = recv(socket_fdesc_, (char *) &rows, sizeof(rows), 0)) == -1) {
+    if (!recv_all(socket_fdesc_, &rows, sizeof(rows))) {
         printf("ERROR!: recv failed\n"
                        "socket_fdesc_: %d\n"
-                       "image_size: %zu\n"
-                       "bytes_sent: %zu\n", socket_fdesc_, dims_size, bytes_sent);
+                       "image_size: %zu\n", socket_fdesc_, sizeof(rows));
         return H_ERROR;
     }
 
-    if ((bytes_sent = recv(socket_fdesc_, (char *) &cols, sizeof(cols), 0)) == -1) {
+    if (!recv_all(socket_fdesc_, &cols, sizeof(cols))) {
         printf("ERROR!: recv failed\n"
                        "socket_fdesc_: %d\n"
-                       "image_size: %zu\n"
-                       "bytes_sent: %zu\n", socket_fdesc_, dims_size, bytes_sent);
+                       "image_size: %zu\n", socket_fdesc_, sizeof(cols));
         return H_ERROR;
     }
 
-    if ((bytes_sent = recv(socket_fdesc_, (char *) &mat_type_, sizeof(mat_type_), 0)) == -1) {
+    if (!recv_all(socket_fdesc_, &mat_type_, sizeof(mat_type_))) {
         printf("ERROR!: recv failed\n"
                        "socket_fdesc_: %d\n"
-                       "image_size: %zu\n"
-                       "bytes_sent: %zu\n", socket_fdesc_, dims_size, bytes_sent);
+                       "image_size: %zu\n", socket_fdesc_, sizeof(mat_type_));
         return H_ERROR;
     }
 
     image_dims_ = cv::Size2i(cols, rows);
     printf("Image dimensions: [%dx%d,%d]\n", cols, rows, mat_type_);
 
+    source_dims_ = image_dims_;
+    if (frame_format_ != TH_FRAME_BGR) {
+        int source_dims[2] = {0, 0};
+        if (!recv_all(socket_fdesc_, source_dims, sizeof(source_dims))) {
+            printf("ERROR!: recv failed\n"
+                           "socket_fdesc_: %d\n"
+                           "image_size: %zu\n", socket_fdesc_, sizeof(source_dims));
+            return H_ERROR;
+        }
+        source_dims_ = cv::Size2i(source_dims[1], source_dims[0]);
+    }
+
     return (HeaderType)header_type;
 }
 // ------------------------------------------------------------------------------------------------------------------
@@ -212,7 +318,7 @@ bool SocketClient::SendResponse(const std::string& resp)
     memcpy(&out[0],&length,sizeof(int));
     memcpy(&out[sizeof(int)],&resp[0],length);
 
-    if (send(socket_fdesc_, &out[0],out.length()*sizeof(char), 0) == -1) {
+    if (!send_buffer(socket_fdesc_, &out[0], out.length()*sizeof(char))) {
         perror("Error sending response");
         return false;
     }
@@ -226,9 +332,8 @@ bool SocketClient::SendResponse(const std::string& resp)
 bool SocketClient::ReceiveResponse(std::string& resp)
 {
     int length = 0;
-    ssize_t num_bytes = recv(socket_fdesc_, (char*)&length, sizeof(int), 0);
 
-    if (num_bytes <= -1) {
+    if (!recv_all(socket_fdesc_, &length, sizeof(length)) || (length < 0)) {
         printf("ERROR!: recv failed\n");
         return false;
     }
@@ -236,14 +341,9 @@ bool SocketClient::ReceiveResponse(std::string& resp)
     resp.resize(length);
 
     // Save image data to buffer
-    for (int i = 0; i < length; i += num_bytes) {
-
-        num_bytes = recv(socket_fdesc_, &resp[i], length - i, 0);
-
-        if (num_bytes == -1) {
-            printf("ERROR!: recv failed\n");
-            return false;
-        }
+    if ((length > 0) && !recv_all(socket_fdesc_, &resp[0], length)) {
+        printf("ERROR!: recv failed\n");
+        return false;
     }
     return true;
 }
@@ -256,69 +356,80 @@ bool SocketClient::SendImage(cv::Mat& image) {
 
     int header_type = (int)H_IMAGE;
 
-    // Header
-    if (send(socket_fdesc_, (char*)&header_type, sizeof(header_type), 0) == -1) {
-        perror("Error sending header");
-        return false;
-    }
-
-    // Send number of rows to server
-    if (send(socket_fdesc_, (char*)&image.rows, sizeof(image.rows), 0) == -1) {
-        perror("Error sending rows");
-        return false;
+    cv::Mat out = image;
+    if (image.isContinuous() == false)
+    {
+        out = image.clone();
     }
 
-    // Send number of cols to server
-    if (send(socket_fdesc_, (char*)&image.cols, sizeof(image.cols), 0) == -1) {
-        perror("Error sending cols");
-        return false;
-    }
+    if (framed_) {
+        FrameHeader header;
+        struct iovec iov[2];
 
-    // Send number of cols to server
-    if (send(socket_fdesc_, (char*)&matType, sizeof(matType), 0) == -1) {
-        perror("Error sending type");
-        return false;
-    }
+        header.header_type = header_type;
+        header.rows = header.source_rows = out.rows;
+        header.cols = header.source_cols = out.cols;
+        header.mat_type = matType;
+        header.fps = 0;
+        header.sequence = 0;
+        header.payload_size = image_size;
 
+        iov[0].iov_base = &header;
+        iov[0].iov_len = sizeof(header);
+        iov[1].iov_base = out.data;
+        iov[1].iov_len = image_size;
 
-    cv::Mat out = image;
-    if (image.isContinuous() == false)
-    {
-        image.copyTo(out);
+        if (!send_all(socket_fdesc_, iov, 2)) {
+            perror("Error sending frame");
+            return false;
+        }
+        return true;
     }
 
-    int num_bytes = send(socket_fdesc_, out.data, image_size, 0);
+    // header, rows, cols, type and image data in one message
+    struct iovec iov[5];
 
-    if (num_bytes > 0)
-        return true;
+    iov[0].iov_base = &header_type;
+    iov[0].iov_len = sizeof(header_type);
+    iov[1].iov_base = &image.rows;
+    iov[1].iov_len = sizeof(image.rows);
+    iov[2].iov_base = &image.cols;
+    iov[2].iov_len = sizeof(image.cols);
+    iov[3].iov_base = &matType;
+    iov[3].iov_len = sizeof(matType);
+    iov[4].iov_base = out.data;
+    iov[4].iov_len = image_size;
 
-    return false;
+    if (!send_all(socket_fdesc_, iov, 5)) {
+        perror("Error sending image");
+        return false;
+    }
+
+    return true;
 }
 //------------------------------------------------------------------------------------------------------------------
 bool SocketClient::ReceiveDOI(int &threshold) {
 
-    ssize_t bytes_sent = 0;
     int cols = 0;
     int rows = 0;
 
     //Receiving doi threshold first
-    bytes_sent = recv(socket_fdesc_, &threshold, sizeof(threshold), 0);
-    if (bytes_sent == -1) {
+    if (!recv_all(socket_fdesc_, &threshold, sizeof(threshold))) {
         perror("Error receiving threshold");
         return false;
     }
 
-    if ((bytes_sent = recv(socket_fdesc_, (char *) &rows, sizeof(rows), 0)) == -1) {
+    if (!recv_all(socket_fdesc_, &rows, sizeof(rows))) {
         perror("Error receiving rows");
         return false;
     }
 
-    if ((bytes_sent = recv(socket_fdesc_, (char *) &cols, sizeof(cols), 0)) == -1) {
+    if (!recv_all(socket_fdesc_, &cols, sizeof(cols))) {
         perror("Error receiving cols");
         return false;
     }
 
-    if ((bytes_sent = recv(socket_fdesc_, (char *) &mat_type_, sizeof(mat_type_), 0)) == -1) {
+    if (!recv_all(socket_fdesc_, &mat_type_, sizeof(mat_type_))) {
         perror("Error receiving mat");
         return false;
     }
@@ -329,18 +440,10 @@ bool SocketClient::ReceiveDOI(int &threshold) {
     // Get image size
     int image_size = image.total() * image.elemSize();
 
-    // Allocate space for image buffer
-    uchar *sock_data = image.ptr<uchar>();
-
     // Save image data to buffer
-    for (int i = 0; i < image_size; i += bytes_sent) {
-
-        bytes_sent = recv(socket_fdesc_, sock_data + i, image_size - i, 0);
-
-        if (bytes_sent == -1) {
-            perror("Error receiving image data");
-            return false;
-        }
+    if (!recv_all(socket_fdesc_, image.ptr<uchar>(), image_size)) {
+        perror("Error receiving image data");
+        return false;
     }
 
     imwrite(DOI_BITMAP_FILE, image);
@@ -352,28 +455,30 @@ std::string SocketClient::ReceiveROI() {
     char coords[BUFFLEN+1];
     int coord_size = 0;
 
-    ssize_t num_bytes = 0;
-
     //Receiving the size of roi coordinates string first
-    num_bytes = recv(socket_fdesc_, &coord_size, sizeof(coord_size), 0);
-    if (num_bytes == -1) {
+    if (!recv_all(socket_fdesc_, &coord_size, sizeof(coord_size))) {
         printf("ERROR!: recv failed\n"
                        "socket_fdesc_: %d\n"
-                       "roi_size: 4\n"
-                       "num_bytes: %d\n", socket_fdesc_, (int)num_bytes);
+                       "roi_size: 4\n", socket_fdesc_);
+        return std::string();
     }
 
-    if( coord_size > 0 && coord_size <= BUFFLEN ) {
-        //Receive the roi coordinate string
-        num_bytes = recv(socket_fdesc_, coords, coord_size, 0);
-        if (num_bytes == -1) {
-            printf("ERROR!: recv failed\n"
-                           "socket_fdesc_: %d\n"
-                           "roi_size: %d\n"
-                           "num_bytes: %d\n", socket_fdesc_, coord_size,  (int)num_bytes);
-        }
+    if (coord_size <= 0)
+        return std::string();
+
+    //Receive the roi coordinate string, an oversized one is drained to keep the stream in step
+    std::string roi(coord_size, '\0');
+    if (!recv_all(socket_fdesc_, &roi[0], coord_size)) {
+        printf("ERROR!: recv failed\n"
+                       "socket_fdesc_: %d\n"
+                       "roi_size: %d\n", socket_fdesc_, coord_size);
+        return std::string();
     }
-    coords[BUFFLEN] = '\0';
+    if (coord_size > BUFFLEN)
+        return std::string();
+
+    memcpy(coords, roi.data(), coord_size);
+    coords[coord_size] = '\0';
     return std::string(coords);
 }
 
@@ -385,11 +490,10 @@ HeaderType SocketClient::ReceiveImage(cv::Mat &image, int &fps) {
     if (header_type != H_IMAGE && header_type != H_FSTART && header_type != H_FEND)
         return (HeaderType) header_type;
 
-    ssize_t num_bytes = 0, bytes_sent = 0;
     size_t image_size = 0;
 
-    // Reset image
-    image = cv::Mat::zeros(image_dims_, mat_type_);
+    // Reuse the buffer of the previous frame, recv overwrites all of it
+    image.create(image_dims_, mat_type_);
 
     // Get image size
     image_size = image.total() * image.elemSize();
@@ -397,34 +501,53 @@ HeaderType SocketClient::ReceiveImage(cv::Mat &image, int &fps) {
     // Allocate space for image buffer
     uchar *sock_data = image.ptr<uchar>();
 
-    if ((header_type == (int) H_FSTART) && ((bytes_sent = recv(socket_fdesc_, (char *) &fps, sizeof(fps), 0)) == -1)) {
+    if (framed_) {
+        if (header_type == H_FSTART) {
+            fps = header_fps_;
+        }
+        if (frame_codec_ != TH_CODEC_RAW) {
+            return ReceiveCompressedImage(image, payload_size_) ? header_type : H_ERROR;
+        }
+        if ((size_t)payload_size_ != image_size) {
+            printf("ERROR!: payload %d for a %zu bytes image\n", payload_size_, image_size);
+            return H_ERROR;
+        }
+        if (!recv_all(socket_fdesc_, sock_data, image_size)) {
+            perror("Error receiving image");
+            return H_ERROR;
+        }
+        return header_type;
+    }
+
+    if ((header_type == (int) H_FSTART) && !recv_all(socket_fdesc_, &fps, sizeof(fps))) {
         printf("ERROR!: recv failed\n"
                        "socket_fdesc_: %d\n"
-                       "image_size: %zu\n"
-                       "bytes_sent: %zu\n", socket_fdesc_, sizeof(fps), bytes_sent);
+                       "image_size: %zu\n", socket_fdesc_, sizeof(fps));
         return H_ERROR;
     }
 
-    // Save image data to buffer
-    for (int i = 0; i < image_size; i += num_bytes) {
-	
-        num_bytes = recv(socket_fdesc_, sock_data + i, image_size - i, 0);
-
-        if (num_bytes == -1) {
-            printf("ERROR!: recv failed\n"
-                           "i: %d\n"
-                           "socket_fdesc_: %d\n"
-                           "image_size: %d\n"
-                           "num_bytes: %d\n", i, socket_fdesc_, (int)image_size, (int)num_bytes);
+    if (frame_codec_ != TH_CODEC_RAW) {
+        int32_t encoded_size = 0;
+        if (!recv_all(socket_fdesc_, &encoded_size, sizeof(encoded_size))) {
+            perror("Error receiving encoded size");
             return H_ERROR;
         }
+        return ReceiveCompressedImage(image, encoded_size) ? header_type : H_ERROR;
+    }
+
+    // Save image data to buffer
+    if (!recv_all(socket_fdesc_, sock_data, image_size)) {
+        printf("ERROR!: recv failed\n"
+                       "socket_fdesc_: %d\n"
+                       "image_size: %d\n", socket_fdesc_, (int)image_size);
+        return H_ERROR;
     }
     return header_type;
 }
 // ------------------------------------------------------------------------------------------------------------------
 bool SocketClient::SendClientType(ClientType cType)
 {
-    if (send(socket_fdesc_, (char*)&cType, sizeof(cType), 0) == -1) {
+    if (!send_buffer(socket_fdesc_, &cType, sizeof(cType))) {
         perror("Error sending Client type");
         return false;
     }
@@ -433,28 +556,39 @@ bool SocketClient::SendClientType(ClientType cType)
 // ------------------------------------------------------------------------------------------------------------------
 bool SocketClient::SendAlgorithm(AlgorithmType alg)
 {
-    if (send(socket_fdesc_, (char*)&alg, sizeof(alg), 0) == -1) {
+    if (!send_buffer(socket_fdesc_, &alg, sizeof(alg))) {
         perror("Error sending Algorithm type");
         return false;
     }
     return true;
 }
 // ------------------------------------------------------------------------------------------------------------------
-bool SocketClient::SendServerVersion()
+bool SocketClient::SendServerVersion(int32_t version)
 {
-    int32_t serverVersion = 4;
+    int32_t serverVersion = version;
 
-    if(send(socket_fdesc_,(char*)&serverVersion,sizeof(serverVersion),0) == -1) {
+    if(!send_buffer(socket_fdesc_, &serverVersion, sizeof(serverVersion))) {
         perror("Error sending MAC ID");
         return false;
     }
 
+    server_version_ = serverVersion;
+
+    // every framed message leaves in one call, Nagle would only hold the small ones back
+    framed_ = (serverVersion >= TH_SERVER_VERSION_FRAMED);
+    if (framed_) {
+        int opt = 1;
+        if (setsockopt(socket_fdesc_, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt)) == -1) {
+            perror("setsockopt TCP_NODELAY");
+        }
+    }
+
     return true;
 }
 
 bool SocketClient::SendROIState(bool state)
 {
-    if (send(socket_fdesc_, (char*)&state, sizeof(state), 0) == -1) {
+    if (!send_buffer(socket_fdesc_, &state, sizeof(state))) {
         perror("Error sending ROI state");
         return false;
     }
@@ -463,7 +597,7 @@ bool SocketClient::SendROIState(bool state)
 
 bool SocketClient::SendDOIState(bool state)
 {
-    if (send(socket_fdesc_, (char*)&state, sizeof(state), 0) == -1) {
+    if (!send_buffer(socket_fdesc_, &state, sizeof(state))) {
         perror("Error sending DOI state");
         return false;
     }
@@ -478,7 +612,7 @@ bool SocketClient::SendMacId(const std::string& mac)
         perror("Incorrect MAC ID");
         return false;
     }
-    if(send(socket_fdesc_,&mac[0],length*sizeof(char),0) == -1) {
+    if(!send_buffer(socket_fdesc_, &mac[0], length*sizeof(char))) {
         perror("Error sending MAC ID");
         return false;
     }
@@ -486,18 +620,38 @@ bool SocketClient::SendMacId(const std::string& mac)
     return true;
 }
 
-bool SocketClient::SendTestHarnessMetaData(ProcessedData_s *data)
+bool SocketClient::SendTestHarnessMetaData(ProcessedData_s *data, int32_t sequence)
 {
     int header_type = (int)H_DATA;
 
-    // Header
-    if (send(socket_fdesc_, (char*)&header_type, sizeof(header_type), 0) == -1) {
-        perror("Error sending header");
-        return false;
+    // header, frame sequence and meta_data in one message
+    if (server_version_ >= TH_SERVER_VERSION_PIPELINED) {
+        struct iovec iov[3];
+
+        iov[0].iov_base = &header_type;
+        iov[0].iov_len = sizeof(header_type);
+        iov[1].iov_base = &sequence;
+        iov[1].iov_len = sizeof(sequence);
+        iov[2].iov_base = data;
+        iov[2].iov_len = sizeof(ProcessedData_s);
+
+        if (!send_all(socket_fdesc_, iov, 3)) {
+            perror("Error sending TestHarness meta-data");
+            return false;
+        }
+        return true;
     }
-    //meta_data
-    if(send(socket_fdesc_,(char*) data,sizeof(ProcessedData_s),0) == -1) {
-	perror("Error sending TestHarness meta-data");
+
+    // header and meta_data in one message
+    struct iovec iov[2];
+
+    iov[0].iov_base = &header_type;
+    iov[0].iov_len = sizeof(header_type);
+    iov[1].iov_base = data;
+    iov[1].iov_len = sizeof(ProcessedData_s);
+
+    if (!send_all(socket_fdesc_, iov, 2)) {
+        perror("Error sending TestHarness meta-data");
         return false;
     }
     return true;
@@ -505,23 +659,86 @@ bool SocketClient::SendTestHarnessMetaData(ProcessedData_s *data)
 
 bool SocketClient::SendImageResolution(int width, int height)
 {
-    if (send(socket_fdesc_, (char*)&width, sizeof(int), 0) == -1) {
-        perror("Error sending width");
+    int32_t resolution[2] = {width, height};
+
+    if (!send_buffer(socket_fdesc_, resolution, sizeof(resolution))) {
+        perror("Error sending resolution");
         return false;
     }
-    if (send(socket_fdesc_, (char*)&height, sizeof(int), 0) == -1) {
-        perror("Error sending height");
+    return true;
+}
+
+bool SocketClient::SendFrameFormat(FrameFormat format, int width, int height)
+{
+    int32_t format_resolution[3] = {format, width, height};
+
+    if (!send_buffer(socket_fdesc_, format_resolution, sizeof(format_resolution))) {
+        perror("Error sending frame format");
         return false;
     }
+    frame_format_ = format;
     return true;
 }
 
-bool SocketClient::ReceiveClipSize(int32_t *clipsize)
+bool SocketClient::ReceiveCompressedImage(cv::Mat &image, int32_t encoded_size) {
+
+    if (encoded_size <= 0) {
+        printf("ERROR!: invalid encoded size %d\n", encoded_size);
+        return false;
+    }
+
+    compressed_.resize(encoded_size);
+    if (!recv_all(socket_fdesc_, compressed_.data(), encoded_size)) {
+        perror("Error receiving encoded image");
+        return false;
+    }
+
+    if (frame_codec_ == TH_CODEC_JPEG) {
+        // decodes into the buffer image already holds when the size matches
+        cv::imdecode(compressed_, cv::IMREAD_UNCHANGED, &image);
+        if ((image.size() != image_dims_) || (image.type() != mat_type_)) {
+            printf("ERROR!: jpeg decode failed [%dx%d,%d]\n", image.cols, image.rows, image.type());
+            return false;
+        }
+        return true;
+    }
+
+#ifdef _HAS_LZ4_
+    if (frame_codec_ == TH_CODEC_LZ4) {
+        int image_size = image.total() * image.elemSize();
+        if (LZ4_decompress_safe((const char *) compressed_.data(), (char *) image.data, encoded_size, image_size) != image_size) {
+            printf("ERROR!: lz4 decompress failed\n");
+            return false;
+        }
+        return true;
+    }
+#endif
+
+    printf("ERROR!: unsupported codec %d\n", frame_codec_);
+    return false;
+}
+
+bool SocketClient::NegotiateFrameCodec(FrameCodec codec, FrameCodec *accepted)
 {
-    
-    ssize_t num_bytes = recv(socket_fdesc_, (char*)clipsize, sizeof(int32_t), 0);
+    int32_t requested = codec;
+    int32_t reply = TH_CODEC_RAW;
+
+    if (!send_buffer(socket_fdesc_, &requested, sizeof(requested))) {
+        perror("Error sending frame codec");
+        return false;
+    }
+    if (!recv_all(socket_fdesc_, &reply, sizeof(reply))) {
+        perror("Error receiving frame codec");
+        return false;
+    }
+    frame_codec_ = (FrameCodec)reply;
+    *accepted = frame_codec_;
+    return true;
+}
 
-    if (num_bytes <= -1) {
+bool SocketClient::ReceiveClipSize(int32_t *clipsize)
+{
+    if (!recv_all(socket_fdesc_, clipsize, sizeof(int32_t))) {
         printf("ERROR!: recv failed : clipsize\n");
         return false;
     }
@@ -530,14 +747,15 @@ bool SocketClient::ReceiveClipSize(int32_t *clipsize)
 bool SocketClient::SendStnUploadStatus(th_smtnUploadStatus stnStatus)
 {
     int header_type=(int)H_STNLD_STATUS;
-     // Header
+    struct iovec iov[2];
 
-    if (send(socket_fdesc_, (char*)&header_type, sizeof(header_type), 0) == -1) {
-        perror("Error sending header");
-        return false;
-    }
+    // Header and status in one message
+    iov[0].iov_base = &header_type;
+    iov[0].iov_len = sizeof(header_type);
+    iov[1].iov_base = &stnStatus.status;
+    iov[1].iov_len = sizeof(stnStatus.status);
 
-    if (send(socket_fdesc_, (char*)&(stnStatus.status), sizeof(stnStatus.status), 0) == -1) {
+    if (!send_all(socket_fdesc_, iov, 2)) {
         perror("Error sending stn upload status");
         return false;
     }
@@ -547,101 +765,59 @@ bool SocketClient::SendStnUploadStatus(th_smtnUploadStatus stnStatus)
 bool SocketClient::SendDeliveryResult(th_deliveryResult result)
 {
     int header_type = (int)H_DD_RESULT;
+    std::string msg;
 
     // Header
-    if (send(socket_fdesc_, (char*)&header_type, sizeof(header_type), 0) == -1) {
-        perror("Error sending header");
-        return false;
-    }
+    append_field(msg, header_type);
 
     //Send DD_result
     //Send timestamp
-/*    if (send(socket_fdesc_, (char*)&(result.timestamp), sizeof(result.timestamp), 0) == -1) {
-        perror("Error sending timestamp");
-        return false;
-    }*/
+    //append_field(msg, result.timestamp);
 
-    if (send(socket_fdesc_, (char*)&(result.fileNum), sizeof(result.fileNum), 0) == -1) {
-        perror("Error sending fileNum");
-        return false;
-    }
-
-    if (send(socket_fdesc_, (char*)&(result.frameNum), sizeof(result.frameNum), 0) == -1) {
-        perror("Error sending frameNum");
-        return false;
-    }
+    append_field(msg, result.fileNum);
+    append_field(msg, result.frameNum);
 
     //Send personcount
     int count = result.personScores.size();
-    if (send(socket_fdesc_, (char*)&count, sizeof(int), 0) == -1) {
-        perror("Error sending personcount");
-        return false;
-    }
+    append_field(msg, count);
     for(int i = 0; i< count; i++) {
         //Send bbox 
         for(int j = 0; j < 4; j++) {
-            if (send(socket_fdesc_, (char*)&(result.personBBoxes[i].at(j)), sizeof(int), 0) == -1) {
-                perror("Error sending person bbox");
-                return false;
-            }
+            append_field(msg, result.personBBoxes[i].at(j));
         }
 
         //Send personscore
-        if (send(socket_fdesc_, (char*)&(result.personScores[i]), sizeof(double), 0) == -1) {
-            perror("Error sending delivery score");
-            return false;
-        }
+        append_field(msg, result.personScores[i]);
     }
 
     //Send nonROIpersoncount
     count = result.nonROIPersonScores.size();
-    if (send(socket_fdesc_, (char*)&count, sizeof(int), 0) == -1) {
-        perror("Error sending nonROIpersoncount");
-        return false;
-    }
+    append_field(msg, count);
     for(int i = 0; i< count; i++) {
         //Send bbox 
         for(int j = 0; j < 4; j++) {
-            if (send(socket_fdesc_, (char*)&(result.nonROIPersonBBoxes[i].at(j)), sizeof(int), 0) == -1) {
-                perror("Error sending non ROI person bbox");
-                return false;
-            }
+            append_field(msg, result.nonROIPersonBBoxes[i].at(j));
         }
 
         //Send personscore
-        if (send(socket_fdesc_, (char*)&(result.nonROIPersonScores[i]), sizeof(double), 0) == -1) {
-            perror("Error sending person score");
-            return false;
-        }
+        append_field(msg, result.nonROIPersonScores[i]);
     }
     //Send deliveryscore
-    if (send(socket_fdesc_, (char*)&(result.deliveryScore), sizeof(result.deliveryScore), 0) == -1) {
-        perror("Error sending delivery score");
-        return false;
-    }
+    append_field(msg, result.deliveryScore);
     //Send maxAugscore
-    if (send(socket_fdesc_, (char*)&(result.maxAugScore), sizeof(result.maxAugScore), 0) == -1) {
-        perror("Error sending maxAugScore");
-        return false;
-    }
+    append_field(msg, result.maxAugScore);
     //Send motionTriggeredTime
-    if (send(socket_fdesc_, (char*)&(result.motionTriggeredTime), sizeof(result.motionTriggeredTime), 0) == -1) {
-        perror("Error sending motionTriggeredTime");
-        return false;
-    }
+    append_field(msg, result.motionTriggeredTime);
     //Send mpipeProcessedframes
-    if (send(socket_fdesc_, (char*)&(result.mpipeProcessedframes), sizeof(result.mpipeProcessedframes), 0) == -1) {
-        perror("Error sending mpipeProcessedframes");
-        return false;
-    }
+    append_field(msg, result.mpipeProcessedframes);
     //Send time_taken
-    if (send(socket_fdesc_, (char*)&(result.time_taken), sizeof(result.time_taken), 0) == -1) {
-        perror("Error sending time_taken");
-        return false;
-    }
+    append_field(msg, result.time_taken);
     //Send time_waited
-    if (send(socket_fdesc_, (char*)&(result.time_waited), sizeof(result.time_waited), 0) == -1) {
-        perror("Error sending time_waited");
+    append_field(msg, result.time_waited);
+
+    // the whole result in one message
+    if (!send_buffer(socket_fdesc_, msg.data(), msg.size())) {
+        perror("Error sending delivery result");
         return false;
     }
     return true;
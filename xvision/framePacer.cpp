@@ -0,0 +1,124 @@
+/*
+* Copyright 2020 Comcast Cable Communications Management, LLC
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* SPDX-License-Identifier: Apache-2.0
+*/
+
+/*************************       INCLUDES         *************************/
+#include <errno.h>
+#include "framePacer.h"
+#include "rdk_debug.h"
+
+#define NSEC_PER_SEC    1000000000LL
+
+static long long timespec_diff_ns(const struct timespec *a, const struct timespec *b)
+{
+    return ((long long)(a->tv_sec - b->tv_sec) * NSEC_PER_SEC) + (a->tv_nsec - b->tv_nsec);
+}
+
+framePacer::framePacer() :
+    period_ns(NSEC_PER_SEC / DEFAULT_ANALYSIS_FPS),
+    fps(DEFAULT_ANALYSIS_FPS),
+    policy(PACER_OVERRUN_DROP),
+    frames(0),
+    overruns(0),
+    dropped(0)
+{
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+}
+
+/** @description: Move the deadline forward
+ *  @param[in] ns : nanoseconds to add
+ *  @return: void
+ */
+void framePacer::advance(long long ns)
+{
+    long long nsec = deadline.tv_nsec + ns;
+
+    deadline.tv_sec += nsec / NSEC_PER_SEC;
+    deadline.tv_nsec = nsec % NSEC_PER_SEC;
+}
+
+/** @description: Set the target frame rate and restart the schedule
+ *  @param[in] target_fps : analysis frames per second, MIN_ANALYSIS_FPS to MAX_ANALYSIS_FPS
+ *  @param[in] overrun_policy : what to do with frames that miss their deadline
+ *  @return: XCV_SUCCESS on success, XCV_FAILURE if the rate is out of range
+ */
+int framePacer::Init(unsigned int target_fps, pacer_overrun_policy_t overrun_policy)
+{
+    if((target_fps < MIN_ANALYSIS_FPS) || (target_fps > MAX_ANALYSIS_FPS)) {
+        RDK_LOG(RDK_LOG_ERROR,"LOG.RDK.XCV","%s(%d): Invalid analysis fps %u, keeping %u\n", __FILE__, __LINE__, target_fps, fps);
+        return XCV_FAILURE;
+    }
+
+    fps = target_fps;
+    period_ns = NSEC_PER_SEC / fps;
+    policy = overrun_policy;
+    frames = 0;
+    overruns = 0;
+    dropped = 0;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+    RDK_LOG(RDK_LOG_INFO,"LOG.RDK.XCV","%s(%d): Analysis pacing %u fps, overrun policy %s\n", __FILE__, __LINE__, fps, (PACER_OVERRUN_DROP == policy) ? "drop" : "catch-up");
+    return XCV_SUCCESS;
+}
+
+/** @description: Start the schedule from now, called right before the first frame
+ *  @return: void
+ */
+void framePacer::Start()
+{
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+}
+
+/** @description: Sleep until the next frame deadline. Deadlines are absolute so
+ *                processing jitter and wall clock changes do not accumulate.
+ *  @return: void
+ */
+void framePacer::WaitNextFrame()
+{
+    struct timespec now;
+    bool sleep = true;
+
+    frames++;
+    advance(period_ns);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    long long late_ns = timespec_diff_ns(&now, &deadline);
+    if(late_ns >= 0) {
+        long long missed = late_ns / period_ns;
+
+        overruns++;
+        if((PACER_OVERRUN_CATCHUP == policy) && (missed < PACER_MAX_CATCHUP_FRAMES)) {
+            /* keep the schedule, next frame starts right away */
+            RDK_LOG(RDK_LOG_DEBUG,"LOG.RDK.XCV","%s(%d): Frame overrun by %lld us, catching up\n", __FILE__, __LINE__, late_ns / 1000);
+            sleep = false;
+        }
+        else {
+            /* skip the slots that already passed and sleep until the next one */
+            dropped += missed + 1;
+            advance((missed + 1) * period_ns);
+            RDK_LOG(RDK_LOG_DEBUG,"LOG.RDK.XCV","%s(%d): Frame overrun by %lld us, dropping %lld slots\n", __FILE__, __LINE__, late_ns / 1000, missed + 1);
+        }
+    }
+
+    if(0 == (frames % (fps * PACER_STATS_INTERVAL))) {
+        RDK_LOG(RDK_LOG_INFO,"LOG.RDK.XCV","%s(%d): Pacer stats frames:%llu overruns:%llu dropped:%llu\n", __FILE__, __LINE__, frames, overruns, dropped);
+    }
+
+    if(sleep) {
+        while(EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL));
+    }
+}
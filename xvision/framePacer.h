@@ -0,0 +1,58 @@
+/*
+* Copyright 2020 Comcast Cable Communications Management, LLC
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* SPDX-License-Identifier: Apache-2.0
+*/
+
+#ifndef _FRAMEPACER_H_
+#define _FRAMEPACER_H_
+
+#include <time.h>
+#include "va_defines.h"
+
+/* Behaviour when a frame finishes after its deadline */
+typedef enum {
+    PACER_OVERRUN_DROP = 0,     /* skip the missed slots and wait for the next one */
+    PACER_OVERRUN_CATCHUP       /* run late frames back to back until the schedule is met */
+} pacer_overrun_policy_t;
+
+class framePacer
+{
+   private:
+    struct timespec deadline;           /* CLOCK_MONOTONIC time of the next frame */
+    long long period_ns;
+    unsigned int fps;
+    pacer_overrun_policy_t policy;
+    unsigned long long frames;
+    unsigned long long overruns;        /* frames that finished after their deadline */
+    unsigned long long dropped;         /* schedule slots skipped because of overruns */
+
+    void advance(long long ns);
+
+   public:
+    framePacer();
+    /* Set the target rate and start the schedule from now */
+    int Init(unsigned int target_fps, pacer_overrun_policy_t overrun_policy);
+    /* Restart the schedule from now, the time spent after Init is not counted */
+    void Start();
+    /* Sleep until the deadline of the next frame */
+    void WaitNextFrame();
+    unsigned int GetFPS() { return fps; }
+    unsigned long long GetFrameCount() { return frames; }
+    unsigned long long GetOverrunCount() { return overruns; }
+    unsigned long long GetDroppedCount() { return dropped; }
+};
+
+#endif
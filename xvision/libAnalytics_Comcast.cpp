@@ -33,9 +33,10 @@ float xcvAnalyticsEngine_Comcast::night_sen = 0.0;
 /** @descripion: Contructor for Comcast Engine
 *
 */
-xcvAnalyticsEngine_Comcast::xcvAnalyticsEngine_Comcast():curr_day_night_mode(0), upscale_resolution(UPSCALE_RESOLUTION_DEFAULT), roiEnable(false), doiEnable(false)
+xcvAnalyticsEngine_Comcast::xcvAnalyticsEngine_Comcast():curr_day_night_mode(0), upscale_resolution(UPSCALE_RESOLUTION_DEFAULT), roiEnable(false), doiEnable(false), frameResultFields(0), motionFlags(0)
 {
     rdkc_ret = RdkC_Status::VA_FAILURE;
+    memset(&frameTime, 0, sizeof(frameTime));
 //    interface = new pluginInterface();
 //    temp_factory = CreatePluginFactoryInstance(); //creating plugin factory instance
 //    recorder = (RdkCVideoCapturer*)temp_factory->CreateVideoCapturer();
@@ -317,6 +318,10 @@ void xcvAnalyticsEngine_Comcast::ProcessFrame()
     // plane0 is Y value, plane1 is interleaved UV
     RDK_LOG(RDK_LOG_DEBUG1,"LOG.RDK.XCV","%s(%d): do detection processing...\n" ,__FILE__, __LINE__);
 
+    // results of the previous frame are stale, only the engine version is kept
+    frameResultFields &= FRAME_RESULT_ENGINE_VERSION;
+    // v1 callers never set the frame time, 0 makes the VA library sample the clock
+    RdkCVASetFrameTime(frameTime.m_l_wallSec);
     rdkc_ret = static_cast<RdkC_Status>(RdkCVAProcessFrame( plane0.data, plane0.size, plane0.height, plane0.width));
     if( VA_SUCCESS != rdkc_ret ) {
 	RDK_LOG(RDK_LOG_ERROR,"LOG.RDK.XCV","%s(%d): RdkCVAProcessFrame failed!\n",__FUNCTION__, __LINE__);
@@ -452,6 +457,7 @@ int xcvAnalyticsEngine_Comcast::reset(xcvAnalyticsEngine* engine, int frametype)
     engine->width = 0;
     engine->height = 0;
     engine->framePTS = 0;
+    memset(&frameTime, 0, sizeof(frameTime));
     engine->timeStamp = 0;
     engine->objectsCount = 0;
     engine->eventsCount = 0;
@@ -593,6 +599,137 @@ int xcvAnalyticsEngine_Comcast::GetBlobsBBoxCoords()
     return VA_SUCCESS;
 }
 
+/** @description: Get the requested results of the last processed frame. Each field is
+ *                computed at most once per frame and the engine version only once.
+ *                The matching public members are updated as well.
+ *  @param[out] result - FrameResult to fill
+ *  @param[in] fields - FRAME_RESULT_* bits to fill
+ *  @return VA_SUCCESS if all requested fields are valid, VA_FAILURE otherwise
+ */
+int xcvAnalyticsEngine_Comcast::GetFrameResult(FrameResult *result, unsigned int fields)
+{
+    unsigned int missing = fields & ~frameResultFields;
+
+    if(NULL == result) {
+        RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.XCV","%s(%d):\tFrameResult is NULL\n",__FILE__,__LINE__);
+        return VA_FAILURE;
+    }
+
+    if(missing & FRAME_RESULT_ENGINE_VERSION) {
+        if(VA_SUCCESS == xcvAnalyticsEngine_Comcast::GetEngineVersion()) {
+            frameResultFields |= FRAME_RESULT_ENGINE_VERSION;
+        }
+    }
+    if(missing & FRAME_RESULT_MOTION_SCORE) {
+        xcvAnalyticsEngine_Comcast::GetMotionScore();
+        frameResultFields |= FRAME_RESULT_MOTION_SCORE;
+    }
+    if(missing & FRAME_RESULT_OBJECT_BBOX) {
+        boundingBoxXOrd = 0;
+        boundingBoxYOrd = 0;
+        boundingBoxWidth = 0;
+        boundingBoxHeight = 0;
+        if(VA_SUCCESS == xcvAnalyticsEngine_Comcast::GetObjectBBoxCoords()) {
+            frameResultFields |= FRAME_RESULT_OBJECT_BBOX;
+        }
+    }
+    if(missing & FRAME_RESULT_BLOB_BBOXS) {
+        if(VA_SUCCESS == xcvAnalyticsEngine_Comcast::GetBlobsBBoxCoords()) {
+            frameResultFields |= FRAME_RESULT_BLOB_BBOXS;
+        }
+    }
+#ifdef _OBJ_DETECTION_
+    if(missing & FRAME_RESULT_DELIVERY_BBOX) {
+        if(VA_SUCCESS == xcvAnalyticsEngine_Comcast::GetDetectionObjectBBoxCoords()) {
+            frameResultFields |= FRAME_RESULT_DELIVERY_BBOX;
+        }
+    }
+#endif
+    if(missing & FRAME_RESULT_MOTION_FLAGS) {
+        motionFlags = 0;
+#ifdef _ROI_ENABLED_
+        if(roiEnable) {
+            motionFlags |= MOTION_FLAG_ROI_SET;
+        }
+        if(RdkCVAIsMotionInsideROI()) {
+            motionFlags |= MOTION_FLAG_INSIDE_ROI;
+        }
+#endif
+        if(doiEnable) {
+            motionFlags |= MOTION_FLAG_DOI_SET;
+        }
+        if(RdkCVAIsMotionInsideDOI()) {
+            motionFlags |= MOTION_FLAG_INSIDE_DOI;
+        }
+        frameResultFields |= FRAME_RESULT_MOTION_FLAGS;
+    }
+
+    result->fields = fields & frameResultFields;
+    result->framePTS = framePTS;
+    if(result->fields & FRAME_RESULT_ENGINE_VERSION) {
+        memcpy(result->vaEngineVersion, vaEngineVersion, sizeof(result->vaEngineVersion));
+    }
+    if(result->fields & FRAME_RESULT_MOTION_SCORE) {
+        result->motionScore = motionScore;
+    }
+    if(result->fields & FRAME_RESULT_OBJECT_BBOX) {
+        result->objectBBox[0] = boundingBoxXOrd;
+        result->objectBBox[1] = boundingBoxYOrd;
+        result->objectBBox[2] = boundingBoxWidth;
+        result->objectBBox[3] = boundingBoxHeight;
+    }
+    if(result->fields & FRAME_RESULT_BLOB_BBOXS) {
+        memcpy(result->blobBBoxs, blobBoundingBoxCoords, sizeof(result->blobBBoxs));
+    }
+#ifdef _OBJ_DETECTION_
+    if(result->fields & FRAME_RESULT_DELIVERY_BBOX) {
+        result->deliveryBBox[0] = deliveryBoundingBoxXOrd;
+        result->deliveryBBox[1] = deliveryBoundingBoxYOrd;
+        result->deliveryBBox[2] = deliveryBoundingBoxWidth;
+        result->deliveryBBox[3] = deliveryBoundingBoxHeight;
+    }
+#endif
+    if(result->fields & FRAME_RESULT_MOTION_FLAGS) {
+        result->motionFlags = motionFlags;
+    }
+
+    return (result->fields == fields) ? VA_SUCCESS : VA_FAILURE;
+}
+
+/** @description: Process a batch of frames in order. Frames go through the same
+ *                background model one after the other, the engine is left holding
+ *                the state of the last processed frame for the v1 getters.
+ *  @param[in] frames - frame descriptors
+ *  @param[out] results - FrameResult per frame, may be NULL
+ *  @param[in] count - number of frames
+ *  @param[in] fields - FRAME_RESULT_* bits to fill in results
+ *  @return number of frames processed
+ */
+int xcvAnalyticsEngine_Comcast::ProcessFrames(const xcvFrameDesc *frames, FrameResult *results, int count, unsigned int fields)
+{
+    int processed = 0;
+
+    for(processed = 0; processed < count; processed++) {
+        const xcvFrameDesc *frame = &frames[processed];
+
+        framePTS = frame->framePTS;
+        frameTime = frame->frameTime;
+        plane0 = frame->plane0;
+        plane1 = frame->plane1;
+
+        xcvAnalyticsEngine_Comcast::ProcessFrame();
+        if(VA_SUCCESS != rdkc_ret) {
+            break;
+        }
+
+        if(NULL != results) {
+            xcvAnalyticsEngine_Comcast::GetFrameResult(&results[processed], fields);
+        }
+    }
+
+    return processed;
+}
+
 #ifdef _ROI_ENABLED_
 
 /** @description: Set ROI
@@ -705,3 +842,28 @@ void DestroyEngine(xcvAnalyticsEngine* e)
     }
     return;
 }
+
+/** @descripion: Function to report the plugin ABI implemented by this library
+ *  @return XCV_ENGINE_ABI_V2
+ */
+int GetEngineABIVersion()
+{
+    return XCV_ENGINE_ABI_V2;
+}
+
+/** @descripion: Function to process a batch of frames, v2 plugin ABI
+ *  @param[in] e - engine created by CreateEngine
+ *  @param[in] frames - frame descriptors
+ *  @param[out] results - FrameResult per frame, may be NULL
+ *  @param[in] count - number of frames
+ *  @param[in] fields - FRAME_RESULT_* bits to fill in results
+ *  @return number of frames processed, XCV_FAILURE on bad arguments
+ */
+int ProcessFrames(xcvAnalyticsEngine* e, const xcvFrameDesc* frames, FrameResult* results, int count, unsigned int fields)
+{
+    if((NULL == e) || (NULL == frames) || (count <= 0)) {
+        RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.XCV","%s(%d):\tInvalid arguments\n",__FILE__,__LINE__);
+        return XCV_FAILURE;
+    }
+    return static_cast<xcvAnalyticsEngine_Comcast*>(e)->ProcessFrames(frames, results, count, fields);
+}
@@ -126,6 +126,8 @@ class xcvAnalyticsEngine_Comcast : public xcvAnalyticsEngine
       virtual int GetObjectBBoxCoords();
       /* get bounding box coordinates of individual blobs */
       virtual int GetBlobsBBoxCoords();
+      /* process a batch of frames described by frames */
+      int ProcessFrames(const xcvFrameDesc *frames, FrameResult *results, int count, unsigned int fields);
 #ifdef _ROI_ENABLED_
       /* set ROI Coordinatres */
       virtual int SetROI(std::vector<float> coords);
@@ -144,6 +146,8 @@ class xcvAnalyticsEngine_Comcast : public xcvAnalyticsEngine
       virtual bool IsMotionInsideDOI();
       /* Get if DOI set */
       virtual int IsDOISet();
+      /* get the requested results of the last processed frame */
+      virtual int GetFrameResult(FrameResult *result, unsigned int fields);
 
    private:
       enum RdkC_Status rdkc_ret;
@@ -160,10 +164,15 @@ class xcvAnalyticsEngine_Comcast : public xcvAnalyticsEngine
       int roiEnable;
 #endif
       int doiEnable;
+      unsigned int frameResultFields;     /* FRAME_RESULT_* bits already computed for the current frame */
+      int motionFlags;
+      iFrameTime frameTime;               /* time of the current frame, set from xcvFrameDesc */
 };
 
 /* Types of the class factories to create and destroy Engine */
 extern "C" xcvAnalyticsEngine* CreateEngine();
 extern "C" void DestroyEngine(xcvAnalyticsEngine* e);
+extern "C" int GetEngineABIVersion();
+extern "C" int ProcessFrames(xcvAnalyticsEngine* e, const xcvFrameDesc* frames, FrameResult* results, int count, unsigned int fields);
 
 #endif
@@ -0,0 +1,78 @@
+/*
+* Copyright 2020 Comcast Cable Communications Management, LLC
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* SPDX-License-Identifier: Apache-2.0
+*/
+
+#include <stdio.h>
+#include "vaResultShm.h"
+
+#define WAIT_TIMEOUT_MS 2000
+
+/**
+ * @brief Prints every result xvisiond publishes to the result ring
+ * @return 0 on success, 1 if the ring is not available.
+ */
+int main()
+{
+	va_shm_reader_t reader;
+	uint64_t next = 0;
+	int ret = XCV_SUCCESS;
+
+	if (XCV_SUCCESS != va_shm_reader_open(&reader)) {
+		printf("Result ring not available, is xvisiond running with ENABLE_RESULT_SHM?\n");
+		return 1;
+	}
+
+	/* start with the results published from now on */
+	next = va_shm_published(&reader);
+
+	while (XCV_FAILURE != (ret = va_shm_wait(&reader, next, WAIT_TIMEOUT_MS))) {
+		if (XCV_OTHER == ret) {
+			printf("No result for %d ms\n", WAIT_TIMEOUT_MS);
+			continue;
+		}
+
+		uint64_t published = va_shm_published(&reader);
+		/* results older than the ring are gone */
+		if (published - next > VA_RESULT_RING_SLOTS) {
+			printf("Missed %llu results\n", (unsigned long long)(published - next - VA_RESULT_RING_SLOTS));
+			next = published - VA_RESULT_RING_SLOTS;
+		}
+
+		for (; next < published; next++) {
+			uint32_t seq = 0;
+			const va_shm_result_t *result = va_shm_begin_read(&reader, next, &seq);
+			if (NULL == result) {
+				break;
+			}
+
+			uint64_t pts = result->framePTS;
+			float motion = result->motionScore;
+			uint32_t flags = result->motionFlags;
+			uint16_t objects = result->vai.num;
+
+			/* the writer got ahead of us, retry from the next wake */
+			if (!va_shm_end_read(&reader, next, seq)) {
+				break;
+			}
+			printf("result %llu pts:%llu motion:%f objects:%u inside ROI:%d\n", (unsigned long long)next,
+				(unsigned long long)pts, motion, objects, (flags & VA_RESULT_MOTION_INSIDE_ROI) ? 1 : 0);
+		}
+	}
+
+	va_shm_reader_close(&reader);
+	return 0;
+}
@@ -0,0 +1,132 @@
+/*
+* Copyright 2020 Comcast Cable Communications Management, LLC
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* SPDX-License-Identifier: Apache-2.0
+*/
+
+/*************************       INCLUDES         *************************/
+#include "shmInterface.h"
+#include "rdk_debug.h"
+
+static_assert(VA_RESULT_MAX_BLOBS == UPPER_LIMIT_BLOB_BBS, "vaResultShm.h blob count out of step with xcv.h");
+static_assert((VA_RESULT_MOTION_INSIDE_DOI == MOTION_FLAG_INSIDE_DOI) && (VA_RESULT_MOTION_DOI_SET == MOTION_FLAG_DOI_SET) &&
+              (VA_RESULT_MOTION_INSIDE_ROI == MOTION_FLAG_INSIDE_ROI) && (VA_RESULT_MOTION_ROI_SET == MOTION_FLAG_ROI_SET),
+              "vaResultShm.h motion flags out of step with xcv.h");
+
+int shmInterface::shm_fd = -1;
+va_shm_ring_t* shmInterface::ring = NULL;
+
+static int futex_wake(uint32_t *addr)
+{
+    return syscall(SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+/** @description: Create and map the result ring, called once by xvisiond
+ *  @return: XCV_SUCCESS on success, XCV_FAILURE otherwise
+ */
+int shmInterface::ResultRingInit()
+{
+    if(NULL != ring) {
+        return XCV_SUCCESS;
+    }
+
+    /* never reuse an object left behind, whoever created it may still have it mapped */
+    shm_unlink(VA_RESULT_SHM_NAME);
+    shm_fd = shm_open(VA_RESULT_SHM_NAME, O_CREAT | O_EXCL | O_RDWR, VA_RESULT_SHM_MODE);
+    if(shm_fd < 0) {
+        RDK_LOG(RDK_LOG_ERROR,"LOG.RDK.XCV","%s(%d): shm_open %s failed: %s\n", __FILE__, __LINE__, VA_RESULT_SHM_NAME, strerror(errno));
+        return XCV_FAILURE;
+    }
+
+    if(0 != ftruncate(shm_fd, sizeof(va_shm_ring_t))) {
+        RDK_LOG(RDK_LOG_ERROR,"LOG.RDK.XCV","%s(%d): ftruncate failed: %s\n", __FILE__, __LINE__, strerror(errno));
+        ResultRingClose();
+        return XCV_FAILURE;
+    }
+
+    void *addr = mmap(NULL, sizeof(va_shm_ring_t), PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+    if(MAP_FAILED == addr) {
+        RDK_LOG(RDK_LOG_ERROR,"LOG.RDK.XCV","%s(%d): mmap failed: %s\n", __FILE__, __LINE__, strerror(errno));
+        ResultRingClose();
+        return XCV_FAILURE;
+    }
+    ring = (va_shm_ring_t *)addr;
+
+    memset(ring, 0, sizeof(va_shm_ring_t));
+    ring->version = VA_RESULT_SHM_VERSION;
+    ring->slotCount = VA_RESULT_RING_SLOTS;
+    ring->slotSize = sizeof(va_shm_slot_t);
+    /* magic is written last, consumers treat the ring as valid only once it is set */
+    __atomic_store_n(&ring->magic, VA_RESULT_SHM_MAGIC, __ATOMIC_RELEASE);
+
+    RDK_LOG(RDK_LOG_INFO,"LOG.RDK.XCV","%s(%d): Result ring %s mapped, %d slots of %d bytes\n", __FILE__, __LINE__, VA_RESULT_SHM_NAME, VA_RESULT_RING_SLOTS, (int)sizeof(va_shm_slot_t));
+    return XCV_SUCCESS;
+}
+
+/** @description: Unmap the result ring and remove the shared memory object
+ *  @return: XCV_SUCCESS
+ */
+int shmInterface::ResultRingClose()
+{
+    if(NULL != ring) {
+        munmap(ring, sizeof(va_shm_ring_t));
+        ring = NULL;
+    }
+    if(shm_fd >= 0) {
+        close(shm_fd);
+        shm_fd = -1;
+        shm_unlink(VA_RESULT_SHM_NAME);
+    }
+    return XCV_SUCCESS;
+}
+
+/** @description: Publish the results of the current frame. The slot is filled in place,
+ *                consumers sleeping in va_shm_wait are woken up only if there are any.
+ *  @param[in] frame_result : results of the current frame from GetFrameResult
+ *  @param[in] vai_results : vai results of the current frame
+ *  @return: XCV_SUCCESS on success, XCV_FAILURE otherwise
+ */
+int shmInterface::PublishResult(const FrameResult *frame_result, vai_result_t *vai_results)
+{
+    if((NULL == ring) || (NULL == frame_result) || (NULL == vai_results)) {
+        return XCV_FAILURE;
+    }
+
+    uint64_t index = ring->published;
+    va_shm_slot_t *slot = &ring->slots[index & VA_RESULT_RING_MASK];
+    uint32_t seq = slot->seq;
+
+    __atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    va_shm_result_t *result = &slot->result;
+    slot->index = index;
+    result->framePTS = frame_result->framePTS;
+    memcpy(&result->vai, vai_results, sizeof(vai_result_t));
+    result->motionScore = frame_result->motionScore;
+    memcpy(result->unionBox, frame_result->objectBBox, sizeof(result->unionBox));
+    memcpy(result->blobBoxes, frame_result->blobBBoxs, sizeof(result->blobBoxes));
+    result->motionFlags = frame_result->motionFlags;
+
+    __atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+    __atomic_store_n(&ring->published, index + 1, __ATOMIC_RELEASE);
+
+    __atomic_add_fetch(&ring->futexWord, 1, __ATOMIC_SEQ_CST);
+    if(__atomic_load_n(&ring->waiters, __ATOMIC_SEQ_CST) > 0) {
+        futex_wake(&ring->futexWord);
+    }
+
+    return XCV_SUCCESS;
+}
@@ -0,0 +1,40 @@
+/*
+* Copyright 2020 Comcast Cable Communications Management, LLC
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* SPDX-License-Identifier: Apache-2.0
+*/
+
+#ifndef _SHMINTERFACE_H_
+#define _SHMINTERFACE_H_
+
+#include "vaResultShm.h"
+#include "xcv.h"
+
+class shmInterface
+{
+   private:
+    static int shm_fd;
+    static va_shm_ring_t* ring;
+
+   public:
+    /* Create the result ring, consumers read it through vaResultShm.h */
+    static int ResultRingInit();
+    /* Unmap and remove the result ring */
+    static int ResultRingClose();
+    /* Publish the results of the current frame */
+    static int PublishResult(const FrameResult *frame_result, vai_result_t *vai_results);
+};
+
+#endif
@@ -0,0 +1,256 @@
+/*
+* Copyright 2020 Comcast Cable Communications Management, LLC
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* SPDX-License-Identifier: Apache-2.0
+*/
+
+/* Layout of the xvisiond result ring and a header-only reader for it.
+ * Consumers include only this header, link with -lrt and need neither
+ * OpenCV nor the engine headers. See sample/ResultConsumer.cpp. */
+
+#ifndef _VARESULTSHM_H_
+#define _VARESULTSHM_H_
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "va_defines.h"
+
+#define VA_RESULT_SHM_NAME              "/xvision_va_result"
+#define VA_RESULT_SHM_MODE              0600            /* consumers run as the xvisiond user */
+#define VA_RESULT_SHM_MAGIC             0x56415253      /* "VARS" */
+#define VA_RESULT_SHM_VERSION           1
+#define VA_RESULT_RING_SLOTS            8               /* must be a power of two */
+#define VA_RESULT_RING_MASK             (VA_RESULT_RING_SLOTS - 1)
+
+/* Mirror UPPER_LIMIT_BLOB_BBS and MOTION_FLAG_* of xcv.h */
+#define VA_RESULT_MAX_BLOBS             5
+#define VA_RESULT_MOTION_INSIDE_DOI     0x01
+#define VA_RESULT_MOTION_DOI_SET        0x02
+#define VA_RESULT_MOTION_INSIDE_ROI     0x04
+#define VA_RESULT_MOTION_ROI_SET        0x08
+
+/* Per-frame analytics result published by xvisiond */
+typedef struct va_shm_result
+{
+    uint64_t framePTS;
+    vai_result_t vai;
+    float motionScore;
+    uint32_t motionFlags;                               /* VA_RESULT_MOTION_* bits */
+    int16_t unionBox[4];                                /* x, y, w, h */
+    int16_t blobBoxes[4 * VA_RESULT_MAX_BLOBS];         /* x, y, w, h per blob */
+} va_shm_result_t;
+
+/* One ring entry, protected by a seqlock */
+typedef struct va_shm_slot
+{
+    uint32_t seq;               /* odd while the writer is updating the slot */
+    uint32_t reserved;
+    uint64_t index;             /* publish index currently held by the slot */
+    va_shm_result_t result;
+} va_shm_slot_t;
+
+/* Layout of the shared memory object */
+typedef struct va_shm_ring
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slotCount;
+    uint32_t slotSize;          /* sizeof(va_shm_slot_t), guards against build flag mismatch */
+    uint64_t published;         /* number of results published so far */
+    uint32_t futexWord;         /* bumped on every publish, consumers sleep on it */
+    uint32_t waiters;           /* consumers currently sleeping on futexWord */
+    va_shm_slot_t slots[VA_RESULT_RING_SLOTS];
+} va_shm_ring_t;
+
+/* Consumer side mapping of the ring */
+typedef struct va_shm_reader
+{
+    int fd;
+    va_shm_ring_t *ring;
+} va_shm_reader_t;
+
+/** @description: Unmap the result ring
+ *  @param[in] reader : reader set up by va_shm_reader_open
+ */
+static inline void va_shm_reader_close(va_shm_reader_t *reader)
+{
+    if(NULL != reader->ring) {
+        munmap(reader->ring, sizeof(va_shm_ring_t));
+        reader->ring = NULL;
+    }
+    if(reader->fd >= 0) {
+        close(reader->fd);
+        reader->fd = -1;
+    }
+}
+
+/** @description: Attach to the result ring created by xvisiond
+ *  @param[out] reader : reader to set up
+ *  @return: XCV_SUCCESS on success, XCV_FAILURE if the ring is missing or its layout differs
+ */
+static inline int va_shm_reader_open(va_shm_reader_t *reader)
+{
+    reader->ring = NULL;
+    reader->fd = shm_open(VA_RESULT_SHM_NAME, O_RDWR, 0);
+    if(reader->fd < 0) {
+        return XCV_FAILURE;
+    }
+
+    /* read-write, waiting registers in the waiters counter */
+    void *addr = mmap(NULL, sizeof(va_shm_ring_t), PROT_READ | PROT_WRITE, MAP_SHARED, reader->fd, 0);
+    if(MAP_FAILED == addr) {
+        va_shm_reader_close(reader);
+        return XCV_FAILURE;
+    }
+    reader->ring = (va_shm_ring_t *)addr;
+
+    if((VA_RESULT_SHM_MAGIC != __atomic_load_n(&reader->ring->magic, __ATOMIC_ACQUIRE)) ||
+       (VA_RESULT_SHM_VERSION != reader->ring->version) ||
+       (VA_RESULT_RING_SLOTS != reader->ring->slotCount) ||
+       (sizeof(va_shm_slot_t) != reader->ring->slotSize)) {
+        va_shm_reader_close(reader);
+        return XCV_FAILURE;
+    }
+    return XCV_SUCCESS;
+}
+
+/** @description: Get the number of results published so far
+ *  @return: published count
+ */
+static inline uint64_t va_shm_published(const va_shm_reader_t *reader)
+{
+    return __atomic_load_n(&reader->ring->published, __ATOMIC_ACQUIRE);
+}
+
+/** @description: Block until a result newer than last_seen is published
+ *  @param[in] last_seen : published count already consumed by the caller
+ *  @param[in] timeout_ms : maximum wait in milliseconds, negative to wait forever
+ *  @return: XCV_SUCCESS if a new result is available, XCV_OTHER on timeout, XCV_FAILURE on error
+ */
+static inline int va_shm_wait(va_shm_reader_t *reader, uint64_t last_seen, int timeout_ms)
+{
+    va_shm_ring_t *ring = reader->ring;
+    struct timespec now, deadline, remaining;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    if(timeout_ms >= 0) {
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+        if(deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+
+    __atomic_add_fetch(&ring->waiters, 1, __ATOMIC_SEQ_CST);
+    int ret = XCV_OTHER;
+    while(1) {
+        uint32_t val = __atomic_load_n(&ring->futexWord, __ATOMIC_SEQ_CST);
+        if(__atomic_load_n(&ring->published, __ATOMIC_SEQ_CST) > last_seen) {
+            ret = XCV_SUCCESS;
+            break;
+        }
+
+        struct timespec *timeout = NULL;
+        if(timeout_ms >= 0) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            remaining.tv_sec = deadline.tv_sec - now.tv_sec;
+            remaining.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+            if(remaining.tv_nsec < 0) {
+                remaining.tv_sec--;
+                remaining.tv_nsec += 1000000000L;
+            }
+            if(remaining.tv_sec < 0) {
+                break;
+            }
+            timeout = &remaining;
+        }
+
+        if((0 != syscall(SYS_futex, &ring->futexWord, FUTEX_WAIT, val, timeout, NULL, 0)) &&
+           (EINTR != errno) && (EAGAIN != errno) && (ETIMEDOUT != errno)) {
+            ret = XCV_FAILURE;
+            break;
+        }
+    }
+    __atomic_sub_fetch(&ring->waiters, 1, __ATOMIC_SEQ_CST);
+
+    return ret;
+}
+
+/** @description: Start an in-place read of a published result. The returned data
+ *                is only valid if va_shm_end_read returns true afterwards.
+ *  @param[in] index : publish index to read, in [published - VA_RESULT_RING_SLOTS, published)
+ *  @param[out] seq : sequence to pass to va_shm_end_read
+ *  @return: pointer to the result in shared memory, NULL if the slot is being written
+ */
+static inline const va_shm_result_t* va_shm_begin_read(const va_shm_reader_t *reader, uint64_t index, uint32_t *seq)
+{
+    va_shm_slot_t *slot = &reader->ring->slots[index & VA_RESULT_RING_MASK];
+    *seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    if(*seq & 1) {
+        return NULL;
+    }
+    return &slot->result;
+}
+
+/** @description: Validate an in-place read started by va_shm_begin_read
+ *  @return: true if the data read in between is consistent
+ */
+static inline bool va_shm_end_read(const va_shm_reader_t *reader, uint64_t index, uint32_t seq)
+{
+    va_shm_slot_t *slot = &reader->ring->slots[index & VA_RESULT_RING_MASK];
+    uint64_t slot_index = slot->index;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq) && (slot_index == index);
+}
+
+/** @description: Copy out the most recent consistent result
+ *  @param[out] result : destination for the result
+ *  @param[out] index : publish index of the result, may be NULL
+ *  @return: XCV_SUCCESS on success, XCV_OTHER if nothing was published yet
+ */
+static inline int va_shm_read_latest(const va_shm_reader_t *reader, va_shm_result_t *result, uint64_t *index)
+{
+    while(1) {
+        uint64_t published = va_shm_published(reader);
+        if(0 == published) {
+            return XCV_OTHER;
+        }
+
+        uint32_t seq = 0;
+        const va_shm_result_t *src = va_shm_begin_read(reader, published - 1, &seq);
+        if(NULL == src) {
+            continue;
+        }
+        memcpy(result, src, sizeof(va_shm_result_t));
+        if(va_shm_end_read(reader, published - 1, seq)) {
+            if(NULL != index) {
+                *index = published - 1;
+            }
+            return XCV_SUCCESS;
+        }
+    }
+}
+
+#endif
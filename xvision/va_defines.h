@@ -42,6 +42,14 @@ extern int enable_debug;
 #define SLEEP_TIME_MAX			        100
 #define CONFIG_PARAM_MAX_LENGTH                 256     /* Array size to store user setting params */
 #define SLEEPTIMER                              100000  /*sleep time after reading one frame*/
+#define DEFAULT_ANALYSIS_FPS                    6       /* frames analysed per second */
+#define MIN_ANALYSIS_FPS                        1
+#define MAX_ANALYSIS_FPS                        30
+#define PACER_MAX_CATCHUP_FRAMES                3       /* overruns longer than this many frames are dropped even in catch-up mode */
+#define PACER_STATS_INTERVAL                    60      /* seconds between pacer statistics logs */
+#define ANALYSIS_FPS_RFC_PARAM                  "XVISION_ANALYSIS_FPS"
+#define ANALYSIS_CATCHUP_RFC_PARAM              "XVISION_OVERRUN_CATCHUP"
+#define FRAME_CLOCK_RESYNC_MS                   60000   /* interval to re-read wall clock for frame time */
 
 #define NIGHT_MODE                              1       /* Flag used to identify Night mode status */
 #define DAY_MODE                                0       /* Flag used to identify Day mode status */
@@ -20,11 +20,39 @@
 #define __XCV_H__
 
 #include "VAStructs.h"
+#include "va_defines.h"
 
 /* Upper limit for number of blob bounding boxes */
 #define UPPER_LIMIT_BLOB_BBS 5
 #define VA_ENGINE_VERSION 10
 
+/* Fields of FrameResult, requested through GetFrameResult */
+#define FRAME_RESULT_ENGINE_VERSION     0x01
+#define FRAME_RESULT_MOTION_SCORE       0x02
+#define FRAME_RESULT_OBJECT_BBOX        0x04
+#define FRAME_RESULT_BLOB_BBOXS         0x08
+#define FRAME_RESULT_MOTION_FLAGS       0x10
+#define FRAME_RESULT_DELIVERY_BBOX      0x20    /* only with _OBJ_DETECTION_ */
+
+/* Motion flags, same bit layout as the flags sent to smart thumbnail */
+#define MOTION_FLAG_INSIDE_DOI          0x01
+#define MOTION_FLAG_DOI_SET             0x02
+#define MOTION_FLAG_INSIDE_ROI          0x04
+#define MOTION_FLAG_ROI_SET             0x08
+
+/* Per-frame results, filled in a single GetFrameResult call */
+typedef struct _FrameResult
+{
+    unsigned int fields;                                /* FRAME_RESULT_* bits holding valid data */
+    unsigned long long framePTS;
+    char vaEngineVersion[VA_ENGINE_VERSION+1];
+    float motionScore;
+    short objectBBox[4];                                /* x, y, w, h of the union of motion blobs */
+    short deliveryBBox[4];                              /* x, y, w, h */
+    short blobBBoxs[4 * UPPER_LIMIT_BLOB_BBS];          /* same layout as blobBoundingBoxCoords */
+    int motionFlags;                                    /* MOTION_FLAG_* bits */
+} FrameResult;
+
 class xcvAnalyticsEngine
  {
    public:
@@ -104,6 +132,15 @@ class xcvAnalyticsEngine
     virtual bool IsMotionInsideDOI() = 0;
     /* Get if DOI set */
     virtual int IsDOISet() = 0;
+    /* get the requested results of the last processed frame. Kept last with a default
+     * body so the vtable of engines built against the older header stays valid */
+    virtual int GetFrameResult(FrameResult *result, unsigned int fields) {
+        (void)fields;
+        if(NULL != result) {
+            result->fields = 0;
+        }
+        return XCV_FAILURE;
+    }
 
    public:
     int width;
@@ -141,4 +178,26 @@ class xcvAnalyticsEngine
 typedef xcvAnalyticsEngine* CreateEngine_t();
 typedef void DestroyEngine_t(xcvAnalyticsEngine*);
 
+/* Plugin ABI versions. v1 engines are driven through the public members and virtual
+ * getters above. v2 engines additionally export GetEngineABIVersion and ProcessFrames,
+ * which take explicit frame descriptors and fill caller provided FrameResult buffers.
+ */
+#define XCV_ENGINE_ABI_V1       1
+#define XCV_ENGINE_ABI_V2       2
+
+/* Frame descriptor for ProcessFrames */
+typedef struct _xcvFrameDesc
+{
+    unsigned long long framePTS;
+    iFrameTime frameTime;
+    iImage plane0;      /* Y */
+    iImage plane1;      /* interleaved UV */
+} xcvFrameDesc;
+
+/* Types of the v2 entry points, resolved with dlsym next to CreateEngine */
+typedef int GetEngineABIVersion_t();
+/* Process count frames in order, results[i] receives the requested fields of frames[i].
+ * results may be NULL. Returns the number of frames processed, XCV_FAILURE on bad arguments */
+typedef int ProcessFrames_t(xcvAnalyticsEngine* engine, const xcvFrameDesc* frames, FrameResult* results, int count, unsigned int fields);
+
 #endif
@@ -47,6 +47,8 @@ pthread_t xcvInterface::rtMessageRecvThread;
 #endif
 
 vai_result_t* xcvInterface::vai_result = NULL;
+long long xcvInterface::wallOffsetMs = 0;
+unsigned long long xcvInterface::wallAnchorMs = 0;
 #ifdef ENABLE_TEST_HARNESS
 THInterface * xcvInterface::th_interface = NULL;
 #endif
@@ -965,6 +967,50 @@ int xcvInterface::get_current_time(struct timespec *curr_time)
     return XCV_SUCCESS;
 }
 
+/** @description: Get monotonic time
+ *  @return: CLOCK_MONOTONIC time in ms
+ */
+unsigned long long xcvInterface::get_monotonic_ms()
+{
+    struct timespec tp = {0};
+
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    return ((unsigned long long)tp.tv_sec * 1000) + (tp.tv_nsec / 1000000);
+}
+
+/** @description: Capture the time of the current frame. Only the monotonic clock is read
+ *                per frame, wall time is derived from an offset refreshed every
+ *                FRAME_CLOCK_RESYNC_MS so that every consumer of the frame sees the same time.
+ *  @parameter:
+ *  framePTS - presentation timestamp of the frame
+ *  frameTime - iFrameTime pointer
+ *  @return: XCV_SUCCESS for success
+ */
+int xcvInterface::get_frame_time(unsigned long long framePTS, iFrameTime *frameTime)
+{
+    struct timespec wall = {0};
+
+    if(NULL == frameTime) {
+	RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.XCV","%s(%d):\tTrying to use invalid memory location.\n",__FILE__,__LINE__);
+	return XCV_FAILURE;
+    }
+
+    frameTime->m_u_pts = framePTS;
+    frameTime->m_u_monoMs = get_monotonic_ms();
+
+    if((0 == wallAnchorMs) || (frameTime->m_u_monoMs - wallAnchorMs >= FRAME_CLOCK_RESYNC_MS)) {
+        if(XCV_SUCCESS != get_current_time(&wall)) {
+            return XCV_FAILURE;
+        }
+        frameTime->m_u_monoMs = get_monotonic_ms();
+        wallOffsetMs = ((long long)wall.tv_sec * 1000) + (wall.tv_nsec / 1000000) - (long long)frameTime->m_u_monoMs;
+        wallAnchorMs = frameTime->m_u_monoMs;
+    }
+
+    frameTime->m_l_wallSec = ((long long)frameTime->m_u_monoMs + wallOffsetMs) / 1000;
+
+    return XCV_SUCCESS;
+}
 
 /* @description: This function is used to update the message m with smInfo
  * @parameter: smInfo
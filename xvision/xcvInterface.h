@@ -85,6 +85,8 @@ class xcvInterface
     static int od_crop_table[OD_RAW_RES_MAX][IMG_RES_NUM];
     static int od_crop_max_width[OD_RAW_RES_MAX];
     static vai_result_t* vai_result;
+    static long long wallOffsetMs;
+    static unsigned long long wallAnchorMs;
 #ifdef ENABLE_TEST_HARNESS
     static THInterface *th_interface;
 #endif
@@ -153,6 +155,10 @@ class xcvInterface
     static int convert_iav_results(unsigned long long framePTS, vai_result_t * vi_results, iObject *objects, int count);
     /* get Current time */
     static int get_current_time(struct timespec* tstamp);
+    /* get monotonic time in ms */
+    static unsigned long long get_monotonic_ms();
+    /* Capture the time of the current frame */
+    static int get_frame_time(unsigned long long framePTS, iFrameTime *frameTime);
     /* get smart thumbnail status */
     static bool get_smart_TN_status();
     /* get roi change status */
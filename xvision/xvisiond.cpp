@@ -32,6 +32,7 @@
 #include "xcv.h"
 #include "xcvInterface.h"
 #include "iavInterface.h"
+#include "framePacer.h"
 #include "RFCCommon.h"
 #include "dev_config.h"
 #ifdef _ROI_ENABLED_
@@ -62,6 +63,9 @@ int enable_debug;
 //#include "RdkCTestHarness.h"
 #endif
 #include <rbus.h>
+#ifdef _RESULT_SHM_
+#include "shmInterface.h"
+#endif
 
 #define MAXSIZE            		 100
 #define MINSIZE            		 10
@@ -442,6 +446,96 @@ static bool check_enabled_rfc_feature(char*  rfc_feature_fname, char* feature_na
     return true;
 }
 
+/** @description: Reads a numeric parameter from the RFC file
+ *  @param[in] rfc_fname: RFC filename
+ *  @param[in] param_name: RFC parameter name
+ *  @param[in] default_val: value returned when the parameter is not set
+ *  @return: int
+ */
+static int get_rfc_int_param(char* rfc_fname, char* param_name, int default_val)
+{
+    char value[MAX_SIZE+1] = {0};
+
+    if((NULL == rfc_fname) ||
+       (NULL == param_name)) {
+	return default_val;
+    }
+
+    if((RDKC_SUCCESS == IsRFCFileAvailable(rfc_fname)) &&
+       (RDKC_SUCCESS == GetValueFromRFCFile(rfc_fname, param_name, value))) {
+	value[MAX_SIZE] = '\0';
+	if('\0' != value[0]) {
+	    RDK_LOG( RDK_LOG_INFO,"LOG.RDK.XCV","%s(%d): %s set to %s via RFC.\n",__FILE__, __LINE__, param_name, value);
+	    return atoi(value);
+	}
+    }
+    return default_val;
+}
+
+/** @description: Fill a FrameResult through the legacy getters of a v1 engine.
+ *                GetFrameResult is not part of the v1 vtable and must not be called.
+ *  @param[in] engine: v1 engine holding the last processed frame
+ *  @param[out] result: FrameResult to fill
+ *  @param[in] fields: FRAME_RESULT_* bits to fill
+ *  @return: void
+ */
+static void get_legacy_frame_result(xcvAnalyticsEngine* engine, FrameResult* result, unsigned int fields)
+{
+    result->framePTS = engine->framePTS;
+
+    if(fields & FRAME_RESULT_ENGINE_VERSION) {
+	engine->GetEngineVersion();
+	memcpy(result->vaEngineVersion, engine->vaEngineVersion, sizeof(result->vaEngineVersion));
+    }
+    if(fields & FRAME_RESULT_MOTION_SCORE) {
+	engine->motionScore = 0.0;
+	engine->GetMotionScore();
+	result->motionScore = engine->motionScore;
+    }
+    if(fields & FRAME_RESULT_OBJECT_BBOX) {
+	engine->boundingBoxXOrd = 0;
+	engine->boundingBoxYOrd = 0;
+	engine->boundingBoxHeight = 0;
+	engine->boundingBoxWidth = 0;
+	engine->GetObjectBBoxCoords();
+	result->objectBBox[0] = engine->boundingBoxXOrd;
+	result->objectBBox[1] = engine->boundingBoxYOrd;
+	result->objectBBox[2] = engine->boundingBoxWidth;
+	result->objectBBox[3] = engine->boundingBoxHeight;
+    }
+    if(fields & FRAME_RESULT_BLOB_BBOXS) {
+	engine->GetBlobsBBoxCoords();
+	memcpy(result->blobBBoxs, engine->blobBoundingBoxCoords, sizeof(result->blobBBoxs));
+    }
+#ifdef _OBJ_DETECTION_
+    if(fields & FRAME_RESULT_DELIVERY_BBOX) {
+	engine->GetDetectionObjectBBoxCoords();
+	result->deliveryBBox[0] = engine->deliveryBoundingBoxXOrd;
+	result->deliveryBBox[1] = engine->deliveryBoundingBoxYOrd;
+	result->deliveryBBox[2] = engine->deliveryBoundingBoxWidth;
+	result->deliveryBBox[3] = engine->deliveryBoundingBoxHeight;
+    }
+#endif
+    if(fields & FRAME_RESULT_MOTION_FLAGS) {
+	result->motionFlags = 0;
+#ifdef _ROI_ENABLED_
+	if(engine->IsROISet()) {
+	    result->motionFlags |= MOTION_FLAG_ROI_SET;
+	}
+	if(engine->IsMotionInsideROI()) {
+	    result->motionFlags |= MOTION_FLAG_INSIDE_ROI;
+	}
+#endif
+	if(engine->IsDOISet()) {
+	    result->motionFlags |= MOTION_FLAG_DOI_SET;
+	}
+	if(engine->IsMotionInsideDOI()) {
+	    result->motionFlags |= MOTION_FLAG_INSIDE_DOI;
+	}
+    }
+    result->fields = fields;
+}
+
 /** @description: main function
  *  @para argv - 6 for IV engine,5 for XCV Engine
  */
@@ -452,7 +546,6 @@ int main(int argc, char* argv[])
     int event_type = 0;
     int od_mode = 0;
     int time_now = 0;
-    unsigned long long timeStamp, timeStamp2;
     unsigned long long framePTS = 0;
     char* configParam = NULL;
     int algIndex = 0;
@@ -472,19 +565,23 @@ int main(int argc, char* argv[])
     bool is_smart_thumbnail_enabled = false;
     bool rfc_smart_thumbnail_enabled = false;
     char usr_value[8] = {0};
-    struct timespec frame_cap_tstamp;
     eRdkCUpScaleResolution_t resolution = UPSCALE_RESOLUTION_DEFAULT;
     SmarttnMetadata *sm = NULL;
     bool rbusEnabled = false;
-    struct timespec processing_start_t, processing_end_t;
-    int sleep_time =0;
+    framePacer pacer;
+    FrameResult frameResult;
+    unsigned int resultFields = 0;
+    GetEngineABIVersion_t* getEngineABIVersion = NULL;
+    ProcessFrames_t* processFrames = NULL;
+    xcvFrameDesc frameDesc;
+    iFrameTime frameTime;
+    int analysis_fps = DEFAULT_ANALYSIS_FPS;
     // timestamp of metadata generation
     //struct timespec metadata_gen_tstamp;
 #ifdef _ROI_ENABLED_
     std::string coords;
 #endif
 
-    memset(&frame_cap_tstamp, 0, sizeof(struct timespec));
     //memset(&metadata_gen_tstamp, 0, sizeof(struct timespec));
 
 #ifdef ENABLE_TEST_HARNESS
@@ -555,6 +652,11 @@ int main(int argc, char* argv[])
 
     RDK_LOG( RDK_LOG_INFO,"LOG.RDK.XCV","%s(%d): smart thumbnail is enabled. rfc_smart_thumbnail_enabled %d!!!\n", __FILE__, __LINE__, rfc_smart_thumbnail_enabled);
 
+    analysis_fps = get_rfc_int_param(RFCFILE, (char*)ANALYSIS_FPS_RFC_PARAM, DEFAULT_ANALYSIS_FPS);
+    if(XCV_SUCCESS != pacer.Init(analysis_fps, check_enabled_rfc_feature(RFCFILE, (char*)ANALYSIS_CATCHUP_RFC_PARAM) ? PACER_OVERRUN_CATCHUP : PACER_OVERRUN_DROP)) {
+	pacer.Init(DEFAULT_ANALYSIS_FPS, PACER_OVERRUN_DROP);
+    }
+
     strncpy(VA_Engine, "RDKCVA",MINSIZE);
     VA_Engine[MINSIZE] = '\0';
     frametype = YUV;
@@ -598,6 +700,14 @@ int main(int argc, char* argv[])
     xcvAnalyticsEngine* engine = create();
     algIndex = engine->GetAlgIndex();
 
+    // Use the v2 entry points when the plugin provides them, v1 plugins are driven as before
+    getEngineABIVersion = (GetEngineABIVersion_t*) dlsym(lib, "GetEngineABIVersion");
+    if ((NULL != getEngineABIVersion) && (getEngineABIVersion() >= XCV_ENGINE_ABI_V2)) {
+        processFrames = (ProcessFrames_t*) dlsym(lib, "ProcessFrames");
+    }
+    dlerror();
+    RDK_LOG(RDK_LOG_INFO,"LOG.RDK.XCV","%s(%d) Engine plugin ABI v%d\n", __FILE__, __LINE__, (NULL != processFrames) ? XCV_ENGINE_ABI_V2 : XCV_ENGINE_ABI_V1);
+
     if(XCV_SUCCESS != engine->reset(engine,frametype)) {
         RDK_LOG(RDK_LOG_ERROR,"LOG.RDK.XCV","%s(%d) Engine Not Created Successfully \n", __FILE__, __LINE__);
 	return XCV_FAILURE;
@@ -693,6 +803,15 @@ int main(int argc, char* argv[])
 	goto err_exit;
     }
 
+#ifdef _RESULT_SHM_
+    // Consumers keep working through rtMessage if the ring cannot be created
+    if (XCV_FAILURE == shmInterface::ResultRingInit()) {
+	RDK_LOG( RDK_LOG_WARN,"LOG.RDK.XCV","%s(%d): Unable to create result ring, local consumers disabled\n",__FILE__, __LINE__);
+    }
+#endif
+
+    // the setup above must not count as an overrun of the first frame
+    pacer.Start();
     while (!term_flag) {
 	//Check if smart thumbnail is enabled.
         is_smart_thumbnail_enabled = xcvInterface::get_smart_TN_status() || rfc_smart_thumbnail_enabled;
@@ -876,15 +995,14 @@ int main(int argc, char* argv[])
     else {
 #endif
 
-        // Frame processing start time
-        clock_gettime(CLOCK_REALTIME, &processing_start_t);
-
 	if( YUV ==  frametype ) {
 		RDK_LOG(RDK_LOG_DEBUG1,"LOG.RDK.XCV"," %s(%d)  I m reading YUV frame\n",  __FILE__, __LINE__);
 		int status = iavInterfaceAPI::rdkc_get_yuv_frame(&engine->framePTS, &engine->plane0, &engine->plane1);
 		if( status == XCV_OTHER) {
 			RDK_LOG(RDK_LOG_INFO,"LOG.RDK.XCV"," %s(%d) YUV frame not ready, retrying \n",  __FILE__, __LINE__);
 			sleep(10);
+			// the wait is not a frame overrun, restart the schedule
+			pacer.Start();
 			continue;
 		}
 	}
@@ -895,13 +1013,10 @@ int main(int argc, char* argv[])
 #endif
 	// initialize dateTime with current date and time
 	//get_iDateTime(&dateTime);
-	// initialize timeStamp with current frame timestamp in ms
-	// Below "timeStamp" and "timeStamp2" are needed to control the frame rate to analytics engine. Commenting the code now to make it similar to stable2/release.
-#ifdef OSI
-        timeStamp = getCurrentTime(NULL);
-#else
-	timeStamp = sc_linear_time(NULL);
-#endif
+	// Capture the frame time once, every result of this frame is stamped with it
+	if (XCV_SUCCESS != xcvInterface::get_frame_time(engine->framePTS, &frameTime)) {
+	    goto err_exit;
+	}
 	//RDK_LOG( RDK_LOG_DEBUG,"LOG.RDK.XCV","current timestamp: %dms\n", timeStamp);
 	//Fetch frame
 	//curr_time = 0;
@@ -913,15 +1028,7 @@ int main(int argc, char* argv[])
 	xcvInterface::reset_vai_results();
 
 #ifdef RTMSG
-        memset(&frame_cap_tstamp, 0, sizeof(struct timespec));
-        memset(curr_time, 0, sizeof(curr_time));
-        //clock_gettime(CLOCK_REALTIME, &smt_tstamp);
-        if (RDKC_SUCCESS != xcvInterface::get_current_time(&frame_cap_tstamp)) {
-            goto err_exit;
-        }
-
-        strncpy(curr_time, std::to_string(frame_cap_tstamp.tv_sec).c_str(),MAXSIZE);
-        curr_time[MAXSIZE] = '\0';
+        snprintf(curr_time, sizeof(curr_time), "%lld", frameTime.m_l_wallSec);
         RDK_LOG(RDK_LOG_DEBUG, "LOG.RDK.XCV","(%s)%d Current time stamp: %s\n", __FILE__, __LINE__, curr_time);
 
         if(is_smart_thumbnail_enabled) {
@@ -944,7 +1051,32 @@ int main(int argc, char* argv[])
 #endif
         }
 #endif
-	engine->ProcessFrame();
+	// Results needed by the enabled consumers, fetched in one call
+	resultFields = 0;
+	if(od_frame_upload_enabled) {
+		resultFields |= FRAME_RESULT_ENGINE_VERSION | FRAME_RESULT_MOTION_SCORE | FRAME_RESULT_OBJECT_BBOX | FRAME_RESULT_BLOB_BBOXS;
+	}
+	if(is_smart_thumbnail_enabled) {
+		resultFields |= FRAME_RESULT_ENGINE_VERSION | FRAME_RESULT_MOTION_SCORE | FRAME_RESULT_OBJECT_BBOX | FRAME_RESULT_BLOB_BBOXS | FRAME_RESULT_MOTION_FLAGS;
+#ifdef _OBJ_DETECTION_
+		resultFields |= FRAME_RESULT_DELIVERY_BBOX;
+#endif
+	}
+#ifdef _RESULT_SHM_
+	resultFields |= FRAME_RESULT_MOTION_SCORE | FRAME_RESULT_OBJECT_BBOX | FRAME_RESULT_BLOB_BBOXS | FRAME_RESULT_MOTION_FLAGS;
+#endif
+	memset(&frameResult, 0, sizeof(frameResult));
+	if(NULL != processFrames) {
+	    frameDesc.framePTS = engine->framePTS;
+	    frameDesc.frameTime = frameTime;
+	    frameDesc.plane0 = engine->plane0;
+	    frameDesc.plane1 = engine->plane1;
+	    if(1 != processFrames(engine, &frameDesc, &frameResult, 1, resultFields)) {
+		RDK_LOG(RDK_LOG_ERROR,"LOG.RDK.XCV","%s(%d): ProcessFrames failed!\n", __FILE__, __LINE__);
+	    }
+	} else {
+	    engine->ProcessFrame();
+	}
 
 	float val = 0.0;
 	engine->GetMotionLevel(&val);
@@ -952,6 +1084,7 @@ int main(int argc, char* argv[])
 	(xcvInterface::get_vai_structure())->motion_level = val;
 	if (od_mode == 0) {
 	    usleep(SLEEPTIMER);
+	    pacer.Start();
 	    continue;
 	}
 
@@ -979,21 +1112,11 @@ int main(int argc, char* argv[])
 	    iObject* obj_ptr = engine->objects;
 
 	    if ((engine->objects)->m_e_class == eOC_Human) {
-		#ifdef OSI
-        	time_now = getCurrentTime(NULL);
-		#else
-		time_now = sc_linear_time(NULL);
-		#endif
 		event_type = EVENT_TYPE_PEOPLE;
 		(xcvInterface::get_vai_structure())->event_type |= 1<<EVENT_TYPE_PEOPLE;
 		RDK_LOG(RDK_LOG_DEBUG1,"LOG.RDK.XCV","%s(%d): People detected (xcvInterface::get_vai_structure())->event_type %d...\n",__FILE__, __LINE__, (xcvInterface::get_vai_structure())->event_type );
 	    }
 	    else {
-		#ifdef OSI
-                time_now = getCurrentTime(NULL);
-		#else
-		time_now = sc_linear_time(NULL);
-		#endif
 		event_type = EVENT_TYPE_MOTION;
 		(xcvInterface::get_vai_structure())->event_type |= 1<<EVENT_TYPE_MOTION;
 		RDK_LOG(RDK_LOG_DEBUG1,"LOG.RDK.XCV","%s(%d): Motion detected (xcvInterface::get_vai_structure())->event_type %d...\n",__FILE__, __LINE__, (xcvInterface::get_vai_structure())->event_type );
@@ -1069,6 +1192,22 @@ int main(int argc, char* argv[])
 	(xcvInterface::get_vai_structure())->motion_level_raw = val;
 	RDK_LOG( RDK_LOG_DEBUG1,"LOG.RDK.XCV","motion_level_raw : %f\n",val);
 
+	// v2 plugins already returned the results from ProcessFrames, v1 plugins only have the legacy getters
+	if(resultFields) {
+		if(NULL == processFrames) {
+			get_legacy_frame_result(engine, &frameResult, resultFields);
+		}
+		else if(frameResult.fields != resultFields) {
+			RDK_LOG( RDK_LOG_DEBUG,"LOG.RDK.XCV","%s(%d): Frame result incomplete, requested 0x%x got 0x%x\n",__FILE__, __LINE__, resultFields, frameResult.fields);
+		}
+		RDK_LOG( RDK_LOG_DEBUG1,"LOG.RDK.XCV","%s(%d): vaEngineVersion: %s\n",__FILE__, __LINE__, frameResult.vaEngineVersion);
+		RDK_LOG( RDK_LOG_DEBUG1,"LOG.RDK.XCV","%s(%d): motionScore: %f\n",__FILE__, __LINE__, frameResult.motionScore);
+		RDK_LOG( RDK_LOG_DEBUG1,"LOG.RDK.XCV","%s(%d): boundingBox x:%d y:%d w:%d h:%d\n",__FILE__, __LINE__, frameResult.objectBBox[0], frameResult.objectBBox[1], frameResult.objectBBox[2], frameResult.objectBBox[3]);
+		for (size_t i = 0; i < sizeof(frameResult.blobBBoxs)/sizeof(frameResult.blobBBoxs[0]); ++i){
+			RDK_LOG( RDK_LOG_DEBUG1,"LOG.RDK.XCV","%s(%d):  -- blobBoundingBoxCoords %d: [%d]\n",__FILE__, __LINE__, i, frameResult.blobBBoxs[i]);
+		}
+	}
+
 #ifdef RTMSG
 	uint16_t levent_type = (xcvInterface::get_vai_structure())->event_type;
 	// Suppress the Motion event outside ROI for CVR
@@ -1077,61 +1216,16 @@ int main(int argc, char* argv[])
 	}
 
 	if(od_frame_upload_enabled) {
-		engine -> motionScore = 0.0;
-		engine  -> boundingBoxXOrd = 0;
-		engine -> boundingBoxYOrd = 0;
-		engine -> boundingBoxHeight = 0;
-		engine -> boundingBoxWidth = 0;
-
-		engine -> GetEngineVersion();
-		engine -> GetMotionScore();
-		engine -> GetObjectBBoxCoords();
-		engine -> GetBlobsBBoxCoords();
-
-		RDK_LOG( RDK_LOG_DEBUG1,"LOG.RDK.XCV","%s(%d): vaEngineVersion: %s\n",__FILE__, __LINE__, engine -> vaEngineVersion);
-		RDK_LOG( RDK_LOG_DEBUG1,"LOG.RDK.XCV","%s(%d): motionScore: %f\n",__FILE__, __LINE__, engine  -> motionScore);
-		RDK_LOG( RDK_LOG_DEBUG1,"LOG.RDK.XCV","%s(%d): boundingBoxXOrd:%d\n",__FILE__, __LINE__ , engine -> boundingBoxXOrd);
-		RDK_LOG( RDK_LOG_DEBUG1,"LOG.RDK.XCV","%s(%d): boundingBoxYOrd:%d\n",__FILE__, __LINE__, engine  -> boundingBoxYOrd);
-		RDK_LOG( RDK_LOG_DEBUG1,"LOG.RDK.XCV","%s(%d): boundingBoxHeight:%d\n",__FILE__, __LINE__, engine -> boundingBoxHeight);
-		RDK_LOG( RDK_LOG_DEBUG1,"LOG.RDK.XCV","%s(%d): boundingBoxWidth:%d\n",__FILE__, __LINE__, engine -> boundingBoxWidth);
-        RDK_LOG( RDK_LOG_DEBUG1,"LOG.RDK.XCV","%s(%d): blobBoundingBoxCoords:\n",__FILE__, __LINE__);
-        for (size_t i = 0; i < sizeof(engine -> blobBoundingBoxCoords)/sizeof(engine -> blobBoundingBoxCoords[0]); ++i){
-            RDK_LOG( RDK_LOG_DEBUG1,"LOG.RDK.XCV","%s(%d):  -- blobBoundingBoxCoords %d: [%d]\n",__FILE__, __LINE__, i, engine -> blobBoundingBoxCoords[i]);
-        }
-		RDK_LOG( RDK_LOG_DEBUG1,"LOG.RDK.XCV","%s(%d): Current timestamp:%d\n",__FILE__, __LINE__, curr_time);
+		RDK_LOG( RDK_LOG_DEBUG1,"LOG.RDK.XCV","%s(%d): Current timestamp:%s\n",__FILE__, __LINE__, curr_time);
 
-		xcvInterface::notifyCVR(engine -> vaEngineVersion, (xcvInterface::get_vai_structure())->timestamp, levent_type, (xcvInterface::get_vai_structure())->motion_level_raw, engine ->motionScore , engine  -> boundingBoxXOrd , engine -> boundingBoxYOrd, engine -> boundingBoxHeight, engine -> boundingBoxWidth, curr_time);
+		xcvInterface::notifyCVR(frameResult.vaEngineVersion, (xcvInterface::get_vai_structure())->timestamp, levent_type, (xcvInterface::get_vai_structure())->motion_level_raw, frameResult.motionScore, frameResult.objectBBox[0], frameResult.objectBBox[1], frameResult.objectBBox[3], frameResult.objectBBox[2], curr_time);
 
 	} else {
 		xcvInterface::notifyCVR((xcvInterface::get_vai_structure())->timestamp, levent_type, (xcvInterface::get_vai_structure())->motion_level_raw, curr_time);
 	}
 
 	 if(is_smart_thumbnail_enabled) {
-                engine -> motionScore = 0.0;
-                engine  -> boundingBoxXOrd = 0;
-                engine -> boundingBoxYOrd = 0;
-                engine -> boundingBoxHeight = 0;
-                engine -> boundingBoxWidth = 0;
-
-                engine -> GetEngineVersion();
-                engine -> GetMotionScore();
-                engine -> GetObjectBBoxCoords();
-                engine -> GetBlobsBBoxCoords();
-#ifdef _OBJ_DETECTION_
-                engine -> GetDetectionObjectBBoxCoords();
-#endif
-
-                RDK_LOG( RDK_LOG_DEBUG1,"LOG.RDK.XCV","%s(%d): vaEngineVersion: %s\n",__FILE__, __LINE__, engine -> vaEngineVersion);
-                RDK_LOG( RDK_LOG_DEBUG1,"LOG.RDK.XCV","%s(%d): motionScore: %f\n",__FILE__, __LINE__, engine  -> motionScore);
-                RDK_LOG( RDK_LOG_DEBUG1,"LOG.RDK.XCV","%s(%d): boundingBoxXOrd:%d\n",__FILE__, __LINE__ , engine -> boundingBoxXOrd);
-                RDK_LOG( RDK_LOG_DEBUG1,"LOG.RDK.XCV","%s(%d): boundingBoxYOrd:%d\n",__FILE__, __LINE__, engine  -> boundingBoxYOrd);
-                RDK_LOG( RDK_LOG_DEBUG1,"LOG.RDK.XCV","%s(%d): boundingBoxHeight:%d\n",__FILE__, __LINE__, engine -> boundingBoxHeight);
-                RDK_LOG( RDK_LOG_DEBUG1,"LOG.RDK.XCV","%s(%d): boundingBoxWidth:%d\n",__FILE__, __LINE__, engine -> boundingBoxWidth);
-                RDK_LOG( RDK_LOG_DEBUG1,"LOG.RDK.XCV","%s(%d): blobBoundingBoxCoords:\n",__FILE__, __LINE__);
-                for (size_t i = 0; i < sizeof(engine -> blobBoundingBoxCoords)/sizeof(engine -> blobBoundingBoxCoords[0]); ++i){
-                    RDK_LOG( RDK_LOG_DEBUG1,"LOG.RDK.XCV","%s(%d):  -- blobBoundingBoxCoords %d: [%d]\n",__FILE__, __LINE__, i, engine -> blobBoundingBoxCoords[i]);
-                }
-                RDK_LOG( RDK_LOG_DEBUG1,"LOG.RDK.XCV","%s(%d): Current timestamp:%d\n",__FILE__, __LINE__, curr_time);
+                RDK_LOG( RDK_LOG_DEBUG1,"LOG.RDK.XCV","%s(%d): Current timestamp:%s\n",__FILE__, __LINE__, curr_time);
 
                 /*memset(&metadata_gen_tstamp, 0, sizeof(struct timespec));
                 if (RDKC_SUCCESS != xcvInterface::get_current_time(&metadata_gen_tstamp)) {
@@ -1141,9 +1235,7 @@ int main(int argc, char* argv[])
                 if(!sm) {
                     RDK_LOG( RDK_LOG_ERROR,"LOG.RDK.XCV","%s(%d):\tError creating SmarttnMetadata.\n",__FILE__,__LINE__);
                 } else {
-                    int motionFlags = 0;
-
-		    /** MOTION FLAGS 
+		    /** MOTION FLAGS
                      *  Motion flags is an integer containing flags describing the motion.
                      *  Each bit corresponds to some flags.
                      *
@@ -1154,23 +1246,11 @@ int main(int argc, char* argv[])
                      *                                                             | Is Motion inside ROI
                      *                                                             If ROI is set
                      *
-                     * All other bit are unused. */
-      
-                    /* Set ROI flags */
-		    motionFlags |= engine -> IsROISet();
-                    motionFlags = motionFlags << 1;
-		    if(engine -> IsMotionInsideROI()) {
-                        motionFlags |= 0x01;
-                    }
-                    /* Set DOI flags */
-		    motionFlags = (motionFlags << 1) | engine -> IsDOISet();
-                    motionFlags = motionFlags << 1;
-                    if(engine -> IsMotionInsideDOI()) {
-                        motionFlags |= 0x01;
-                    }
+                     * All other bit are unused. See MOTION_FLAG_* in xcv.h */
+                    int motionFlags = frameResult.motionFlags;
 
                     RDK_LOG( RDK_LOG_DEBUG,"LOG.RDK.XCV","%s(%d):\tMotion Flags: %d \n",__FILE__,__LINE__, motionFlags);
-                    int rc = xcvInterface::notifySmartThumbnail(engine -> vaEngineVersion, sm, motionFlags);
+                    int rc = xcvInterface::notifySmartThumbnail(frameResult.vaEngineVersion, sm, motionFlags);
                     delete sm;
                     sm = NULL;
                     if(rc) {
@@ -1205,17 +1285,16 @@ int main(int argc, char* argv[])
 	//Send VAI Results to hydra
         iavInterfaceAPI::VA_send_result(va_send_id, (xcvInterface::get_vai_structure()));
 
+#ifdef _RESULT_SHM_
+	// Publish results to local consumers
+	shmInterface::PublishResult(&frameResult, xcvInterface::get_vai_structure());
+#endif
+
 	// Log VAI Results which is sent to hydra
 	vai_result_t* va_to_hydra = xcvInterface::get_vai_structure();
 	RDK_LOG( RDK_LOG_DEBUG1,"LOG.RDK.XCV","Event[%d] Motion Level[%f] Raw Motion Level[%f] Number of Detected Objects[%d]  TimeStamp[%llu]\n", va_to_hydra->event_type, va_to_hydra->motion_level, va_to_hydra->motion_level_raw, va_to_hydra->num, va_to_hydra->timestamp);
 
-	// Below "timeStamp2" and above "timeStamp" are needed to control the frame rate to analytics engine. Commenting the code now to make it similar to stable2/release.
-	#ifdef OSI
-        timeStamp2 = getCurrentTime(NULL);
-	#else
-        timeStamp2 = sc_linear_time(NULL);
-	#endif
-	RDK_LOG( RDK_LOG_DEBUG1,"LOG.RDK.XCV","loop cost: %llu ms\n", timeStamp2-timeStamp);
+	RDK_LOG( RDK_LOG_DEBUG1,"LOG.RDK.XCV","loop cost: %llu ms\n", xcvInterface::get_monotonic_ms() - frameTime.m_u_monoMs);
 #ifdef ENABLE_TEST_HARNESS
                 /* to avoid sleep only when frame is from file */
                 if( th->THGetFileFeedEnabledParam() == true ) {
@@ -1230,19 +1309,8 @@ int main(int argc, char* argv[])
 	    usleep(SLEEPTIMER);
 	}*/
 
-        // Frame processing start time
-        clock_gettime(CLOCK_REALTIME, &processing_end_t);
-
-        sleep_time = (1000000/6) - (((int)(processing_end_t.tv_nsec - processing_start_t.tv_nsec) /1000) + ((int)(processing_end_t.tv_sec - processing_start_t.tv_sec) *1000000));
-
-	RDK_LOG( RDK_LOG_DEBUG,"LOG.RDK.XCV","sleeping %d ms\n", sleep_time);
-
-        if(sleep_time > 0) {
-	        usleep(sleep_time);
-	} else {
-		// sleep for 100ms after processing every frame
-		usleep(SLEEPTIMER);
-        }
+        // Sleep until the next frame deadline
+        pacer.WaitNextFrame();
 
 #ifdef ENABLE_TEST_HARNESS
 iva_loop_end:
@@ -1267,6 +1335,10 @@ err_exit:
 #ifdef RTMSG
     xcvInterface::rtMessageClose();
 #endif
+    RDK_LOG( RDK_LOG_INFO,"LOG.RDK.XCV","%s(%d): Pacer frames:%llu overruns:%llu dropped:%llu\n", __FILE__, __LINE__, pacer.GetFrameCount(), pacer.GetOverrunCount(), pacer.GetDroppedCount());
+#ifdef _RESULT_SHM_
+    shmInterface::ResultRingClose();
+#endif
 
     iavInterfaceAPI::rdkc_source_buffer_close();
 